@@ -0,0 +1,56 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark support
+ * @file bench.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <dwt.hh>
+
+#ifndef BENCH_BENCH_HH
+#define BENCH_BENCH_HH
+
+/// Every benchmark image fills a global bench_results object and returns
+/// from bench::run(), the startup sets bench_done then. Results are read
+/// with a debugger: break on bench_done change and print bench_results.
+extern volatile lp::u32_t bench_done;
+
+namespace bench {
+    /// Benchmark body, one per firmware image, called by the startup with
+    /// data and bss set up and static constructors run
+    void run() noexcept;
+
+    /// Dwt cycle counter on, hal::clock::start is not used so no SysTick
+    /// interrupt disturbs the measurements
+    inline void enable_cycles() noexcept {
+        ::dcb::demcr::get() = ::dcb::demcr::get() | ::dcb::demcr_trcena::mask<lp::u32_t>::value;
+        ::dwt::cyccnt::get() = 0;
+        ::dwt::ctrl::get() = ::dwt::ctrl::get() | ::dwt::ctrl_cyccntena::mask<lp::u32_t>::value;
+    }
+
+    /// Dwt cycles of one call of function
+    template <typename Function>
+    inline lp::u32_t measure(Function function) noexcept {
+        const lp::u32_t begin = ::dwt::cyccnt::get();
+
+        function();
+
+        return ::dwt::cyccnt::get() - begin;
+    }
+}
+
+#endif // BENCH_BENCH_HH
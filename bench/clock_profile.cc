@@ -0,0 +1,111 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of clock profile switch latency
+ * @file clock_profile.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_profile.hh>
+#include <hal/clock_tree.hh>
+#include <hal/flash_accel.hh>
+
+#include "bench.hh"
+
+namespace {
+    /// Pll burst, pll relock needing the bridge, msi and hsi16 low power
+    using profiles = hal::clock_profile<
+        hal::clock_tree<hal::clock_source::pll_msi, 80000000>,
+        hal::clock_tree<hal::clock_source::pll_msi, 48000000>,
+        hal::clock_tree<hal::clock_source::msi, 2000000>,
+        hal::clock_tree<hal::clock_source::hsi16, 16000000>
+    >;
+
+    constexpr lp::u32_t rounds = 16;
+}
+
+/// Worst latency of every switch from one profile to another in
+/// microseconds, [from][to], over rounds switches each
+struct clock_profile_result {
+    /// Whole select() by dwt around the call
+    lp::u32_t switch_us[profiles::count][profiles::count];
+    /// Longest masked part as the profile reports it
+    lp::u32_t masked_us[profiles::count][profiles::count];
+    lp::u32_t masked_bound_us;
+    lp::u32_t worst_masked_us;
+    lp::u32_t failures;
+    /// Every masked part within masked_bound_us
+    bool within_bound;
+};
+
+volatile clock_profile_result bench_results;
+
+namespace {
+    lp::u32_t to_us(lp::u32_t cycles, lp::u32_t hz) noexcept {
+        return static_cast<lp::u32_t>((static_cast<lp::u64_t>(cycles) * 1000000 + hz - 1) / hz);
+    }
+}
+
+void bench::run() noexcept {
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    bench::enable_cycles();
+
+    lp::u32_t failures = 0;
+    lp::u32_t worst_masked = 0;
+
+    for (lp::u32_t from = 0; from < profiles::count; ++from) {
+        for (lp::u32_t to = 0; to < profiles::count; ++to) {
+            lp::u32_t worst_switch = 0;
+            lp::u32_t worst_pair = 0;
+
+            if (from == to) {
+                continue;
+            }
+
+            for (lp::u32_t round = 0; round < rounds; ++round) {
+                if (!profiles::select(from)) {
+                    ++failures;
+                    continue;
+                }
+
+                profiles::reset_statistics();
+
+                const lp::u32_t cycles = bench::measure([to] {
+                    profiles::select(to);
+                });
+                const auto stats = profiles::report();
+                const lp::u32_t hz = profiles::frequencies(from).hclk_hz < profiles::frequencies(to).hclk_hz ?
+                    profiles::frequencies(from).hclk_hz : profiles::frequencies(to).hclk_hz;
+                const lp::u32_t us = to_us(cycles, hz);
+
+                failures += stats.failures;
+                worst_switch = us > worst_switch ? us : worst_switch;
+                worst_pair = stats.worst_masked_us > worst_pair ? stats.worst_masked_us : worst_pair;
+            }
+
+            bench_results.switch_us[from][to] = worst_switch;
+            bench_results.masked_us[from][to] = worst_pair;
+            worst_masked = worst_pair > worst_masked ? worst_pair : worst_masked;
+        }
+    }
+
+    profiles::select(0);
+
+    bench_results.masked_bound_us = profiles::masked_bound_us;
+    bench_results.worst_masked_us = worst_masked;
+    bench_results.failures = failures;
+    bench_results.within_bound = failures == 0 && worst_masked <= profiles::masked_bound_us;
+}
@@ -0,0 +1,90 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of crc unit, crc unit with dma and software crc
+ * @file crc.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/crc.hh>
+#include <hal/dma.hh>
+#include <hal/flash_accel.hh>
+#include <hal/rcc.hh>
+
+#include "bench.hh"
+
+/// Cycles of one 4 KB crc at 80 MHz by each path
+struct crc_result {
+    lp::u32_t unit_cycles;
+    lp::u32_t dma_cycles;
+    lp::u32_t software_cycles;
+    /// All paths gave the same crc
+    bool agree;
+};
+
+/// Crc32 (reflected, dma moves words) and crc32_mpeg2 (plain, dma moves
+/// bytes)
+volatile crc_result bench_results[2];
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+    using channel = hal::dma1_mem<1>;
+
+    constexpr lp::u32_t size = 4096;
+
+    alignas(4) lp::u8_t buffer[size];
+
+    template <typename Config>
+    void measure_config(volatile crc_result &result) noexcept {
+        using unit = hal::crc<Config>;
+        using software = hal::crc_software<Config>;
+
+        lp::u32_t by_unit = 0;
+        lp::u32_t by_dma = 0;
+        lp::u32_t by_software = 0;
+        bool dma_done = false;
+
+        result.unit_cycles = bench::measure([&by_unit] {
+            by_unit = unit::compute(buffer, size);
+        });
+        result.dma_cycles = bench::measure([&by_dma, &dma_done] {
+            dma_done = unit::template compute_dma<channel>(buffer, size, by_dma);
+        });
+        result.software_cycles = bench::measure([&by_software] {
+            by_software = software::compute(buffer, size);
+        });
+        result.agree = dma_done && by_unit == by_dma && by_dma == by_software;
+    }
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    hal::rcc::device_enable<hal::rcc_device::dma1en>();
+    hal::crc<hal::crc32>::enable();
+    bench::enable_cycles();
+
+    for (lp::u32_t i = 0; i < size; ++i) {
+        buffer[i] = static_cast<lp::u8_t>(i * 37 + 11);
+    }
+
+    measure_config<hal::crc32>(bench_results[0]);
+    measure_config<hal::crc32_mpeg2>(bench_results[1]);
+}
@@ -0,0 +1,131 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of flash erase and programming modes
+ * @file flash.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/flash.hh>
+#include <hal/flash_accel.hh>
+#include <hal/flash_device.hh>
+
+#include "isr_base.hh"
+#include "isr_extend.hh"
+
+#include "bench.hh"
+
+/// Throughput of each flash::mode meter at 80 MHz over 16 KB of the
+/// upper bank, code runs from the lower one
+struct flash_result {
+    lp::u32_t erase_bytes_per_second;
+    lp::u32_t double_word_bytes_per_second;
+    lp::u32_t row_bytes_per_second;
+    /// Mass erase of the upper bank
+    lp::u32_t bank_erase_cycles;
+    /// erase_page_async() call to done hook, and main loop rounds meanwhile
+    lp::u32_t async_erase_cycles;
+    lp::u32_t async_spins;
+    /// Every operation returned ok and the data read back
+    bool ok;
+};
+
+volatile flash_result bench_results;
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+
+    constexpr lp::u32_t core_hz = 80000000;
+    constexpr lp::addr_t region = hal::flash_device::base + hal::flash_device::bank_size;
+    constexpr lp::u32_t size = 16 * 1024;
+
+    alignas(8) lp::u8_t data[hal::flash_device::row_size];
+
+    volatile bool erased = false;
+    volatile hal::flash_status erase_status = hal::flash_status::busy;
+
+    void erase_done(hal::flash_status status) noexcept {
+        erase_status = status;
+        erased = true;
+    }
+
+    bool holds_data() noexcept {
+        for (lp::addr_t address = region; address < region + size; address += sizeof(data)) {
+            if (__builtin_memcmp(reinterpret_cast<const void *>(address), data, sizeof(data)) != 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+void isr::FLASH() {
+    hal::flash::irq_handler();
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    bench::enable_cycles();
+    hal::flash::unlock();
+
+    for (lp::u32_t i = 0; i < sizeof(data); ++i) {
+        data[i] = static_cast<lp::u8_t>(i * 37 + 11);
+    }
+
+    bool ok = true;
+
+    bench_results.bank_erase_cycles = bench::measure([&ok] {
+        ok = hal::flash::erase_bank(region) == hal::flash_status::ok && ok;
+    });
+
+    hal::flash::reset_meters();
+
+    for (lp::addr_t address = region; address < region + size; address += sizeof(data)) {
+        ok = hal::flash::program_row(address, data) == hal::flash_status::ok && ok;
+    }
+
+    ok = holds_data() && ok;
+    ok = hal::flash::erase(region, size) == hal::flash_status::ok && ok;
+
+    for (lp::addr_t address = region; address < region + size; address += sizeof(data)) {
+        ok = hal::flash::program(address, data, sizeof(data)) == hal::flash_status::ok && ok;
+    }
+
+    ok = holds_data() && ok;
+
+    lp::u32_t spins = 0;
+
+    bench_results.async_erase_cycles = bench::measure([&ok, &spins] {
+        ok = hal::flash::erase_page_async(region, erase_done) == hal::flash_status::ok && ok;
+
+        while (!erased) {
+            ++spins;
+        }
+    });
+
+    bench_results.async_spins = spins;
+    bench_results.erase_bytes_per_second = hal::flash::bytes_per_second<core_hz>(hal::flash::mode::erase);
+    bench_results.double_word_bytes_per_second =
+        hal::flash::bytes_per_second<core_hz>(hal::flash::mode::double_word);
+    bench_results.row_bytes_per_second = hal::flash::bytes_per_second<core_hz>(hal::flash::mode::row);
+    bench_results.ok = ok && erase_status == hal::flash_status::ok;
+}
@@ -0,0 +1,115 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of flash prefetch and caches
+ * @file flash_accel.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/flash_accel.hh>
+
+#include "bench.hh"
+
+/// Cycles of both workloads at 80 MHz and 4 wait states
+struct flash_accel_result {
+    lp::u32_t code_cycles;
+    lp::u32_t data_cycles;
+};
+
+/// Indexed by setting, bit 2 prefetch, bit 1 icache, bit 0 dcache
+volatile flash_accel_result bench_results[8];
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+
+    constexpr lp::u32_t rounds = 4096;
+
+    struct lookup_table {
+        lp::u32_t entry[64];
+    };
+
+    constexpr lookup_table make_table() noexcept {
+        lookup_table result{};
+        lp::u32_t value = 0x12345678;
+
+        for (auto &entry : result.entry) {
+            value = value * 1664525 + 1013904223;
+            entry = value;
+        }
+
+        return result;
+    }
+
+    /// Flash resident, 256 bytes as the data cache
+    constexpr lookup_table table = make_table();
+
+    volatile lp::u32_t seed = 1;
+    volatile lp::u32_t sink;
+
+    /// Instruction fetch bound, straight line mixing run from flash
+    __attribute__((noinline)) void code_bound() noexcept {
+        lp::u32_t value = seed;
+
+        for (lp::u32_t round = 0; round < rounds; ++round) {
+            value ^= value << 13;
+            value ^= value >> 17;
+            value ^= value << 5;
+            value = value * 0x9e3779b1 + round;
+            value ^= value >> 15;
+            value = (value << 7) | (value >> 25);
+        }
+
+        sink = value;
+    }
+
+    /// Flash data read bound, table lookups in pseudo random order
+    __attribute__((noinline)) void data_bound() noexcept {
+        lp::u32_t value = seed;
+        lp::u32_t sum = 0;
+
+        for (lp::u32_t round = 0; round < rounds; ++round) {
+            value = value * 1664525 + 1013904223;
+            sum += table.entry[value >> 26];
+        }
+
+        sink = sum;
+    }
+
+    /// Caches are reset on each setting, both workloads start cold
+    template <lp::u32_t Setting>
+    void measure_setting() noexcept {
+        hal::flash_accel::configure<hal::flash_accel_config<(Setting & 4) != 0, (Setting & 2) != 0, (Setting & 1) != 0>>();
+
+        bench_results[Setting].code_cycles = bench::measure(code_bound);
+        bench_results[Setting].data_cycles = bench::measure(data_bound);
+    }
+
+    template <lp::u32_t ...Settings>
+    void measure_all() noexcept {
+        const int settings[] = {0, (measure_setting<Settings>(), 0)...};
+        (void)settings;
+    }
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    bench::enable_cycles();
+    measure_all<0, 1, 2, 3, 4, 5, 6, 7>();
+}
@@ -0,0 +1,106 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of flash key/value store writes, lookups and boot
+ * @file flash_kv.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/flash_accel.hh>
+#include <hal/flash_kv.hh>
+
+#include "bench.hh"
+
+/// Cycles at 80 MHz of a 64 KB store kept busy until every page took
+/// records and collections ran
+struct flash_kv_result {
+    /// start() replaying the whole region
+    lp::u32_t boot_cycles;
+    /// Any set(), collections included
+    lp::u32_t worst_write_cycles;
+    /// set() without a collection
+    lp::u32_t worst_append_cycles;
+    lp::u32_t worst_get_cycles;
+    lp::u32_t collections;
+    /// Append below 1 ms and boot below 10 ms
+    bool within_targets;
+};
+
+volatile flash_kv_result bench_results;
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+    /// Last 64 KB of the upper bank, away from the image
+    using store = hal::flash_kv<0x080f0000, 32, 64, 128>;
+
+    constexpr lp::u32_t keys = 64;
+    constexpr lp::u32_t writes = 1200;
+    constexpr lp::u32_t cycles_per_ms = 80000;
+
+    lp::u8_t value[128];
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    bench::enable_cycles();
+
+    if (store::start() == hal::kv_status::failed) {
+        return;
+    }
+
+    lp::u32_t worst_append = 0;
+
+    for (lp::u32_t write = 0; write < writes; ++write) {
+        const lp::u32_t collections = store::report().collections;
+
+        __builtin_memset(value, static_cast<int>(write), sizeof(value));
+
+        const lp::u32_t spent = bench::measure([write] {
+            store::set(static_cast<lp::u16_t>(write % keys), value, sizeof(value));
+        });
+
+        if (store::report().collections == collections && spent > worst_append) {
+            worst_append = spent;
+        }
+    }
+
+    const store::statistics filled = store::report();
+
+    store::start();
+
+    lp::u32_t worst_get = 0;
+
+    for (lp::u32_t key = 0; key < keys; ++key) {
+        lp::u32_t size = 0;
+        const lp::u32_t spent = bench::measure([key, &size] {
+            store::get(static_cast<lp::u16_t>(key), value, sizeof(value), size);
+        });
+
+        worst_get = spent > worst_get ? spent : worst_get;
+    }
+
+    bench_results.boot_cycles = store::report().boot_cycles;
+    bench_results.worst_write_cycles = filled.worst_write_cycles;
+    bench_results.worst_append_cycles = worst_append;
+    bench_results.worst_get_cycles = worst_get;
+    bench_results.collections = filled.collections;
+    bench_results.within_targets = worst_append < cycles_per_ms && bench_results.boot_cycles < 10 * cycles_per_ms;
+}
@@ -0,0 +1,168 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of flash log under a periodic control loop
+ * @file flash_log.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <stk.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/flash.hh>
+#include <hal/flash_accel.hh>
+#include <hal/flash_log.hh>
+
+#include "isr_base.hh"
+#include "isr_extend.hh"
+
+#include "bench.hh"
+
+/// A 10 kHz SysTick control loop at 80 MHz, first alone, then appending
+/// a record per run while the main loop writes them and pages are
+/// erased in the background. Latency is in core cycles from the SysTick
+/// reload to the handler reading the counter, jitter is max - min.
+struct flash_log_result {
+    lp::u32_t quiet_latency_min;
+    lp::u32_t quiet_latency_max;
+    lp::u32_t logged_latency_min;
+    lp::u32_t logged_latency_max;
+    /// Record bytes programmed per second while logging
+    lp::u32_t bytes_per_second;
+    lp::u32_t erases;
+    lp::u32_t dropped;
+    lp::u32_t failed;
+    lp::u32_t max_queued;
+    lp::u32_t worst_append_cycles;
+    lp::u32_t worst_poll_cycles;
+};
+
+volatile flash_log_result bench_results;
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+
+    struct sample {
+        lp::u32_t tick;
+        lp::u32_t latency;
+        lp::u32_t spare[2];
+    };
+
+    /// Upper bank, code runs from the lower one; 25 ms of erase at 10 kHz
+    /// queues 250 records
+    using record_log = hal::flash_log<sample, 0x08080000, 16, 512>;
+
+    constexpr lp::u32_t core_hz = 80000000;
+    constexpr lp::u32_t period = core_hz / 10000;
+    constexpr lp::u32_t quiet_ticks = 10000;
+    constexpr lp::u32_t logged_ticks = 20000;
+
+    volatile lp::u32_t ticks = 0;
+    volatile bool logging = false;
+    lp::u32_t latency_min = ~0u;
+    lp::u32_t latency_max = 0;
+
+    void wait_ticks(lp::u32_t count) noexcept {
+        const lp::u32_t end = ticks + count;
+
+        while (ticks != end) {
+            if (logging) {
+                record_log::poll();
+            }
+        }
+    }
+
+    void take_latency(lp::u32_t &low, lp::u32_t &high) noexcept {
+        ::stk::ctrl::get() = ::stk::ctrl::get() & ~::stk::ctrl_tickint::mask<lp::u32_t>::value;
+        low = latency_min;
+        high = latency_max;
+        latency_min = ~0u;
+        latency_max = 0;
+        ::stk::ctrl::get() = ::stk::ctrl::get() | ::stk::ctrl_tickint::mask<lp::u32_t>::value;
+    }
+}
+
+void isr::sys_tick_timer() {
+    const lp::u32_t latency = ::stk::load::get() - ::stk::val::get();
+
+    latency_min = latency < latency_min ? latency : latency_min;
+    latency_max = latency > latency_max ? latency : latency_max;
+
+    if (logging) {
+        record_log::append({ticks, latency, {0, 0}});
+    }
+
+    ticks = ticks + 1;
+}
+
+void isr::FLASH() {
+    hal::flash::irq_handler();
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    bench::enable_cycles();
+
+    if (record_log::start() != hal::flash_status::ok) {
+        return;
+    }
+
+    ::stk::load::get() = period - 1;
+    ::stk::val::get() = 0;
+    ::stk::ctrl::get() = ::stk::ctrl_clksource::mask<lp::u32_t>::value |
+        ::stk::ctrl_tickint::mask<lp::u32_t>::value | ::stk::ctrl_enable::mask<lp::u32_t>::value;
+
+    wait_ticks(1);
+
+    lp::u32_t low;
+    lp::u32_t high;
+
+    take_latency(low, high);
+    wait_ticks(quiet_ticks);
+    take_latency(low, high);
+    bench_results.quiet_latency_min = low;
+    bench_results.quiet_latency_max = high;
+
+    record_log::reset_statistics();
+    logging = true;
+
+    const lp::u32_t begin = ::dwt::cyccnt::get();
+
+    wait_ticks(logged_ticks);
+
+    const lp::u32_t spent = ::dwt::cyccnt::get() - begin;
+
+    take_latency(low, high);
+    logging = false;
+    ::stk::ctrl::get() = 0;
+
+    const record_log::statistics figures = record_log::report();
+
+    bench_results.logged_latency_min = low;
+    bench_results.logged_latency_max = high;
+    bench_results.bytes_per_second = static_cast<lp::u32_t>(
+        static_cast<lp::u64_t>(figures.written) * record_log::record_size * core_hz / spent);
+    bench_results.erases = figures.erases;
+    bench_results.dropped = figures.dropped;
+    bench_results.failed = figures.failed;
+    bench_results.max_queued = figures.max_queued;
+    bench_results.worst_append_cycles = figures.worst_append_cycles;
+    bench_results.worst_poll_cycles = figures.worst_poll_cycles;
+}
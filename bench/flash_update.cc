@@ -0,0 +1,116 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of dual bank update flash and total time
+ * @file flash_update.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/crc.hh>
+#include <hal/flash_accel.hh>
+#include <hal/flash_update.hh>
+
+#include "bench.hh"
+
+/// A 64 KB image streamed from ram in 240 byte packets at 80 MHz, the
+/// fastest transport possible. A transport of fewer bytes per second
+/// than flash_bytes_per_second bounds the update, not flash.
+struct flash_update_result {
+    lp::u32_t bytes;
+    /// Bank erase and row programming with read back crc
+    lp::u32_t flash_cycles;
+    /// Bank erase share of flash_cycles
+    lp::u32_t erase_cycles;
+    lp::u32_t total_cycles;
+    /// Bytes per second of flash_cycles alone, with and without the
+    /// bank erase
+    lp::u32_t flash_bytes_per_second;
+    lp::u32_t program_bytes_per_second;
+    /// finish() saw the image crc in flash
+    bool verified;
+};
+
+volatile flash_update_result bench_results;
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+    using software = hal::crc_software<hal::crc32_mpeg2>;
+
+    constexpr lp::u32_t image_size = 64 * 1024;
+    constexpr lp::u32_t packet_size = 240;
+    constexpr lp::u64_t core_hz = 80000000;
+
+    lp::u8_t packet[packet_size];
+
+    /// Image bytes from offset, the same on every pass
+    lp::u32_t make_packet(lp::u32_t offset) noexcept {
+        const lp::u32_t left = image_size - offset;
+        const lp::u32_t size = left < packet_size ? left : packet_size;
+
+        for (lp::u32_t i = 0; i < size; ++i) {
+            packet[i] = static_cast<lp::u8_t>((offset + i) * 37 + 11);
+        }
+
+        return size;
+    }
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    bench::enable_cycles();
+
+    lp::u32_t state = software::start();
+
+    for (lp::u32_t offset = 0; offset < image_size; ) {
+        const lp::u32_t size = make_packet(offset);
+
+        state = software::update(state, packet, size);
+        offset += size;
+    }
+
+    if (hal::flash_update::begin(image_size) != hal::flash_status::ok) {
+        return;
+    }
+
+    const lp::u32_t erase = static_cast<lp::u32_t>(hal::flash_update::report().flash_cycles);
+
+    for (lp::u32_t offset = 0; offset < image_size; ) {
+        const lp::u32_t size = make_packet(offset);
+
+        if (hal::flash_update::write(packet, size) != hal::flash_status::ok) {
+            return;
+        }
+
+        offset += size;
+    }
+
+    bench_results.verified = hal::flash_update::finish(software::finish(state)) == hal::flash_status::ok;
+
+    const hal::flash_update::statistics figures = hal::flash_update::report();
+
+    bench_results.bytes = figures.bytes;
+    bench_results.flash_cycles = static_cast<lp::u32_t>(figures.flash_cycles);
+    bench_results.total_cycles = static_cast<lp::u32_t>(figures.total_cycles);
+    bench_results.erase_cycles = erase;
+    bench_results.flash_bytes_per_second = static_cast<lp::u32_t>(figures.bytes * core_hz / figures.flash_cycles);
+    bench_results.program_bytes_per_second = static_cast<lp::u32_t>(
+        figures.bytes * core_hz / (figures.flash_cycles - erase));
+}
@@ -0,0 +1,140 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark of hash processor feeds with known answer checks
+ * @file hash.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/flash_accel.hh>
+#include <hal/hash.hh>
+#include <hal/rcc.hh>
+
+#include "bench.hh"
+
+/// Sha-256 throughput at 80 MHz in bytes per second, MB/s is this / 10^6
+struct hash_result {
+    lp::u32_t core_bytes_per_second;
+    lp::u32_t dma_bytes_per_second;
+    /// Two digests taking turns every 256 bytes, context swap included
+    lp::u32_t interleaved_bytes_per_second;
+    /// Sha-256 "abc" and hmac-sha256 of rfc 4231 case 2 as published
+    bool known_answers;
+    /// Core, dma and interleaved digests of the same data agree
+    bool agree;
+};
+
+volatile hash_result bench_results;
+
+namespace {
+    using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+    using unit = hal::hash<>;
+
+    constexpr lp::u32_t size = 4096;
+    constexpr lp::u32_t turn = 256;
+    constexpr lp::u32_t core_hz = 80000000;
+
+    alignas(4) lp::u8_t buffer[size];
+
+    const lp::u8_t abc_digest[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+
+    const lp::u8_t hmac_digest[32] = {
+        0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+        0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43
+    };
+
+    bool same(const lp::u8_t *one, const lp::u8_t *two) noexcept {
+        return __builtin_memcmp(one, two, 32) == 0;
+    }
+
+    bool known_answers() noexcept {
+        static const lp::u8_t key[] = {'J', 'e', 'f', 'e'};
+        static const char message[] = "what do ya want for nothing?";
+        hal::hash_context context;
+        lp::u8_t digest[32];
+
+        unit::init(context, hal::hash_algorithm::sha256);
+        unit::update(context, "abc", 3);
+
+        const bool plain = unit::finish(context, digest) == 32 && same(digest, abc_digest);
+
+        unit::init_hmac(context, hal::hash_algorithm::sha256, key, sizeof(key));
+        unit::update(context, message, sizeof(message) - 1);
+
+        return plain && unit::finish(context, digest) == 32 && same(digest, hmac_digest);
+    }
+}
+
+void bench::run() noexcept {
+    if (!tree::apply()) {
+        return;
+    }
+
+    hal::flash_accel::configure<hal::flash_accel_all>();
+    hal::rcc::device_enable<hal::rcc_device::dma2en>();
+    unit::enable();
+    bench::enable_cycles();
+
+    for (lp::u32_t i = 0; i < size; ++i) {
+        buffer[i] = static_cast<lp::u8_t>(i * 37 + 11);
+    }
+
+    bench_results.known_answers = known_answers();
+
+    hal::hash_context one;
+    hal::hash_context two;
+    lp::u8_t by_core[32];
+    lp::u8_t by_dma[32];
+    lp::u8_t first[32];
+    lp::u8_t second[32];
+
+    unit::init(one, hal::hash_algorithm::sha256);
+    unit::reset_meter();
+    unit::update(one, buffer, size);
+    bench_results.core_bytes_per_second = unit::bytes_per_second<core_hz>();
+    unit::finish(one, by_core);
+
+    // completion polled through the handler, no dma interrupt in this image
+    unit::init(one, hal::hash_algorithm::sha256);
+    unit::reset_meter();
+    unit::update_dma(one, buffer, size, nullptr);
+
+    while (unit::dma_busy()) {
+        unit::dma_irq_handler();
+    }
+
+    bench_results.dma_bytes_per_second = unit::bytes_per_second<core_hz>();
+    unit::finish(one, by_dma);
+
+    unit::init(one, hal::hash_algorithm::sha256);
+    unit::init(two, hal::hash_algorithm::sha256);
+    unit::reset_meter();
+
+    for (lp::u32_t offset = 0; offset < size; offset += turn) {
+        unit::update(one, buffer + offset, turn);
+        unit::update(two, buffer + offset, turn);
+    }
+
+    bench_results.interleaved_bytes_per_second = unit::bytes_per_second<core_hz>();
+    unit::finish(one, first);
+    unit::finish(two, second);
+
+    bench_results.agree = same(by_core, by_dma) && same(by_dma, first) && same(first, second);
+}
@@ -0,0 +1,64 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Firmware benchmark startup
+ * @file startup.cc
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include "isr_base.hh"
+#include "isr_extend.hh"
+
+#include "bench.hh"
+
+extern lp::u32_t __data_load;
+extern lp::u32_t __data_start;
+extern lp::u32_t __data_end;
+extern lp::u32_t __bss_start;
+extern lp::u32_t __bss_end;
+extern void (*__init_array_start[])();
+extern void (*__init_array_end[])();
+
+extern const isr::vectors vectors_table;
+extern const isr::device_vectors device_vectors_table;
+
+volatile lp::u32_t bench_done = 0;
+
+// the references pull both vector tables out of lp_devices, device
+// interrupts used by an image land in the second one
+__attribute__((used)) static const isr::vectors *const vectors = &vectors_table;
+__attribute__((used)) static const isr::device_vectors *const device_vectors = &device_vectors_table;
+
+void isr::reset() {
+    const lp::u32_t *source = &__data_load;
+
+    for (lp::u32_t *target = &__data_start; target < &__data_end; ++target) {
+        *target = *source++;
+    }
+
+    for (lp::u32_t *target = &__bss_start; target < &__bss_end; ++target) {
+        *target = 0;
+    }
+
+    for (auto constructor = __init_array_start; constructor < __init_array_end; ++constructor) {
+        (*constructor)();
+    }
+
+    bench::run();
+    bench_done = 1;
+
+    while (true);
+}
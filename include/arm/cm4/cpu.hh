@@ -17,6 +17,8 @@
  * @author Boris Vinogradov
  */
 
+#include <types.hh>
+
 #ifndef CPU_HH
 #define CPU_HH
 
@@ -29,6 +31,43 @@ struct cpu {
     static inline void __attribute__((always_inline)) wait_event() noexcept {
         __asm__ volatile ("wfe");
     }
+
+    static inline void __attribute__((always_inline)) data_sync_barrier() noexcept {
+        __asm__ volatile ("dsb" ::: "memory");
+    }
+
+    static inline void __attribute__((always_inline)) instruction_sync_barrier() noexcept {
+        __asm__ volatile ("isb" ::: "memory");
+    }
+
+    static inline lp::u32_t __attribute__((always_inline)) get_basepri() noexcept {
+        lp::u32_t value;
+        __asm__ volatile ("mrs %0, basepri" : "=r" (value));
+        return value;
+    }
+
+    static inline void __attribute__((always_inline)) set_basepri(lp::u32_t value) noexcept {
+        __asm__ volatile ("msr basepri, %0" :: "r" (value) : "memory");
+    }
+
+    /// Raise only, lower or zero values leave basepri unchanged
+    static inline void __attribute__((always_inline)) set_basepri_max(lp::u32_t value) noexcept {
+        __asm__ volatile ("msr basepri_max, %0" :: "r" (value) : "memory");
+    }
+
+    static inline lp::u32_t __attribute__((always_inline)) get_primask() noexcept {
+        lp::u32_t value;
+        __asm__ volatile ("mrs %0, primask" : "=r" (value));
+        return value;
+    }
+
+    static inline void __attribute__((always_inline)) disable_interrupts() noexcept {
+        __asm__ volatile ("cpsid i" ::: "memory");
+    }
+
+    static inline void __attribute__((always_inline)) enable_interrupts() noexcept {
+        __asm__ volatile ("cpsie i" ::: "memory");
+    }
 };
 
 #endif // CPU_HH
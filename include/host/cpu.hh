@@ -0,0 +1,82 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host simulation of core features
+ * @file cpu.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#ifndef CPU_HH
+#define CPU_HH
+
+/// Host implementation of cpu type, there is nothing to wait for and
+/// interrupt masking only keeps register state
+struct cpu {
+    static inline void __attribute__((always_inline)) wait_interrupt() noexcept {
+    }
+
+    static inline void __attribute__((always_inline)) wait_event() noexcept {
+    }
+
+    static inline void __attribute__((always_inline)) data_sync_barrier() noexcept {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    static inline void __attribute__((always_inline)) instruction_sync_barrier() noexcept {
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    }
+
+    static inline lp::u32_t __attribute__((always_inline)) get_basepri() noexcept {
+        return basepri();
+    }
+
+    static inline void __attribute__((always_inline)) set_basepri(lp::u32_t value) noexcept {
+        basepri() = value & 0xff;
+    }
+
+    static inline void __attribute__((always_inline)) set_basepri_max(lp::u32_t value) noexcept {
+        value &= 0xff;
+
+        if (value != 0 && (basepri() == 0 || value < basepri())) {
+            basepri() = value;
+        }
+    }
+
+    static inline lp::u32_t __attribute__((always_inline)) get_primask() noexcept {
+        return primask();
+    }
+
+    static inline void __attribute__((always_inline)) disable_interrupts() noexcept {
+        primask() = 1;
+    }
+
+    static inline void __attribute__((always_inline)) enable_interrupts() noexcept {
+        primask() = 0;
+    }
+
+private:
+    static lp::u32_t &basepri() noexcept {
+        static lp::u32_t value = 0;
+        return value;
+    }
+
+    static lp::u32_t &primask() noexcept {
+        static lp::u32_t value = 0;
+        return value;
+    }
+};
+
+#endif // CPU_HH
@@ -0,0 +1,119 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host simulation of flash memory interface
+ * @file flash_model.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <flash.hh>
+
+#include <hal/flash_device.hh>
+
+#include "register_model.hh"
+
+#ifndef FLASH_MODEL_HH
+#define FLASH_MODEL_HH
+
+namespace sim {
+    /// Flash interface with instant operations: page and bank erases
+    /// started through cr fill main memory with 0xff and set eop, sr
+    /// flags clear by writing 1. Programming needs no model, main memory
+    /// is plain memory. Banks are never swapped.
+    struct flash_model {
+        /// Called before an erase of size bytes at address, may copy the
+        /// memory to play a reset right before it
+        using erase_hook = void (*)(lp::addr_t address, lp::u32_t size);
+
+        /// Erased main memory, hooks on cr and sr
+        static bool attach() noexcept {
+            context() = {0, nullptr};
+            __builtin_memset(reinterpret_cast<void *>(hal::flash_device::base), 0xff, hal::flash_device::size);
+            poke<::flash::sr>(0);
+            poke<::flash::cr>(0);
+
+            return on_write<::flash::cr>(cr_written) && on_write<::flash::sr>(sr_written);
+        }
+
+        static void before_erase(erase_hook hook) noexcept {
+            context().hook = hook;
+        }
+
+        /// Page erases and bank erases counted since attach()
+        static lp::u32_t erases() noexcept {
+            return context().erases;
+        }
+
+    private:
+        static constexpr lp::u32_t start = ::flash::cr_start::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t per = ::flash::cr_per::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t bker = ::flash::cr_bker::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mer1 = ::flash::cr_mer1::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mer2 = ::flash::cr_mer2::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pnb_mask = ::flash::cr_pnb::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pnb_position = ::flash::cr_pnb::position;
+        static constexpr lp::u32_t eop = ::flash::sr_eop::mask<lp::u32_t>::value;
+
+        struct state {
+            lp::u32_t erases;
+            erase_hook hook;
+        };
+
+        static state &context() noexcept {
+            static state value;
+            return value;
+        }
+
+        static void erase(lp::addr_t address, lp::u32_t size) noexcept {
+            if (context().hook) {
+                context().hook(address, size);
+            }
+
+            ++context().erases;
+            __builtin_memset(reinterpret_cast<void *>(address), 0xff, size);
+        }
+
+        static void cr_written(lp::addr_t, lp::u32_t, lp::u32_t value) noexcept {
+            if (!(value & start)) {
+                return;
+            }
+
+            if (value & per) {
+                const lp::u32_t page = (value & pnb_mask) >> pnb_position;
+
+                erase(hal::flash_device::base + (value & bker ? hal::flash_device::bank_size : 0) +
+                    page * hal::flash_device::page_size, hal::flash_device::page_size);
+            }
+
+            if (value & mer1) {
+                erase(hal::flash_device::base, hal::flash_device::bank_size);
+            }
+
+            if (value & mer2) {
+                erase(hal::flash_device::base + hal::flash_device::bank_size, hal::flash_device::bank_size);
+            }
+
+            poke<::flash::cr>(value & ~start);
+            poke<::flash::sr>(peek<::flash::sr>() | eop);
+        }
+
+        static void sr_written(lp::addr_t, lp::u32_t old_value, lp::u32_t value) noexcept {
+            poke<::flash::sr>(old_value & ~value);
+        }
+    };
+}
+
+#endif // FLASH_MODEL_HH
@@ -0,0 +1,83 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host simulation of device registers
+ * @file register_model.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#ifndef REGISTER_MODEL_HH
+#define REGISTER_MODEL_HH
+
+/// In-process memory model backing lp::io_register on a Linux x86-64 host.
+/// Device address windows are mapped at their physical addresses, so
+/// register maps and hal code run unchanged. Pages holding hooked
+/// registers are access protected: every access to them traps, runs the
+/// hooks and is single-stepped. Other pages are plain memory.
+/// Hooks run in signal context and must not reenter the model through
+/// hooked registers, use peek()/poke() for raw access instead.
+namespace sim {
+    /// Called before the faulting read is executed, may poke a new value
+    using read_hook = void (*)(lp::addr_t address);
+    /// Called after the write with the 32-bit word content around it
+    using write_hook = void (*)(lp::addr_t address, lp::u32_t old_value, lp::u32_t new_value);
+    /// Called after every register access while watching, reads pass the
+    /// value read as both old and new value
+    using access_hook = void (*)(lp::addr_t address, lp::u32_t old_value, lp::u32_t new_value,
+        bool write);
+
+    /// Map device windows and install trap handlers, safe to call twice
+    bool init() noexcept;
+
+    /// Drop every hook and zero all simulated memory
+    void reset() noexcept;
+
+    /// Raw register access bypassing hooks
+    lp::u32_t peek(lp::addr_t address) noexcept;
+    void poke(lp::addr_t address, lp::u32_t value) noexcept;
+
+    template <typename Register>
+    lp::u32_t peek() noexcept {
+        return peek(Register::address);
+    }
+
+    template <typename Register>
+    void poke(lp::u32_t value) noexcept {
+        poke(Register::address, value);
+    }
+
+    /// Register side effects for the 32-bit word holding address
+    bool on_read(lp::addr_t address, read_hook hook) noexcept;
+    bool on_write(lp::addr_t address, write_hook hook) noexcept;
+
+    template <typename Register>
+    bool on_read(read_hook hook) noexcept {
+        return on_read(Register::address, hook);
+    }
+
+    template <typename Register>
+    bool on_write(write_hook hook) noexcept {
+        return on_write(Register::address, hook);
+    }
+
+    void clear_hooks() noexcept;
+
+    /// Trap every access to peripheral windows and report it to hook,
+    /// nullptr stops watching
+    void watch(access_hook hook) noexcept;
+}
+
+#endif // REGISTER_MODEL_HH
@@ -0,0 +1,105 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host register access trace
+ * @file register_trace.hh
+ * @author Boris Vinogradov
+ */
+
+#include <stdio.h>
+
+#include <types.hh>
+
+#include "register_model.hh"
+
+#ifndef REGISTER_TRACE_HH
+#define REGISTER_TRACE_HH
+
+/// Counts every peripheral register access made while tracing and
+/// optionally logs it into a fixed size buffer. Accesses are attributed
+/// to the innermost open scope, so a report lists the bus cycles spent by
+/// each hal call:
+///
+///     sim::trace::start();
+///     {
+///         sim::trace::scope s("gpio::set_mode");
+///         hal::gpio_device::gpioa::set_mode<hal::pins::mode::output, hal::pins::p5>();
+///     }
+///     sim::trace::report();
+namespace sim {
+    namespace trace {
+        constexpr lp::u32_t max_records = 4096;
+        constexpr lp::u32_t max_scopes = 64;
+        constexpr lp::u32_t max_depth = 8;
+
+        enum struct access_kind : lp::u8_t {
+            read,
+            write
+        };
+
+        struct record {
+            lp::addr_t address;
+            lp::u32_t old_value;
+            lp::u32_t new_value;
+            access_kind kind;
+            lp::u8_t scope;
+        };
+
+        struct counters {
+            lp::u32_t calls;
+            lp::u32_t reads;
+            lp::u32_t writes;
+            /// Writes which left the register unchanged
+            lp::u32_t redundant_writes;
+            /// Writes directly preceded by a read of the same register
+            lp::u32_t read_modify_writes;
+        };
+
+        /// Watch register windows, log records when logging is set
+        void start(bool logging = true) noexcept;
+        void stop() noexcept;
+
+        /// Drop records and zero counters, scope names are kept
+        void clear() noexcept;
+
+        /// Counters over every traced access
+        counters totals() noexcept;
+
+        /// Counters of named scope, zero when the scope never ran
+        counters totals(const char *name) noexcept;
+
+        lp::u32_t size() noexcept;
+        /// Records which did not fit into the buffer
+        lp::u32_t lost() noexcept;
+        const record &at(lp::u32_t index) noexcept;
+
+        /// Name of scope index from record, "-" for unscoped accesses
+        const char *scope_name(lp::u8_t index) noexcept;
+
+        /// Print per scope counters followed by logged records
+        void report(FILE *out = stdout) noexcept;
+
+        /// Attributes accesses to name until destroyed, name must outlive
+        /// the trace
+        struct scope {
+            explicit scope(const char *name) noexcept;
+            ~scope() noexcept;
+
+            scope(const scope &) = delete;
+            scope &operator=(const scope &) = delete;
+        };
+    }
+}
+
+#endif // REGISTER_TRACE_HH
@@ -0,0 +1,79 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host simulation of usart
+ * @file usart_model.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/ring_buffer.hh>
+
+#include "register_model.hh"
+
+#ifndef USART_MODEL_HH
+#define USART_MODEL_HH
+
+namespace sim {
+    /// Usart with instant transmission: tdr writes are captured and
+    /// txe/tc stay set, injected characters show up in rdr with rxne.
+    template <typename Usart_block, lp::u32_t Capacity = 256>
+    struct usart_model {
+        using block = Usart_block;
+
+        static bool attach() noexcept {
+            output.clear();
+            poke<typename block::isr>(txe | tc);
+
+            return on_write<typename block::tdr>(tdr_written) &&
+                on_read<typename block::rdr>(rdr_read);
+        }
+
+        /// Place a received character, raises overrun if rdr is unread
+        static void inject(lp::u8_t value) noexcept {
+            const lp::u32_t status = peek<typename block::isr>();
+
+            poke<typename block::rdr>(value);
+            poke<typename block::isr>(status | rxne | ((status & rxne) ? ore : 0));
+        }
+
+        /// Take characters written to tdr so far
+        static lp::u32_t transmitted(lp::u8_t *data, lp::u32_t size) noexcept {
+            return output.read(data, size);
+        }
+
+    private:
+        static constexpr lp::u32_t txe = block::isr_txe::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t tc = block::isr_tc::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t rxne = block::isr_rxne::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ore = block::isr_ore::template mask<lp::u32_t>::value;
+
+        static void tdr_written(lp::addr_t, lp::u32_t, lp::u32_t value) noexcept {
+            output.push(static_cast<lp::u8_t>(value));
+            poke<typename block::isr>(peek<typename block::isr>() | txe | tc);
+        }
+
+        static void rdr_read(lp::addr_t) noexcept {
+            poke<typename block::isr>(peek<typename block::isr>() & ~rxne);
+        }
+
+        static hal::ring_buffer<lp::u8_t, Capacity> output;
+    };
+
+    template <typename Usart_block, lp::u32_t Capacity>
+    hal::ring_buffer<lp::u8_t, Capacity> usart_model<Usart_block, Capacity>::output;
+}
+
+#endif // USART_MODEL_HH
@@ -0,0 +1,706 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for aes hardware accelerator
+ * @file aes.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+#include <type_list.hh>
+
+#include <aes.hh>
+#include <dwt.hh>
+#include <rcc.hh>
+
+#include <hal/dma_device.hh>
+#include <hal/dma_type.hh>
+#include <hal/nvic.hh>
+
+#ifndef HAL_AES_HH
+#define HAL_AES_HH
+
+namespace hal {
+    enum class aes_chain : lp::u32_t {
+        ecb = 0b00,
+        cbc = 0b01,
+        ctr = 0b10
+    };
+
+    enum class aes_direction {
+        encrypt,
+        decrypt
+    };
+
+    /// One aes-128 stream: key and chaining value in register order
+    /// (word 3 is the first four bytes), updated after every call, so
+    /// streams can take turns on the unit
+    struct aes_context {
+        lp::u32_t key[4];
+        lp::u32_t iv[4];
+        aes_chain chain;
+        aes_direction direction;
+    };
+
+    namespace aes_table {
+        constexpr lp::u8_t twice(lp::u8_t value) noexcept {
+            return static_cast<lp::u8_t>((value << 1) ^ (value & 0x80 ? 0x1b : 0));
+        }
+
+        constexpr lp::u8_t multiply(lp::u8_t value, lp::u8_t factor) noexcept {
+            lp::u8_t result = 0;
+
+            for (; factor; factor >>= 1, value = twice(value)) {
+                if (factor & 1) {
+                    result ^= value;
+                }
+            }
+
+            return result;
+        }
+
+        constexpr lp::u8_t rotate(lp::u8_t value, lp::u32_t shift) noexcept {
+            return static_cast<lp::u8_t>((value << shift) | (value >> (8 - shift)));
+        }
+
+        /// S-boxes and round tables, a column word holds its first byte in
+        /// bits 31..24. Other three round tables are rotations of these.
+        struct boxes {
+            lp::u8_t forward[256];
+            lp::u8_t inverse[256];
+            lp::u32_t encrypt[256];
+            lp::u32_t decrypt[256];
+        };
+
+        /// S-box from walking the multiplicative group by 3 with the
+        /// inverse by 1/3 alongside, then the affine step
+        constexpr boxes make() noexcept {
+            boxes result = {};
+            lp::u8_t power = 1;
+            lp::u8_t inverse = 1;
+
+            do {
+                power = static_cast<lp::u8_t>(power ^ twice(power));
+                inverse ^= static_cast<lp::u8_t>(inverse << 1);
+                inverse ^= static_cast<lp::u8_t>(inverse << 2);
+                inverse ^= static_cast<lp::u8_t>(inverse << 4);
+
+                if (inverse & 0x80) {
+                    inverse ^= 0x09;
+                }
+
+                result.forward[power] = static_cast<lp::u8_t>(inverse ^ rotate(inverse, 1) ^
+                    rotate(inverse, 2) ^ rotate(inverse, 3) ^ rotate(inverse, 4) ^ 0x63);
+            } while (power != 1);
+
+            result.forward[0] = 0x63;
+
+            for (lp::u32_t i = 0; i < 256; ++i) {
+                result.inverse[result.forward[i]] = static_cast<lp::u8_t>(i);
+            }
+
+            for (lp::u32_t i = 0; i < 256; ++i) {
+                const lp::u8_t s = result.forward[i];
+                const lp::u8_t v = result.inverse[i];
+
+                result.encrypt[i] = static_cast<lp::u32_t>(twice(s)) << 24 | static_cast<lp::u32_t>(s) << 16 |
+                    static_cast<lp::u32_t>(s) << 8 | (twice(s) ^ s);
+                result.decrypt[i] = static_cast<lp::u32_t>(multiply(v, 14)) << 24 |
+                    static_cast<lp::u32_t>(multiply(v, 9)) << 16 |
+                    static_cast<lp::u32_t>(multiply(v, 13)) << 8 | multiply(v, 11);
+            }
+
+            return result;
+        }
+    }
+
+    /// Table driven aes-128 on the core for host builds and a baseline
+    /// to the unit, same streams and chaining as hal::aes, 2.5 KB of
+    /// tables in flash. The key schedule of the last stream is kept, so
+    /// switching streams costs about one block.
+    ///
+    ///     hal::aes_software::init(link, hal::aes_chain::cbc, hal::aes_direction::encrypt, key, iv);
+    ///     hal::aes_software::process(link, plain, cipher, blocks);
+    struct aes_software {
+        static constexpr lp::u32_t block_size = 16;
+
+        /// Set up a stream, arguments as for hal::aes::init
+        static void init(aes_context &context, aes_chain chain, aes_direction direction,
+                const lp::u8_t *key, const lp::u8_t *iv = nullptr) noexcept {
+            load_words(key, context.key);
+
+            if (iv) {
+                load_words(iv, context.iv);
+            } else {
+                context.iv[0] = context.iv[1] = context.iv[2] = context.iv[3] = 0;
+            }
+
+            context.chain = chain;
+            context.direction = direction;
+
+            if (schedule().owner == &context) {
+                schedule().owner = nullptr;
+            }
+        }
+
+        /// Process blocks from input to output, both may be the same.
+        /// Always true, so it stands in for hal::aes::process.
+        static bool process(aes_context &context, const void *input, void *output, lp::u32_t blocks) noexcept {
+            const lp::u8_t *in = static_cast<const lp::u8_t *>(input);
+            lp::u8_t *out = static_cast<lp::u8_t *>(output);
+            const bool decrypt = context.direction == aes_direction::decrypt && context.chain != aes_chain::ctr;
+            const lp::u32_t *keys = expand(context, decrypt);
+
+            for (lp::u32_t i = 0; i < blocks; ++i, in += block_size, out += block_size) {
+                lp::u32_t block[4];
+                lp::u32_t next[4];
+
+                load(in, block);
+
+                if (context.chain == aes_chain::ctr) {
+                    for (lp::u32_t k = 0; k < 4; ++k) {
+                        next[k] = context.iv[3 - k];
+                    }
+
+                    encrypt_block(keys, next);
+
+                    for (lp::u32_t k = 0; k < 4; ++k) {
+                        next[k] ^= block[k];
+                    }
+
+                    ++context.iv[0];
+                } else if (decrypt) {
+                    for (lp::u32_t k = 0; k < 4; ++k) {
+                        next[k] = block[k];
+                    }
+
+                    decrypt_block(keys, next);
+
+                    if (context.chain == aes_chain::cbc) {
+                        for (lp::u32_t k = 0; k < 4; ++k) {
+                            next[k] ^= context.iv[3 - k];
+                            context.iv[3 - k] = block[k];
+                        }
+                    }
+                } else {
+                    for (lp::u32_t k = 0; k < 4; ++k) {
+                        next[k] = context.chain == aes_chain::cbc ? block[k] ^ context.iv[3 - k] : block[k];
+                    }
+
+                    encrypt_block(keys, next);
+
+                    if (context.chain == aes_chain::cbc) {
+                        for (lp::u32_t k = 0; k < 4; ++k) {
+                            context.iv[3 - k] = next[k];
+                        }
+                    }
+                }
+
+                store(next, out);
+            }
+
+            return true;
+        }
+
+    private:
+        static constexpr lp::u32_t rounds = 10;
+        static constexpr lp::u32_t key_words = 4 * (rounds + 1);
+
+        struct state {
+            lp::u32_t keys[key_words];
+            const aes_context *owner;
+            bool decrypt;
+        };
+
+        /// Header only schedule of the last stream, zero initialized
+        static state &schedule() noexcept {
+            static state value;
+            return value;
+        }
+
+        static const aes_table::boxes &tables() noexcept {
+            static constexpr aes_table::boxes value = aes_table::make();
+            return value;
+        }
+
+        static lp::u32_t rotate(lp::u32_t value, lp::u32_t shift) noexcept {
+            return (value >> shift) | (value << (32 - shift));
+        }
+
+        /// Big endian 16 bytes to register order
+        static void load_words(const lp::u8_t *bytes, lp::u32_t *words) noexcept {
+            for (lp::u32_t i = 0; i < 4; ++i) {
+                lp::u32_t word;
+
+                __builtin_memcpy(&word, bytes + i * 4, sizeof(word));
+                words[3 - i] = __builtin_bswap32(word);
+            }
+        }
+
+        /// Block bytes to column words and back, little endian core
+        static void load(const lp::u8_t *bytes, lp::u32_t *words) noexcept {
+            __builtin_memcpy(words, bytes, 4 * sizeof(lp::u32_t));
+
+            for (lp::u32_t k = 0; k < 4; ++k) {
+                words[k] = __builtin_bswap32(words[k]);
+            }
+        }
+
+        static void store(const lp::u32_t *words, lp::u8_t *bytes) noexcept {
+            for (lp::u32_t k = 0; k < 4; ++k) {
+                const lp::u32_t word = __builtin_bswap32(words[k]);
+
+                __builtin_memcpy(bytes + k * 4, &word, sizeof(word));
+            }
+        }
+
+        static lp::u32_t substitute(const lp::u8_t *box, lp::u32_t word) noexcept {
+            return static_cast<lp::u32_t>(box[word >> 24]) << 24 | static_cast<lp::u32_t>(box[(word >> 16) & 0xff]) << 16 |
+                static_cast<lp::u32_t>(box[(word >> 8) & 0xff]) << 8 | box[word & 0xff];
+        }
+
+        /// Round keys of a stream unless they are kept already, decryption
+        /// takes them in reverse with inverse mix columns on the inner ones
+        static const lp::u32_t *expand(const aes_context &context, bool decrypt) noexcept {
+            state &current = schedule();
+
+            if (current.owner == &context && current.decrypt == decrypt) {
+                return current.keys;
+            }
+
+            const aes_table::boxes &table = tables();
+            lp::u32_t *keys = current.keys;
+            lp::u32_t constant = 0x01;
+
+            for (lp::u32_t i = 0; i < 4; ++i) {
+                keys[i] = context.key[3 - i];
+            }
+
+            for (lp::u32_t i = 4; i < key_words; ++i) {
+                lp::u32_t word = keys[i - 1];
+
+                if (i % 4 == 0) {
+                    word = substitute(table.forward, rotate(word, 24)) ^ (constant << 24);
+                    constant = aes_table::twice(static_cast<lp::u8_t>(constant));
+                }
+
+                keys[i] = keys[i - 4] ^ word;
+            }
+
+            if (decrypt) {
+                for (lp::u32_t i = 0, j = key_words - 4; i < j; i += 4, j -= 4) {
+                    for (lp::u32_t k = 0; k < 4; ++k) {
+                        const lp::u32_t word = keys[i + k];
+
+                        keys[i + k] = keys[j + k];
+                        keys[j + k] = word;
+                    }
+                }
+
+                for (lp::u32_t i = 4; i < key_words - 4; ++i) {
+                    const lp::u32_t word = substitute(table.forward, keys[i]);
+
+                    keys[i] = table.decrypt[word >> 24] ^ rotate(table.decrypt[(word >> 16) & 0xff], 8) ^
+                        rotate(table.decrypt[(word >> 8) & 0xff], 16) ^ rotate(table.decrypt[word & 0xff], 24);
+                }
+            }
+
+            current.owner = &context;
+            current.decrypt = decrypt;
+
+            return keys;
+        }
+
+        static void encrypt_block(const lp::u32_t *keys, lp::u32_t *block) noexcept {
+            const aes_table::boxes &table = tables();
+            const lp::u32_t *te = table.encrypt;
+            lp::u32_t s0 = block[0] ^ keys[0];
+            lp::u32_t s1 = block[1] ^ keys[1];
+            lp::u32_t s2 = block[2] ^ keys[2];
+            lp::u32_t s3 = block[3] ^ keys[3];
+
+            for (lp::u32_t round = 1; round < rounds; ++round) {
+                keys += 4;
+
+                const lp::u32_t t0 = te[s0 >> 24] ^ rotate(te[(s1 >> 16) & 0xff], 8) ^
+                    rotate(te[(s2 >> 8) & 0xff], 16) ^ rotate(te[s3 & 0xff], 24) ^ keys[0];
+                const lp::u32_t t1 = te[s1 >> 24] ^ rotate(te[(s2 >> 16) & 0xff], 8) ^
+                    rotate(te[(s3 >> 8) & 0xff], 16) ^ rotate(te[s0 & 0xff], 24) ^ keys[1];
+                const lp::u32_t t2 = te[s2 >> 24] ^ rotate(te[(s3 >> 16) & 0xff], 8) ^
+                    rotate(te[(s0 >> 8) & 0xff], 16) ^ rotate(te[s1 & 0xff], 24) ^ keys[2];
+                const lp::u32_t t3 = te[s3 >> 24] ^ rotate(te[(s0 >> 16) & 0xff], 8) ^
+                    rotate(te[(s1 >> 8) & 0xff], 16) ^ rotate(te[s2 & 0xff], 24) ^ keys[3];
+
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+            }
+
+            keys += 4;
+            block[0] = last(table.forward, s0, s1, s2, s3) ^ keys[0];
+            block[1] = last(table.forward, s1, s2, s3, s0) ^ keys[1];
+            block[2] = last(table.forward, s2, s3, s0, s1) ^ keys[2];
+            block[3] = last(table.forward, s3, s0, s1, s2) ^ keys[3];
+        }
+
+        static void decrypt_block(const lp::u32_t *keys, lp::u32_t *block) noexcept {
+            const aes_table::boxes &table = tables();
+            const lp::u32_t *td = table.decrypt;
+            lp::u32_t s0 = block[0] ^ keys[0];
+            lp::u32_t s1 = block[1] ^ keys[1];
+            lp::u32_t s2 = block[2] ^ keys[2];
+            lp::u32_t s3 = block[3] ^ keys[3];
+
+            for (lp::u32_t round = 1; round < rounds; ++round) {
+                keys += 4;
+
+                const lp::u32_t t0 = td[s0 >> 24] ^ rotate(td[(s3 >> 16) & 0xff], 8) ^
+                    rotate(td[(s2 >> 8) & 0xff], 16) ^ rotate(td[s1 & 0xff], 24) ^ keys[0];
+                const lp::u32_t t1 = td[s1 >> 24] ^ rotate(td[(s0 >> 16) & 0xff], 8) ^
+                    rotate(td[(s3 >> 8) & 0xff], 16) ^ rotate(td[s2 & 0xff], 24) ^ keys[1];
+                const lp::u32_t t2 = td[s2 >> 24] ^ rotate(td[(s1 >> 16) & 0xff], 8) ^
+                    rotate(td[(s0 >> 8) & 0xff], 16) ^ rotate(td[s3 & 0xff], 24) ^ keys[2];
+                const lp::u32_t t3 = td[s3 >> 24] ^ rotate(td[(s2 >> 16) & 0xff], 8) ^
+                    rotate(td[(s1 >> 8) & 0xff], 16) ^ rotate(td[s0 & 0xff], 24) ^ keys[3];
+
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+            }
+
+            keys += 4;
+            block[0] = last(table.inverse, s0, s3, s2, s1) ^ keys[0];
+            block[1] = last(table.inverse, s1, s0, s3, s2) ^ keys[1];
+            block[2] = last(table.inverse, s2, s1, s0, s3) ^ keys[2];
+            block[3] = last(table.inverse, s3, s2, s1, s0) ^ keys[3];
+        }
+
+        /// Final round column, bytes taken from a, b, c and d in turn
+        static lp::u32_t last(const lp::u8_t *box, lp::u32_t a, lp::u32_t b, lp::u32_t c, lp::u32_t d) noexcept {
+            return static_cast<lp::u32_t>(box[a >> 24]) << 24 | static_cast<lp::u32_t>(box[(b >> 16) & 0xff]) << 16 |
+                static_cast<lp::u32_t>(box[(c >> 8) & 0xff]) << 8 | box[d & 0xff];
+        }
+    };
+
+    /// Aes-128 unit shared by any number of aes_context streams. Data goes
+    /// as 16 byte blocks with byte swapping done by the unit, the key and
+    /// chaining value are written when a different stream takes the unit.
+    /// The decryption key schedule is derived once per switch and stays
+    /// in the unit while the same stream keeps going.
+    ///
+    /// process() moves blocks by the core, process_dma() by In_dma and
+    /// Out_dma, finished in dma_irq_handler() (isr of the Out_dma channel)
+    /// while irq_handler() (isr::AES) aborts on unit errors. Both irqs at
+    /// the same priority. A stream is suspended simply by not calling it,
+    /// another one can run meanwhile and the first resumes where it
+    /// stopped.
+    ///
+    ///     hal::aes_context link;
+    ///     using unit = hal::aes<>;
+    ///
+    ///     unit::enable();
+    ///     unit::init(link, hal::aes_chain::ctr, hal::aes_direction::encrypt, key, nonce);
+    ///     unit::process(link, plain, cipher, blocks);
+    template <typename In_dma = dma_device::aes_in, typename Out_dma = dma_device::aes_out>
+    struct aes {
+        using in_channel = In_dma;
+        using out_channel = Out_dma;
+        using dma_channels = lp::type_list<in_channel, out_channel>;
+        using done_hook = void (*)(bool ok);
+
+        static constexpr irq_dev_num_t irq = irq_dev_num_t::AES;
+        static constexpr lp::u32_t block_size = 16;
+        /// Dma transfer counter limit in words
+        static constexpr lp::u32_t max_dma_blocks = 0xffff / 4;
+
+        /// Core path figures for cycles per byte, dwt cyccnt
+        struct meter {
+            lp::u64_t bytes;
+            lp::u64_t cycles;
+        };
+
+        static void enable() noexcept {
+            ::rcc::ahb2enr::get() = ::rcc::ahb2enr::get() | aesen;
+
+            // read back so the clock is running before the first access
+            const lp::u32_t enabled = ::rcc::ahb2enr::get();
+            (void)enabled;
+        }
+
+        /// Set up a stream, iv is the chaining value for cbc and the
+        /// nonce with initial 32-bit big endian counter for ctr
+        static void init(aes_context &context, aes_chain chain, aes_direction direction,
+                const lp::u8_t *key, const lp::u8_t *iv = nullptr) noexcept {
+            load_words(key, context.key);
+
+            if (iv) {
+                load_words(iv, context.iv);
+            } else {
+                context.iv[0] = context.iv[1] = context.iv[2] = context.iv[3] = 0;
+            }
+
+            context.chain = chain;
+            context.direction = direction;
+
+            if (active == &context) {
+                active = nullptr;
+            }
+        }
+
+        /// Process blocks from input to output, both may be the same.
+        /// False while a dma transfer holds the unit.
+        static bool process(aes_context &context, const void *input, void *output, lp::u32_t blocks) noexcept {
+            if (busy) {
+                return false;
+            }
+
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            const lp::u8_t *in = static_cast<const lp::u8_t *>(input);
+            lp::u8_t *out = static_cast<lp::u8_t *>(output);
+
+            select(context);
+
+            for (lp::u32_t i = 0; i < blocks; ++i, in += block_size, out += block_size) {
+                lp::u32_t words[4];
+
+                __builtin_memcpy(words, in, sizeof(words));
+                chain_input(context, in);
+
+                for (auto word : words) {
+                    ::aes::dinr::get() = word;
+                }
+
+                while (!(::aes::sr::get() & ccf)) {
+                }
+
+                for (auto &word : words) {
+                    word = ::aes::doutr::get();
+                }
+
+                ::aes::cr::get() = ::aes::cr::get() | ccfc;
+                __builtin_memcpy(out, words, sizeof(words));
+                chain_output(context, out);
+            }
+
+            stats.bytes += blocks * block_size;
+            stats.cycles += ::dwt::cyccnt::get() - begin;
+
+            return true;
+        }
+
+        /// Start dma processing, buffers stay untouched until done is
+        /// called. False while a transfer runs or above max_dma_blocks.
+        static bool process_dma(aes_context &context, const void *input, void *output, lp::u32_t blocks,
+                done_hook done) noexcept {
+            if (busy || blocks == 0 || blocks > max_dma_blocks) {
+                return false;
+            }
+
+            const lp::u8_t *in = static_cast<const lp::u8_t *>(input);
+
+            busy = true;
+            pending = &context;
+            pending_output = static_cast<lp::u8_t *>(output);
+            pending_blocks = blocks;
+            callback = done;
+
+            select(context);
+
+            // decryption chains on the last input block, output may overwrite it
+            chain_input(context, in + (blocks - 1) * block_size);
+
+            if (context.chain == aes_chain::ctr) {
+                context.iv[0] += blocks - 1;
+            }
+
+            in_channel::select_request();
+            out_channel::select_request();
+            out_channel::template periph_to_mem<
+                dma_config::complete_int,
+                dma_config::error_int,
+                dma_config::periph_size<dma_config::width::word>,
+                dma_config::memory_size<dma_config::width::word>
+            >(::aes::doutr::address, output, blocks * 4);
+            in_channel::template mem_to_periph<
+                dma_config::periph_size<dma_config::width::word>,
+                dma_config::memory_size<dma_config::width::word>
+            >(::aes::dinr::address, input, blocks * 4);
+
+            nvic::template enable_irq<irq>();
+            ::aes::cr::get() = ::aes::cr::get() | errie | dmainen | dmaouten;
+
+            return true;
+        }
+
+        static bool dma_busy() noexcept {
+            return busy;
+        }
+
+        static void dma_irq_handler() noexcept {
+            const lp::u32_t status = out_channel::take_flags();
+
+            if (status & (out_channel::flags::complete | out_channel::flags::error)) {
+                finish(!(status & out_channel::flags::error));
+            }
+        }
+
+        static void irq_handler() noexcept {
+            if (::aes::sr::get() & (rderr | wrerr)) {
+                ::aes::cr::get() = ::aes::cr::get() | errc;
+
+                if (busy) {
+                    // unit state is unknown now, the stream reloads next time
+                    active = nullptr;
+                    finish(false);
+                }
+            }
+        }
+
+        static meter measured() noexcept {
+            return stats;
+        }
+
+        static void reset_meter() noexcept {
+            stats = {0, 0};
+        }
+
+    private:
+        static constexpr lp::u32_t aesen = ::rcc::ahb2enr_aesen::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t en = ::aes::cr_en::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ccfc = ::aes::cr_ccfc::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t errc = ::aes::cr_errc::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t errie = ::aes::cr_errie::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dmainen = ::aes::cr_dmainen::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dmaouten = ::aes::cr_dmaouten::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ccf = ::aes::sr_ccf::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t rderr = ::aes::sr_rderr::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t wrerr = ::aes::sr_wrerr::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t byte_swap = 0b10u << ::aes::cr_datatype::position;
+        static constexpr lp::u32_t mode_encrypt = 0b00u << ::aes::cr_mode::position;
+        static constexpr lp::u32_t mode_derive = 0b01u << ::aes::cr_mode::position;
+        static constexpr lp::u32_t mode_decrypt = 0b10u << ::aes::cr_mode::position;
+
+        /// Big endian 16 bytes to register order
+        static void load_words(const lp::u8_t *bytes, lp::u32_t *words) noexcept {
+            for (lp::u32_t i = 0; i < 4; ++i) {
+                lp::u32_t word;
+
+                __builtin_memcpy(&word, bytes + i * 4, sizeof(word));
+                words[3 - i] = __builtin_bswap32(word);
+            }
+        }
+
+        /// Load key and chaining value of a stream unless it holds the
+        /// unit already, ecb/cbc decryption derives the key schedule first
+        static void select(aes_context &context) noexcept {
+            if (active == &context) {
+                return;
+            }
+
+            const lp::u32_t chain = static_cast<lp::u32_t>(context.chain) << ::aes::cr_chmod::position;
+            const bool derive = context.direction == aes_direction::decrypt && context.chain != aes_chain::ctr;
+
+            ::aes::cr::get() = 0;
+            ::aes::keyr0::get() = context.key[0];
+            ::aes::keyr1::get() = context.key[1];
+            ::aes::keyr2::get() = context.key[2];
+            ::aes::keyr3::get() = context.key[3];
+
+            if (derive) {
+                ::aes::cr::get() = mode_derive | en;
+
+                while (!(::aes::sr::get() & ccf)) {
+                }
+
+                ::aes::cr::get() = ccfc;
+            }
+
+            ::aes::ivr0::get() = context.iv[0];
+            ::aes::ivr1::get() = context.iv[1];
+            ::aes::ivr2::get() = context.iv[2];
+            ::aes::ivr3::get() = context.iv[3];
+            ::aes::cr::get() = byte_swap | chain | (derive ? mode_decrypt : mode_encrypt) | en;
+
+            active = &context;
+        }
+
+        /// Chaining value after a block, cbc decryption takes the input
+        static void chain_input(aes_context &context, const lp::u8_t *block) noexcept {
+            if (context.chain == aes_chain::cbc && context.direction == aes_direction::decrypt) {
+                load_words(block, context.iv);
+            } else if (context.chain == aes_chain::ctr) {
+                ++context.iv[0];
+            }
+        }
+
+        /// Cbc encryption chains on the output
+        static void chain_output(aes_context &context, const lp::u8_t *block) noexcept {
+            if (context.chain == aes_chain::cbc && context.direction == aes_direction::encrypt) {
+                load_words(block, context.iv);
+            }
+        }
+
+        static void finish(bool ok) noexcept {
+            ::aes::cr::get() = (::aes::cr::get() & ~(errie | dmainen | dmaouten)) | ccfc;
+            in_channel::stop();
+            out_channel::stop();
+
+            if (ok) {
+                chain_output(*pending, pending_output + (pending_blocks - 1) * block_size);
+            }
+
+            const done_hook done = callback;
+
+            busy = false;
+            callback = nullptr;
+
+            if (done) {
+                done(ok);
+            }
+        }
+
+        static aes_context *active;
+        static aes_context *pending;
+        static lp::u8_t *pending_output;
+        static lp::u32_t pending_blocks;
+        static done_hook callback;
+        static bool busy;
+        static meter stats;
+    };
+
+    template <typename In_dma, typename Out_dma>
+    aes_context *aes<In_dma, Out_dma>::active = nullptr;
+
+    template <typename In_dma, typename Out_dma>
+    aes_context *aes<In_dma, Out_dma>::pending = nullptr;
+
+    template <typename In_dma, typename Out_dma>
+    lp::u8_t *aes<In_dma, Out_dma>::pending_output = nullptr;
+
+    template <typename In_dma, typename Out_dma>
+    lp::u32_t aes<In_dma, Out_dma>::pending_blocks = 0;
+
+    template <typename In_dma, typename Out_dma>
+    typename aes<In_dma, Out_dma>::done_hook aes<In_dma, Out_dma>::callback = nullptr;
+
+    template <typename In_dma, typename Out_dma>
+    bool aes<In_dma, Out_dma>::busy = false;
+
+    template <typename In_dma, typename Out_dma>
+    typename aes<In_dma, Out_dma>::meter aes<In_dma, Out_dma>::stats;
+}
+
+#endif // HAL_AES_HH
@@ -0,0 +1,215 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for board pin map
+ * @file board.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/gpio.hh>
+
+#ifndef HAL_BOARD_HH
+#define HAL_BOARD_HH
+
+namespace hal {
+    /// Board pin entry, Port is hal gpio port type
+    template <typename Port, lp::u32_t Number, typename Config>
+    struct pin {
+        using port = Port;
+        using config = Config;
+
+        static constexpr lp::u32_t number = Number;
+        static constexpr lp::u32_t key = gpio_port<Port>::index * 16 + Number;
+
+        static_assert(Number < 16, "Pin number is out of port range");
+        static_assert(Config::pull != pins::pull::_reserved, "Pin pull is reserved value");
+
+        /// Contribution to port registers: field mask and field value
+        static constexpr lp::u32_t moder_mask = 0b11u << (Number * 2);
+        static constexpr lp::u32_t moder = static_cast<lp::u32_t>(Config::mode) << (Number * 2);
+        static constexpr lp::u32_t otyper_mask = 1u << Number;
+        static constexpr lp::u32_t otyper = static_cast<lp::u32_t>(Config::otype) << Number;
+        static constexpr lp::u32_t ospeedr_mask = moder_mask;
+        static constexpr lp::u32_t ospeedr = static_cast<lp::u32_t>(Config::speed) << (Number * 2);
+        static constexpr lp::u32_t pupdr_mask = moder_mask;
+        static constexpr lp::u32_t pupdr = static_cast<lp::u32_t>(Config::pull) << (Number * 2);
+
+        // alternate function is left at reset value unless the pin uses it
+        static constexpr bool alt_func = Config::mode == pins::mode::alt_func;
+        static constexpr lp::u32_t afr_mask = alt_func ? 0xfu << ((Number % 8) * 4) : 0;
+        static constexpr lp::u32_t afr = alt_func ?
+            static_cast<lp::u32_t>(Config::alt) << ((Number % 8) * 4) : 0;
+        static constexpr lp::u32_t afrl_mask = Number < 8 ? afr_mask : 0;
+        static constexpr lp::u32_t afrl = Number < 8 ? afr : 0;
+        static constexpr lp::u32_t afrh_mask = Number < 8 ? 0 : afr_mask;
+        static constexpr lp::u32_t afrh = Number < 8 ? 0 : afr;
+    };
+
+    /// Whole board pin map folded at compile time:
+    ///
+    ///     using my_board = board<
+    ///         pin<gpioa, 5, pin_config<pins::mode::output>>,
+    ///         pin<gpioa, 9, pin_config<pins::mode::alt_func, pins::speed::high,
+    ///             pins::pull::none, pins::otype::push_pull,
+    ///             pins::from(device::alt::usart1_2_3)>>
+    ///     >;
+    ///
+    ///     my_board::init();
+    ///
+    /// Port clocks are enabled by one write, each port register is
+    /// touched at most once and only when some pin changes it.
+    template <typename ...Pins>
+    struct board {
+        static_assert(sizeof...(Pins) > 0, "Board needs at least one pin");
+
+        /// Pin keys must be unique, a pin assigned twice is a conflict
+        static constexpr bool unique() noexcept {
+            const lp::u32_t keys[] = {Pins::key...};
+
+            for (lp::u32_t i = 0; i < sizeof...(Pins); ++i) {
+                for (lp::u32_t j = i + 1; j < sizeof...(Pins); ++j) {
+                    if (keys[i] == keys[j]) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        static_assert(unique(), "Board assigns the same pin more than once");
+
+        /// Apply pin map on top of current register state
+        static void init() noexcept {
+            enable_clocks();
+
+            const int ports[] = {0, (port_setup<Pins, first_of_port<Pins>(), false>::apply(), 0)...};
+            (void)ports;
+        }
+
+        /// Apply pin map assuming ports still hold reset values, nothing
+        /// is read back, so it is valid only straight after reset
+        static void init_from_reset() noexcept {
+            enable_clocks();
+
+            const int ports[] = {0, (port_setup<Pins, first_of_port<Pins>(), true>::apply(), 0)...};
+            (void)ports;
+        }
+
+    private:
+        /// Or of values belonging to pins of port, every port for all_ports
+        template <lp::u32_t Port, typename ...Values>
+        static constexpr lp::u32_t merge(Values ...values) noexcept {
+            const lp::u32_t ports[] = {gpio_port<typename Pins::port>::index...};
+            const lp::u32_t list[] = {values...};
+            lp::u32_t result = 0;
+
+            for (lp::u32_t i = 0; i < sizeof...(Pins); ++i) {
+                if (Port == all_ports || ports[i] == Port) {
+                    result |= list[i];
+                }
+            }
+
+            return result;
+        }
+
+        static constexpr lp::u32_t all_ports = ~0u;
+
+        /// Port registers are written once, by the first pin of the port
+        template <typename Pin>
+        static constexpr bool first_of_port() noexcept {
+            const lp::u32_t ports[] = {gpio_port<typename Pins::port>::index...};
+            const lp::u32_t keys[] = {Pins::key...};
+
+            for (lp::u32_t i = 0; i < sizeof...(Pins); ++i) {
+                if (ports[i] == gpio_port<typename Pin::port>::index) {
+                    return keys[i] == Pin::key;
+                }
+            }
+
+            return false;
+        }
+
+        static void enable_clocks() noexcept {
+            constexpr lp::u32_t enable = merge<all_ports>(
+                gpio_port<typename Pins::port>::enable::template mask<lp::u32_t>::value...);
+
+            gpio_enable_register::get() = gpio_enable_register::get() | enable;
+
+            // read back delays the first port access until the clock runs
+            const lp::u32_t enabled = gpio_enable_register::get();
+            (void)enabled;
+        }
+
+        template <typename Register, lp::u32_t Mask, lp::u32_t Value, lp::u32_t Full,
+            lp::u32_t Reset, bool From_reset>
+        static void write() noexcept {
+            constexpr lp::u32_t from_reset = (Reset & ~Mask) | Value;
+
+            if (Mask == 0) {
+                return;
+            }
+
+            if (From_reset) {
+                if (from_reset != Reset) {
+                    Register::get() = from_reset;
+                }
+            } else if (Mask == Full) {
+                Register::get() = Value;
+            } else {
+                Register::get() = (Register::get() & ~Mask) | Value;
+            }
+        }
+
+        template <typename Pin, bool First, bool From_reset>
+        struct port_setup {
+            static void apply() noexcept {
+            }
+        };
+
+        template <typename Pin, bool From_reset>
+        struct port_setup<Pin, true, From_reset> {
+            using block = typename Pin::port::block;
+            using traits = gpio_port<typename Pin::port>;
+
+            static constexpr lp::u32_t port = traits::index;
+
+            /// Moder goes last, pins start driving fully configured
+            static void apply() noexcept {
+                write<typename block::otyper,
+                    merge<port>(Pins::otyper_mask...), merge<port>(Pins::otyper...),
+                    0xffff, 0, From_reset>();
+                write<typename block::ospeedr,
+                    merge<port>(Pins::ospeedr_mask...), merge<port>(Pins::ospeedr...),
+                    0xffffffff, traits::ospeedr_reset, From_reset>();
+                write<typename block::pupdr,
+                    merge<port>(Pins::pupdr_mask...), merge<port>(Pins::pupdr...),
+                    0xffffffff, traits::pupdr_reset, From_reset>();
+                write<typename block::afrl,
+                    merge<port>(Pins::afrl_mask...), merge<port>(Pins::afrl...),
+                    0xffffffff, 0, From_reset>();
+                write<typename block::afrh,
+                    merge<port>(Pins::afrh_mask...), merge<port>(Pins::afrh...),
+                    0xffffffff, 0, From_reset>();
+                write<typename block::moder,
+                    merge<port>(Pins::moder_mask...), merge<port>(Pins::moder...),
+                    0xffffffff, traits::moder_reset, From_reset>();
+            }
+        };
+    };
+}
+
+#endif // HAL_BOARD_HH
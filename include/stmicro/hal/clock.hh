@@ -0,0 +1,244 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for system time
+ * @file clock.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <dwt.hh>
+#include <scb.hh>
+#include <stk.hh>
+
+#include <hal/stk.hh>
+
+#ifndef HAL_CLOCK_HH
+#define HAL_CLOCK_HH
+
+namespace hal {
+    /// Monotonic system time: SysTick periods counted in a 64-bit tick
+    /// counter plus the position inside the current period give core cycle
+    /// resolution, dwt cyccnt gives a single load 32-bit cycle stamp for
+    /// short measurements. irq_handler() must be called from
+    /// isr::sys_tick_timer and is the only writer, so readers need no lock:
+    /// the tick counter is read twice around the SysTick value and a pending
+    /// SysTick not yet handled (masked or less urgent than the reader)
+    /// is accounted for through icsr pendstset.
+    ///
+    /// Time counts in cycles of Core_hz whatever hclk SysTick runs from.
+    /// A clock profile switch calls retune() (clock_retune hook), each tick
+    /// then spans hclk_hz / Tick_hz SysTick counts scaled to Core_hz cycles,
+    /// so resolution follows the running hclk. Dwt cycles() counts real
+    /// core cycles and is not scaled.
+    template <lp::u32_t Core_hz, lp::u32_t Tick_hz = 1000>
+    struct clock {
+        static constexpr lp::u32_t core_hz = Core_hz;
+        static constexpr lp::u32_t tick_hz = Tick_hz;
+        static constexpr lp::u32_t cycles_per_tick = Core_hz / Tick_hz;
+
+        static_assert(Core_hz % Tick_hz == 0, "Tick rate must divide core clock");
+
+        /// Deadline on the cycle time line, 64-bit so it never wraps
+        struct deadline {
+            lp::u64_t at;
+
+            bool expired() const noexcept {
+                return now() >= at;
+            }
+
+            lp::u64_t remaining() const noexcept {
+                const lp::u64_t current = now();
+
+                return current < at ? at - current : 0;
+            }
+        };
+
+        /// Start SysTick from core clock and enable dwt cycle counter
+        static void start() noexcept {
+            tick_count = 0;
+            period = cycles_per_tick;
+
+            ::dcb::demcr::get() = ::dcb::demcr::get() | trcena;
+            ::dwt::cyccnt::get() = 0;
+            ::dwt::ctrl::get() = ::dwt::ctrl::get() | cyccntena;
+
+            stk::template config<cycles_per_tick>();
+        }
+
+        static void irq_handler() noexcept {
+            tick_count = tick_count + 1;
+        }
+
+        /// SysTick periods since start
+        static lp::u64_t ticks() noexcept {
+            lp::u64_t count;
+            lp::u32_t value;
+
+            (void)sample(count, value);
+
+            return count;
+        }
+
+        /// Core_hz cycles since start
+        static lp::u64_t now() noexcept {
+            lp::u64_t count;
+            lp::u32_t value;
+            lp::u32_t span = sample(count, value);
+
+            return count * cycles_per_tick + position(value, span);
+        }
+
+        /// Free running dwt cycle counter, wraps every 2^32 cycles
+        static lp::u32_t cycles() noexcept {
+            return ::dwt::cyccnt::get();
+        }
+
+        static lp::u64_t elapsed(lp::u64_t since) noexcept {
+            return now() - since;
+        }
+
+        /// Wrap safe while less than 2^32 cycles passed
+        static lp::u32_t elapsed_cycles(lp::u32_t since) noexcept {
+            return cycles() - since;
+        }
+
+        static deadline deadline_in(lp::u64_t cycles) noexcept {
+            return {now() + cycles};
+        }
+
+        /// Stop SysTick for a low power mode that halts the core clock,
+        /// call with interrupts masked. False when a tick is already
+        /// pending, the caller should resume(0) and not sleep.
+        static bool halt() noexcept {
+            ::stk::ctrl::get() = ::stk::ctrl::get() & ~enable;
+
+            return !(::scb::icsr::get() & pendstset);
+        }
+
+        /// Restart SysTick after halt() with slept Core_hz cycles added.
+        /// Current period is shortened to the remaining part through load,
+        /// the normal reload is restored for the following ones, so time
+        /// stays continuous with at most one SysTick count lost.
+        static void resume(lp::u64_t slept) noexcept {
+            restart(tick_count, position(::stk::val::get(), period) + slept);
+        }
+
+        /// SysTick for a new hclk, call with interrupts masked right after
+        /// the switch. The running period keeps its share of Core_hz
+        /// cycles and ends early or late in SysTick counts, so time stays
+        /// continuous across the switch.
+        static void retune(lp::u32_t hclk_hz) noexcept {
+            lp::u64_t count;
+            lp::u32_t value;
+
+            ::stk::ctrl::get() = ::stk::ctrl::get() & ~enable;
+
+            const lp::u32_t span = sample(count, value);
+
+            // a tick pending here is in count already
+            ::scb::icsr::get() = pendstclr;
+            period = hclk_hz / Tick_hz;
+
+            restart(count, position(value, span));
+        }
+
+        static constexpr lp::u64_t from_us(lp::u64_t us) noexcept {
+            return us * Core_hz / 1000000;
+        }
+
+        static constexpr lp::u64_t from_ms(lp::u64_t ms) noexcept {
+            return ms * Core_hz / 1000;
+        }
+
+        static constexpr lp::u64_t to_us(lp::u64_t cycles) noexcept {
+            return cycles * 1000000 / Core_hz;
+        }
+
+    private:
+        static constexpr lp::u32_t trcena = ::dcb::demcr_trcena::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cyccntena = ::dwt::ctrl_cyccntena::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t enable = ::stk::ctrl_enable::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pendstset = ::scb::icsr_pendstset::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pendstclr = ::scb::icsr_pendstclr::template mask<lp::u32_t>::value;
+
+        /// Tick count and SysTick value of one moment, returns the SysTick
+        /// counts per tick they were taken with
+        static lp::u32_t sample(lp::u64_t &count, lp::u32_t &value) noexcept {
+            lp::u64_t check;
+            lp::u32_t span;
+
+            do {
+                span = period;
+                count = tick_count;
+                value = ::stk::val::get();
+
+                // reload happened before this read, the value read above
+                // may predate it, so take a fresh one after the wrap
+                if (::scb::icsr::get() & pendstset) {
+                    value = ::stk::val::get();
+                    count = count + 1;
+                    check = tick_count + 1;
+                } else {
+                    check = tick_count;
+                }
+            } while (count != check || span != period);
+
+            return span;
+        }
+
+        /// Core_hz cycles into the current tick at SysTick value
+        static lp::u64_t position(lp::u32_t value, lp::u32_t span) noexcept {
+            const lp::u32_t counted = span - 1 - value;
+
+            return span == cycles_per_tick ? counted :
+                static_cast<lp::u64_t>(counted) * cycles_per_tick / span;
+        }
+
+        /// Continue count ticks and offset Core_hz cycles on, the current
+        /// period loaded with its remaining SysTick counts
+        static void restart(lp::u64_t count, lp::u64_t offset) noexcept {
+            const lp::u64_t left = cycles_per_tick - 1 - offset % cycles_per_tick;
+            lp::u32_t remaining = static_cast<lp::u32_t>(left * period / cycles_per_tick);
+
+            count = count + offset / cycles_per_tick;
+
+            // zero load would stop SysTick, start the next period instead
+            if (remaining == 0) {
+                remaining = period - 1;
+                count = count + 1;
+            }
+
+            tick_count = count;
+
+            ::stk::load::get() = remaining;
+            ::stk::val::get() = 0;
+            ::stk::ctrl::get() = ::stk::ctrl::get() | enable;
+            ::stk::load::get() = period - 1;
+        }
+
+        static volatile lp::u64_t tick_count;
+        /// SysTick counts per tick at the running hclk
+        static volatile lp::u32_t period;
+    };
+
+    template <lp::u32_t Core_hz, lp::u32_t Tick_hz>
+    volatile lp::u64_t clock<Core_hz, Tick_hz>::tick_count = 0;
+
+    template <lp::u32_t Core_hz, lp::u32_t Tick_hz>
+    volatile lp::u32_t clock<Core_hz, Tick_hz>::period = Core_hz / Tick_hz;
+}
+
+#endif // HAL_CLOCK_HH
@@ -0,0 +1,369 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for runtime clock profile switching
+ * @file clock_profile.hh
+ * @author Boris Vinogradov
+ */
+
+#include <type_list.hh>
+#include <types.hh>
+
+#include <dwt.hh>
+#include <stk.hh>
+
+#include <hal/clock_tree.hh>
+#include <hal/critical_section.hh>
+#include <hal/usart_type.hh>
+
+#ifndef HAL_CLOCK_PROFILE_HH
+#define HAL_CLOCK_PROFILE_HH
+
+namespace hal {
+    /// Bus frequencies of a clock tree at runtime
+    struct clock_frequencies {
+        lp::u32_t sysclk_hz;
+        lp::u32_t hclk_hz;
+        lp::u32_t pclk1_hz;
+        lp::u32_t pclk2_hz;
+        lp::u32_t apb1_timer_hz;
+        lp::u32_t apb2_timer_hz;
+
+        /// Kernel clock of peripheral block, as clock_tree::kernel_hz
+        template <typename Block>
+        lp::u32_t kernel_hz() const noexcept {
+            using clock = peripheral_clock<Block>;
+
+            return clock::bus == clock_bus::apb1 ?
+                (clock::timer ? apb1_timer_hz : pclk1_hz) :
+                (clock::timer ? apb2_timer_hz : pclk2_hz);
+        }
+    };
+
+    /// Driver divider update, runs with interrupts masked right after the
+    /// bus clocks changed
+    using retune_hook = void (*)(const clock_frequencies &frequencies);
+
+    /// Usart brr for Baudrate on the new kernel clock, brr is writable only
+    /// with the usart disabled, a character in flight is lost
+    template <typename Usart_block, lp::u32_t Baudrate>
+    struct usart_retune {
+        static void apply(const clock_frequencies &frequencies) noexcept {
+            const lp::u64_t scaled = usart_brr_scale<Usart_block>::value *
+                frequencies.template kernel_hz<Usart_block>();
+            const lp::u32_t cr1 = Usart_block::cr1::get();
+
+            Usart_block::cr1::get() = cr1 & ~ue;
+            Usart_block::brr::get() = static_cast<lp::u32_t>((scaled + Baudrate / 2) / Baudrate);
+            Usart_block::cr1::get() = cr1;
+        }
+
+    private:
+        static constexpr lp::u32_t ue = Usart_block::cr1_ue::template mask<lp::u32_t>::value;
+    };
+
+    /// Timer prescaler for Tick_hz counting on the new kernel clock. The
+    /// prescaler is loaded through an update event at once, the counter
+    /// value is kept.
+    template <typename Tim_block, lp::u32_t Tick_hz>
+    struct tim_retune {
+        static void apply(const clock_frequencies &frequencies) noexcept {
+            const lp::u32_t clock = frequencies.template kernel_hz<Tim_block>();
+            const lp::u32_t count = Tim_block::cnt::get();
+
+            Tim_block::psc::get() = (clock + Tick_hz / 2) / Tick_hz - 1;
+            Tim_block::egr::get() = ug;
+            Tim_block::cnt::get() = count;
+            Tim_block::sr::get() = ~uif;
+        }
+
+    private:
+        static constexpr lp::u32_t ug = Tim_block::egr_ug::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t uif = Tim_block::sr_uif::template mask<lp::u32_t>::value;
+    };
+
+    /// SysTick reload for Tick_hz on the new hclk, the current period
+    /// restarts. Only for SysTick run without hal::clock, which would lose
+    /// the restarted period and misread sub-tick time, use clock_retune
+    /// there.
+    template <lp::u32_t Tick_hz>
+    struct stk_retune {
+        static void apply(const clock_frequencies &frequencies) noexcept {
+            ::stk::load::get() = frequencies.hclk_hz / Tick_hz - 1;
+            ::stk::val::get() = 0;
+        }
+    };
+
+    /// hal::clock SysTick on the new hclk, time keeps counting in the
+    /// Core_hz cycles the clock was built for
+    template <typename Clock>
+    struct clock_retune {
+        static void apply(const clock_frequencies &frequencies) noexcept {
+            Clock::retune(frequencies.hclk_hz);
+        }
+    };
+
+    /// Lowest hclk any of Trees or its pll bridge runs at
+    template <typename ...Trees>
+    struct slowest_hclk_of {
+        static constexpr lp::u32_t find() noexcept {
+            const lp::u32_t clocks[] = {Trees::hclk_hz..., Trees::bridge_hclk_hz...};
+            lp::u32_t result = clocks[0];
+
+            for (auto clock : clocks) {
+                result = clock < result ? clock : result;
+            }
+
+            return result;
+        }
+
+        static constexpr lp::u32_t value = find();
+    };
+
+    /// Runtime switch between clock trees, for example a burst pll
+    /// profile and a low power msi one:
+    ///
+    ///     using sys = hal::clock<80000000>;
+    ///     using profiles = hal::clock_profile<
+    ///         hal::clock_tree<hal::clock_source::pll_msi, 80000000>,
+    ///         hal::clock_tree<hal::clock_source::msi, 2000000>
+    ///     >;
+    ///
+    ///     profiles::attach(hal::usart_retune<::usart2, 115200>::apply);
+    ///     profiles::attach(hal::clock_retune<sys>::apply);
+    ///     profiles::select<0>();
+    ///
+    /// Oscillator start, pll lock and range/wait state raise run with
+    /// interrupts enabled on the old clocks (clock_tree::prepare), then
+    /// interrupts are masked only for the sysclk switch and the retune
+    /// hooks, wait states and range are lowered afterwards. A pll relock
+    /// while running from the pll, or a new msi range feeding it, first
+    /// moves sysclk to the pll input (clock_tree::bridge) in a masked
+    /// part of its own with the hooks at the bridge clocks, the pll locks
+    /// with interrupts enabled, then the switch to it is masked again.
+    ///
+    /// No masked part waits on an oscillator, the only loop in there is
+    /// the sysclk switch status, at most switch_polls reads for each of
+    /// the two switches. A masked part is so bounded by masked_accesses
+    /// rcc register accesses besides the hooks, masked_bound_us with
+    /// access_cycles cycles an access at the slowest hclk of all trees.
+    /// Select fails when any wait gives up, the profile is none then
+    /// unless the core never left the old one.
+    ///
+    /// Switch time and masked time are measured with dwt cyccnt, which
+    /// clock_tree::apply does not start (hal::clock::start does). Cycles
+    /// span both clocks, so they are turned to microseconds against the
+    /// slower hclk of the two profiles, an upper bound of the real time.
+    template <typename ...Trees>
+    struct clock_profile {
+        static constexpr lp::u32_t count = sizeof...(Trees);
+        static constexpr lp::u32_t max_hooks = 8;
+        static constexpr lp::u32_t none = ~0u;
+        /// Rcc accesses of one masked part besides the retune hooks
+        static constexpr lp::u32_t masked_accesses = 2 * clock_solver::switch_polls + 32;
+        /// Core cycles of a status poll round running from the flash
+        /// accelerator, an estimate bench/clock_profile.cc checks
+        static constexpr lp::u32_t access_cycles = 8;
+        /// Masked part bound in microseconds besides the retune hooks
+        static constexpr lp::u32_t masked_bound_us = static_cast<lp::u32_t>(
+            (static_cast<lp::u64_t>(masked_accesses) * access_cycles * 1000000 +
+                slowest_hclk_of<Trees...>::value - 1) / slowest_hclk_of<Trees...>::value);
+
+        static_assert(count > 0, "Clock profile needs at least one clock tree");
+
+        struct statistics {
+            lp::u32_t switches;
+            lp::u32_t worst_switch_us;
+            lp::u32_t worst_masked_us;
+            lp::u32_t failures;
+        };
+
+        /// False when every hook slot is taken
+        static bool attach(retune_hook hook) noexcept {
+            if (hook_count == max_hooks) {
+                return false;
+            }
+
+            hooks[hook_count++] = hook;
+
+            return true;
+        }
+
+        /// False when a clock tree step gave up waiting
+        template <lp::u32_t Index>
+        static bool select() noexcept {
+            static_assert(Index < count, "Clock profile index out of range");
+
+            if (Index == active) {
+                return true;
+            }
+
+            return apply<typename lp::type_list<Trees...>::template get<Index>>(Index);
+        }
+
+        /// False for index out of range or a clock tree step that gave up
+        static bool select(lp::u32_t index) noexcept {
+            if (index >= count) {
+                return false;
+            }
+
+            return index == active || appliers[index](index);
+        }
+
+        /// Profile index, none before the first select
+        static lp::u32_t current() noexcept {
+            return active;
+        }
+
+        static clock_frequencies frequencies(lp::u32_t index) noexcept {
+            return table.entry[index];
+        }
+
+        static statistics report() noexcept {
+            return stats;
+        }
+
+        static void reset_statistics() noexcept {
+            stats = {0, 0, 0, 0};
+        }
+
+    private:
+        using applier = bool (*)(lp::u32_t index);
+
+        struct frequency_table {
+            clock_frequencies entry[count];
+        };
+
+        template <typename Tree>
+        static bool apply(lp::u32_t index) noexcept {
+            const lp::u32_t previous = active;
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            lp::u32_t masked = 0;
+            lp::u32_t slowest = previous == none || table.entry[previous].hclk_hz > Tree::hclk_hz ?
+                Tree::hclk_hz : table.entry[previous].hclk_hz;
+
+            if (!Tree::prepare()) {
+                ++stats.failures;
+                return false;
+            }
+
+            if (Tree::needs_bridge()) {
+                bool bridged;
+
+                slowest = Tree::bridge_hclk_hz < slowest ? Tree::bridge_hclk_hz : slowest;
+
+                {
+                    global_critical_section section;
+                    const lp::u32_t mask_begin = ::dwt::cyccnt::get();
+
+                    bridged = Tree::bridge();
+
+                    if (bridged) {
+                        run_hooks(bridge_frequencies<Tree>());
+                    }
+
+                    active = none;
+                    masked = ::dwt::cyccnt::get() - mask_begin;
+                }
+
+                if (!bridged || !Tree::lock()) {
+                    ++stats.failures;
+                    return false;
+                }
+            }
+
+            {
+                global_critical_section section;
+                const lp::u32_t mask_begin = ::dwt::cyccnt::get();
+
+                if (Tree::switch_over()) {
+                    run_hooks(table.entry[index]);
+                    active = index;
+                } else {
+                    active = none;
+                }
+
+                const lp::u32_t cycles = ::dwt::cyccnt::get() - mask_begin;
+
+                masked = cycles > masked ? cycles : masked;
+            }
+
+            if (active != index || !Tree::settle()) {
+                ++stats.failures;
+                return false;
+            }
+
+            const lp::u32_t total = ::dwt::cyccnt::get() - begin;
+
+            ++stats.switches;
+            record(stats.worst_switch_us, total, slowest);
+            record(stats.worst_masked_us, masked, slowest);
+
+            return true;
+        }
+
+        static void run_hooks(const clock_frequencies &frequencies) noexcept {
+            for (lp::u32_t i = 0; i < hook_count; ++i) {
+                hooks[i](frequencies);
+            }
+        }
+
+        /// Bus clocks while Tree holds sysclk on its pll input
+        template <typename Tree>
+        static constexpr clock_frequencies bridge_frequencies() noexcept {
+            return {Tree::oscillator_hz, Tree::bridge_hclk_hz, Tree::bridge_pclk1_hz, Tree::bridge_pclk2_hz,
+                Tree::pclk1_hz == Tree::hclk_hz ? Tree::bridge_pclk1_hz : Tree::bridge_pclk1_hz * 2,
+                Tree::pclk2_hz == Tree::hclk_hz ? Tree::bridge_pclk2_hz : Tree::bridge_pclk2_hz * 2};
+        }
+
+        static void record(lp::u32_t &worst, lp::u32_t cycles, lp::u32_t hz) noexcept {
+            const lp::u32_t us = static_cast<lp::u32_t>((static_cast<lp::u64_t>(cycles) * 1000000 + hz - 1) / hz);
+
+            if (us > worst) {
+                worst = us;
+            }
+        }
+
+        static constexpr frequency_table table = {{
+            {Trees::sysclk_hz, Trees::hclk_hz, Trees::pclk1_hz, Trees::pclk2_hz,
+                Trees::apb1_timer_hz, Trees::apb2_timer_hz}...
+        }};
+        static constexpr applier appliers[] = {apply<Trees>...};
+
+        static retune_hook hooks[max_hooks];
+        static lp::u32_t hook_count;
+        static lp::u32_t active;
+        static statistics stats;
+    };
+
+    template <typename ...Trees>
+    constexpr typename clock_profile<Trees...>::frequency_table clock_profile<Trees...>::table;
+
+    template <typename ...Trees>
+    constexpr typename clock_profile<Trees...>::applier clock_profile<Trees...>::appliers[];
+
+    template <typename ...Trees>
+    retune_hook clock_profile<Trees...>::hooks[max_hooks];
+
+    template <typename ...Trees>
+    lp::u32_t clock_profile<Trees...>::hook_count = 0;
+
+    template <typename ...Trees>
+    lp::u32_t clock_profile<Trees...>::active = none;
+
+    template <typename ...Trees>
+    typename clock_profile<Trees...>::statistics clock_profile<Trees...>::stats;
+}
+
+#endif // HAL_CLOCK_PROFILE_HH
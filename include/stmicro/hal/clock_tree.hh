@@ -0,0 +1,594 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for clock tree setup
+ * @file clock_tree.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <flash.hh>
+#include <pwr.hh>
+#include <rcc.hh>
+
+#include <hal/rcc_device.hh>
+
+#ifndef HAL_CLOCK_TREE_HH
+#define HAL_CLOCK_TREE_HH
+
+namespace hal {
+    /// System clock source, pll_* run the main pll from the named oscillator
+    enum class clock_source {
+        msi,
+        hsi16,
+        hse,
+        pll_msi,
+        pll_hsi16,
+        pll_hse
+    };
+
+    namespace clock_solver {
+        /// Voltage range 1 and 2 maximum core and pll frequencies
+        constexpr lp::u32_t range1_hz = 80000000;
+        constexpr lp::u32_t range2_hz = 26000000;
+        constexpr lp::u32_t range1_vco_hz = 344000000;
+        constexpr lp::u32_t range2_vco_hz = 128000000;
+        constexpr lp::u32_t vco_min_hz = 64000000;
+        constexpr lp::u32_t vco_input_min_hz = 4000000;
+        constexpr lp::u32_t vco_input_max_hz = 16000000;
+        /// Highest hclk for 0, 1, 2, ... flash wait states
+        constexpr lp::u32_t range1_latency_hz[] = {16000000, 32000000, 48000000, 64000000, 80000000};
+        constexpr lp::u32_t range2_latency_hz[] = {6000000, 12000000, 18000000, 26000000};
+        constexpr lp::u32_t msi_range_hz[] = {
+            100000, 200000, 400000, 800000, 1000000, 2000000,
+            4000000, 8000000, 16000000, 24000000, 32000000, 48000000
+        };
+        constexpr lp::u32_t invalid = ~0u;
+        /// Status reads before a wait on an oscillator, the pll, voltage
+        /// scaling or wait states gives up, over 10 ms at 80 MHz
+        constexpr lp::u32_t oscillator_polls = 0x40000;
+        /// Status reads before a sysclk switch gives up. Sws follows within
+        /// two cycles of the slower clock, 1600 cycles of an 80 MHz core
+        /// against the 100 kHz msi, each read takes a few cycles.
+        constexpr lp::u32_t switch_polls = 1024;
+
+        struct pll_setting {
+            lp::u32_t m;
+            lp::u32_t n;
+            lp::u32_t r;
+        };
+
+        /// Msirange field value or invalid
+        constexpr lp::u32_t msi_range(lp::u32_t hz) noexcept {
+            for (lp::u32_t index = 0; index < 12; ++index) {
+                if (msi_range_hz[index] == hz) {
+                    return index;
+                }
+            }
+
+            return invalid;
+        }
+
+        /// Cfgr hpre field value or invalid
+        constexpr lp::u32_t hpre(lp::u32_t divider) noexcept {
+            switch (divider) {
+                case 1: return 0;
+                case 2: return 8;
+                case 4: return 9;
+                case 8: return 10;
+                case 16: return 11;
+                case 64: return 12;
+                case 128: return 13;
+                case 256: return 14;
+                case 512: return 15;
+                default: return invalid;
+            }
+        }
+
+        /// Ahb divider of cfgr hpre field value
+        constexpr lp::u32_t hpre_divider(lp::u32_t field) noexcept {
+            return field < 8 ? 1 : field < 12 ? 1u << (field - 7) : 1u << (field - 6);
+        }
+
+        /// Cfgr hpre field value of the smallest ahb divider taking hz
+        /// down to limit or below
+        constexpr lp::u32_t hpre_within(lp::u32_t hz, lp::u32_t limit) noexcept {
+            const lp::u32_t dividers[] = {1, 2, 4, 8, 16, 64, 128, 256};
+
+            for (auto divider : dividers) {
+                if (hz <= static_cast<lp::u64_t>(limit) * divider) {
+                    return hpre(divider);
+                }
+            }
+
+            return hpre(512);
+        }
+
+        /// Cfgr ppre1/ppre2 field value or invalid
+        constexpr lp::u32_t ppre(lp::u32_t divider) noexcept {
+            switch (divider) {
+                case 1: return 0;
+                case 2: return 4;
+                case 4: return 5;
+                case 8: return 6;
+                case 16: return 7;
+                default: return invalid;
+            }
+        }
+
+        /// Fewest flash wait states for hclk or invalid
+        constexpr lp::u32_t wait_states(lp::u32_t hclk, bool low_range) noexcept {
+            const lp::u32_t count = low_range ? 4 : 5;
+
+            for (lp::u32_t states = 0; states < count; ++states) {
+                if (hclk <= (low_range ? range2_latency_hz[states] : range1_latency_hz[states])) {
+                    return states;
+                }
+            }
+
+            return invalid;
+        }
+
+        /// Pll dividers, vco input is 4 to 16 MHz, vco output 64 MHz to
+        /// vco_max, larger vco input is taken first for lower jitter.
+        /// All zero when nothing reaches output exactly.
+        constexpr pll_setting solve_pll(lp::u32_t input_hz, lp::u32_t output_hz, lp::u32_t vco_max) noexcept {
+            for (lp::u32_t m = 1; m <= 8; ++m) {
+                const lp::u32_t input = input_hz / m;
+
+                if (input_hz % m != 0 || input < vco_input_min_hz || input > vco_input_max_hz) {
+                    continue;
+                }
+
+                for (lp::u32_t r = 2; r <= 8; r += 2) {
+                    const lp::u64_t vco = static_cast<lp::u64_t>(output_hz) * r;
+                    const lp::u64_t n = vco / input;
+
+                    if (vco % input == 0 && vco >= vco_min_hz && vco <= vco_max && n >= 8 && n <= 86) {
+                        return {m, static_cast<lp::u32_t>(n), r};
+                    }
+                }
+            }
+
+            return {0, 0, 0};
+        }
+    }
+
+    /// Compile time clock tree. States the wanted sysclk/hclk/pclk1/pclk2
+    /// and source, Osc_hz is the msi range frequency feeding the pll or
+    /// crystal frequency for hse sources. The pll dividers, bus prescalers,
+    /// voltage range and minimum flash wait states are solved at compile
+    /// time, infeasible trees fail with static_assert:
+    ///
+    ///     using tree = hal::clock_tree<hal::clock_source::pll_msi, 80000000>;
+    ///
+    ///     tree::apply();
+    ///     hal::usart1::setup<hal::usart1::config::baud<tree, 115200>, ...>();
+    ///
+    /// Voltage range 2 is taken whenever the tree fits in it. Every wait
+    /// gives up after clock_solver::oscillator_polls or switch_polls status
+    /// reads, apply() and its steps return false then.
+    template <clock_source Source, lp::u32_t Sysclk_hz, lp::u32_t Hclk_hz = Sysclk_hz,
+        lp::u32_t Pclk1_hz = Hclk_hz, lp::u32_t Pclk2_hz = Hclk_hz, lp::u32_t Osc_hz = 4000000>
+    struct clock_tree {
+        static constexpr clock_source source = Source;
+        static constexpr lp::u32_t sysclk_hz = Sysclk_hz;
+        static constexpr lp::u32_t hclk_hz = Hclk_hz;
+        static constexpr lp::u32_t pclk1_hz = Pclk1_hz;
+        static constexpr lp::u32_t pclk2_hz = Pclk2_hz;
+
+        static constexpr bool uses_pll = Source == clock_source::pll_msi ||
+            Source == clock_source::pll_hsi16 || Source == clock_source::pll_hse;
+        static constexpr bool uses_msi = Source == clock_source::msi || Source == clock_source::pll_msi;
+        static constexpr bool uses_hsi16 = Source == clock_source::hsi16 || Source == clock_source::pll_hsi16;
+        static constexpr bool uses_hse = Source == clock_source::hse || Source == clock_source::pll_hse;
+
+        /// Oscillator feeding sysclk or pll, msi as sysclk runs at sysclk
+        static constexpr lp::u32_t oscillator_hz = uses_hsi16 ? 16000000 :
+            Source == clock_source::msi ? Sysclk_hz : Osc_hz;
+
+        static_assert(!uses_msi || clock_solver::msi_range(oscillator_hz) != clock_solver::invalid,
+            "Msi frequency is not one of msi ranges");
+        static_assert(!uses_hse || (Osc_hz >= 4000000 && Osc_hz <= 48000000), "Hse frequency is 4 to 48 MHz");
+        static_assert(uses_pll || Sysclk_hz == oscillator_hz, "Sysclk must equal oscillator without pll");
+        static_assert(Sysclk_hz <= clock_solver::range1_hz, "Sysclk is above 80 MHz");
+
+        /// Voltage range 2 holds the whole tree
+        static constexpr bool low_range = Sysclk_hz <= clock_solver::range2_hz &&
+            (!uses_pll || clock_solver::solve_pll(oscillator_hz, Sysclk_hz, clock_solver::range2_vco_hz).m != 0) &&
+            !((uses_hse || uses_msi) && oscillator_hz > clock_solver::range2_hz);
+
+        static constexpr lp::u32_t range = low_range ? 2 : 1;
+        static constexpr clock_solver::pll_setting pll = uses_pll ?
+            clock_solver::solve_pll(oscillator_hz, Sysclk_hz,
+                low_range ? clock_solver::range2_vco_hz : clock_solver::range1_vco_hz) :
+            clock_solver::pll_setting{0, 0, 0};
+
+        static_assert(!uses_pll || pll.m != 0, "No pll m/n/r reaches sysclk exactly");
+
+        static constexpr lp::u32_t vco_hz = uses_pll ? oscillator_hz / pll.m * pll.n : 0;
+
+        static_assert(Sysclk_hz % Hclk_hz == 0 && clock_solver::hpre(Sysclk_hz / Hclk_hz) != clock_solver::invalid,
+            "Hclk must be sysclk divided by 1, 2, 4, 8, 16, 64, 128, 256 or 512");
+        static_assert(Hclk_hz % Pclk1_hz == 0 && clock_solver::ppre(Hclk_hz / Pclk1_hz) != clock_solver::invalid,
+            "Pclk1 must be hclk divided by 1, 2, 4, 8 or 16");
+        static_assert(Hclk_hz % Pclk2_hz == 0 && clock_solver::ppre(Hclk_hz / Pclk2_hz) != clock_solver::invalid,
+            "Pclk2 must be hclk divided by 1, 2, 4, 8 or 16");
+
+        /// Fewest flash wait states for hclk in the chosen range
+        static constexpr lp::u32_t latency = clock_solver::wait_states(Hclk_hz, low_range);
+
+        static_assert(latency != clock_solver::invalid, "Hclk is above flash limit of voltage range");
+
+        static constexpr lp::u32_t apb1_timer_hz = Pclk1_hz == Hclk_hz ? Pclk1_hz : Pclk1_hz * 2;
+        static constexpr lp::u32_t apb2_timer_hz = Pclk2_hz == Hclk_hz ? Pclk2_hz : Pclk2_hz * 2;
+
+        /// Kernel clock of peripheral block (::usart2, ::tim5, ...)
+        template <typename Block>
+        static constexpr lp::u32_t kernel_hz() noexcept {
+            using clock = peripheral_clock<Block>;
+
+            return clock::bus == clock_bus::apb1 ?
+                (clock::timer ? apb1_timer_hz : Pclk1_hz) :
+                (clock::timer ? apb2_timer_hz : Pclk2_hz);
+        }
+
+        /// Switch running core to this tree from any other, wait states
+        /// and voltage range are raised before the clock goes up and
+        /// lowered after it went down, the pll is stopped when unused.
+        /// False when an oscillator, the pll, the range or a sysclk switch
+        /// gave up waiting, the core then runs at some safe point between
+        /// the old tree and this one.
+        static bool apply() noexcept {
+            if (!prepare()) {
+                return false;
+            }
+
+            if (needs_bridge() && !(bridge() && lock())) {
+                return false;
+            }
+
+            return switch_over() && settle();
+        }
+
+        /// First apply() step, everything that leaves sysclk untouched:
+        /// range and wait states up, oscillators the core does not run
+        /// from started at the frequency of this tree, the pll locked
+        /// unless needs_bridge(). Peripherals keep running on the old
+        /// clocks meanwhile.
+        static bool prepare() noexcept {
+            ::rcc::apb1enr1::get() = ::rcc::apb1enr1::get() | pwren;
+
+            const lp::u32_t enabled = ::rcc::apb1enr1::get();
+            (void)enabled;
+
+            if (range == 1 && !set_range()) {
+                return false;
+            }
+
+            if (latency > (::flash::acr::get() & latency_mask) && !set_latency()) {
+                return false;
+            }
+
+            if (!uses_msi) {
+                if (!start_oscillator()) {
+                    return false;
+                }
+            } else if (msi_drives_sysclk()) {
+                // masked steps write a new range only to a ready msi
+                if (!wait<::rcc::cr>(msirdy, msirdy, clock_solver::oscillator_polls)) {
+                    return false;
+                }
+            } else if (!set_msi()) {
+                return false;
+            }
+
+            if (uses_pll && !pll_ready() && !needs_bridge()) {
+                return start_pll();
+            }
+
+            return true;
+        }
+
+        /// The pll has to be locked while sysclk runs from it, or its msi
+        /// input needs a new range while sysclk runs from the msi. Sysclk
+        /// then moves over to the pll input with bridge() and the pll is
+        /// locked with lock(), both between prepare() and switch_over().
+        static bool needs_bridge() noexcept {
+            return uses_pll && !pll_ready() &&
+                (running() == 3 || (uses_msi && running() == 0 && !msi_at_target()));
+        }
+
+        /// Sysclk to the pll input oscillator at the frequency of this
+        /// tree, hclk held within this tree's, pll stopped. Never waits on
+        /// an oscillator, a new msi range settles in lock().
+        static bool bridge() noexcept {
+            const lp::u32_t input_hz = uses_msi ? msi_hz() : oscillator_hz;
+
+            if (!route(input_sw, clock_solver::hpre_within(
+                    input_hz > oscillator_hz ? input_hz : oscillator_hz, Hclk_hz))) {
+                return false;
+            }
+
+            ::rcc::cr::get() = ::rcc::cr::get() & ~pllon;
+
+            if (uses_msi && !msi_at_target()) {
+                write_msi_range();
+            }
+
+            return route(input_sw, bridge_hpre);
+        }
+
+        /// Pll locked with the dividers of this tree after bridge()
+        static bool lock() noexcept {
+            return start_pll();
+        }
+
+        /// Sysclk and bus prescalers change here. An msi sysclk with a new
+        /// range is reached through the msi at its current range, hclk
+        /// held within this tree's, the range settles in settle(). Only
+        /// waits on sysclk switches, never on an oscillator.
+        static bool switch_over() noexcept {
+            if (uses_msi && !uses_pll && !msi_at_target()) {
+                const lp::u32_t now_hz = msi_hz();
+
+                if (!route(0, clock_solver::hpre_within(now_hz > oscillator_hz ? now_hz : oscillator_hz, Hclk_hz))) {
+                    return false;
+                }
+
+                // the pll may run from the msi even when sysclk does not
+                ::rcc::cr::get() = ::rcc::cr::get() & ~pllon;
+                write_msi_range();
+            }
+
+            if (!route(sw, hpre_value)) {
+                return false;
+            }
+
+            if (!uses_pll) {
+                ::rcc::cr::get() = ::rcc::cr::get() & ~pllon;
+            }
+
+            return true;
+        }
+
+        /// Last apply() step, msi range settled, wait states and range down
+        /// to this tree
+        static bool settle() noexcept {
+            if (uses_msi && !wait<::rcc::cr>(msirdy, msirdy, clock_solver::oscillator_polls)) {
+                return false;
+            }
+
+            if (latency < (::flash::acr::get() & latency_mask) && !set_latency()) {
+                return false;
+            }
+
+            return range == 1 || set_range();
+        }
+
+        /// Ahb prescaler while bridge() holds sysclk on the pll input
+        static constexpr lp::u32_t bridge_hpre = clock_solver::hpre_within(oscillator_hz, Hclk_hz);
+
+        /// Bus clocks between bridge() and switch_over()
+        static constexpr lp::u32_t bridge_hclk_hz = oscillator_hz / clock_solver::hpre_divider(bridge_hpre);
+        static constexpr lp::u32_t bridge_pclk1_hz = bridge_hclk_hz / (Hclk_hz / Pclk1_hz);
+        static constexpr lp::u32_t bridge_pclk2_hz = bridge_hclk_hz / (Hclk_hz / Pclk2_hz);
+
+    private:
+        static constexpr lp::u32_t sw = uses_pll ? 3 : uses_hse ? 2 : uses_hsi16 ? 1 : 0;
+        static constexpr lp::u32_t pll_source = uses_msi ? 1 : uses_hsi16 ? 2 : 3;
+        /// Sysclk source value of the pll input oscillator
+        static constexpr lp::u32_t input_sw = pll_source == 1 ? 0 : pll_source - 1;
+        static constexpr lp::u32_t hpre_value = clock_solver::hpre(Sysclk_hz / Hclk_hz);
+        static constexpr lp::u32_t ppre_value =
+            (clock_solver::ppre(Hclk_hz / Pclk1_hz) << ::rcc::cfgr_ppre1::position) |
+            (clock_solver::ppre(Hclk_hz / Pclk2_hz) << ::rcc::cfgr_ppre2::position);
+
+        static constexpr lp::u32_t pwren = ::rcc::apb1enr1_pwren::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t vos_mask = ::pwr::cr1_vos::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t vos_position = ::pwr::cr1_vos::position;
+        static constexpr lp::u32_t vosf = ::pwr::sr2_vosf::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t latency_mask = ::flash::acr_latency::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t msion = ::rcc::cr_msion::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t msirdy = ::rcc::cr_msirdy::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t msirgsel = ::rcc::cr_msirgsel::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t msirange_mask = ::rcc::cr_msirange::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t msirange_position = ::rcc::cr_msirange::position;
+        static constexpr lp::u32_t msisrange_mask = ::rcc::csr_msisrange::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t msisrange_position = ::rcc::csr_msisrange::position;
+        static constexpr lp::u32_t msi_range_value = uses_msi ? clock_solver::msi_range(oscillator_hz) : 0;
+        static constexpr lp::u32_t hsion = ::rcc::cr_hsion::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t hsirdy = ::rcc::cr_hsirdy::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t hseon = ::rcc::cr_hseon::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t hserdy = ::rcc::cr_hserdy::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pllon = ::rcc::cr_pllon::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pllrdy = ::rcc::cr_pllrdy::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t sw_mask = ::rcc::cfgr_sw::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t sw_position = ::rcc::cfgr_sw::position;
+        static constexpr lp::u32_t sws_mask = ::rcc::cfgr_sws::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t sws_position = ::rcc::cfgr_sws::position;
+        static constexpr lp::u32_t hpre_mask = ::rcc::cfgr_hpre::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t hpre_position = ::rcc::cfgr_hpre::position;
+        static constexpr lp::u32_t ppre1_mask = ::rcc::cfgr_ppre1::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ppre1_position = ::rcc::cfgr_ppre1::position;
+        static constexpr lp::u32_t ppre2_mask = ::rcc::cfgr_ppre2::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ppre2_position = ::rcc::cfgr_ppre2::position;
+        static constexpr lp::u32_t pllsrc_mask = ::rcc::pllcfgr_pllsrc::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pllsrc_position = ::rcc::pllcfgr_pllsrc::position;
+
+        static constexpr lp::u32_t pllcfgr_value =
+            (pll_source << ::rcc::pllcfgr_pllsrc::position) |
+            ((pll.m - 1) << ::rcc::pllcfgr_pllm::position) |
+            (pll.n << ::rcc::pllcfgr_plln::position) |
+            ((pll.r / 2 - 1) << ::rcc::pllcfgr_pllr::position) |
+            ::rcc::pllcfgr_pllren::template mask<lp::u32_t>::value;
+
+        /// Current sysclk source as cfgr sws reports it
+        static lp::u32_t running() noexcept {
+            return (::rcc::cfgr::get() & sws_mask) >> sws_position;
+        }
+
+        /// Pll locked with the dividers of this tree
+        static bool pll_ready() noexcept {
+            return (::rcc::cr::get() & pllrdy) && ::rcc::pllcfgr::get() == pllcfgr_value;
+        }
+
+        /// Poll Register until its Mask bits read value, false after polls
+        /// reads
+        template <typename Register>
+        static bool wait(lp::u32_t mask, lp::u32_t value, lp::u32_t polls) noexcept {
+            for (lp::u32_t poll = 0; poll < polls; ++poll) {
+                if ((Register::get() & mask) == value) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        static bool set_range() noexcept {
+            ::pwr::cr1::get() = (::pwr::cr1::get() & ~vos_mask) | (range << vos_position);
+
+            return wait<::pwr::sr2>(vosf, 0, clock_solver::oscillator_polls);
+        }
+
+        /// New wait states apply once acr reads them back
+        static bool set_latency() noexcept {
+            ::flash::acr::get() = (::flash::acr::get() & ~latency_mask) | latency;
+
+            return wait<::flash::acr>(latency_mask, latency, clock_solver::oscillator_polls);
+        }
+
+        /// Msi range in use, csr msisrange until msirgsel is set
+        static lp::u32_t msi_range_now() noexcept {
+            const lp::u32_t cr = ::rcc::cr::get();
+
+            return (cr & msirgsel) ? (cr & msirange_mask) >> msirange_position :
+                (::rcc::csr::get() & msisrange_mask) >> msisrange_position;
+        }
+
+        static lp::u32_t msi_hz() noexcept {
+            const lp::u32_t index = msi_range_now();
+
+            return index < 12 ? clock_solver::msi_range_hz[index] : clock_solver::msi_range_hz[11];
+        }
+
+        static bool msi_at_target() noexcept {
+            return (::rcc::cr::get() & msion) && msi_range_now() == msi_range_value;
+        }
+
+        /// Core runs from the msi, directly or through the pll
+        static bool msi_drives_sysclk() noexcept {
+            return running() == 0 ||
+                (running() == 3 && ((::rcc::pllcfgr::get() & pllsrc_mask) >> pllsrc_position) == 1);
+        }
+
+        /// Sysclk to source with ahb prescaler field hpre and bus
+        /// prescalers of this tree. A larger ahb divider goes before the
+        /// switch and a smaller one after it, so hclk never passes the
+        /// old one or the one of this tree. False when sws did not follow
+        /// within switch_polls reads, the larger divider stays then.
+        static bool route(lp::u32_t source, lp::u32_t hpre) noexcept {
+            const lp::u32_t field = (::rcc::cfgr::get() & hpre_mask) >> hpre_position;
+            const lp::u32_t current = field < 8 ? 0 : field;
+
+            if (hpre > current) {
+                ::rcc::cfgr::get() = (::rcc::cfgr::get() & ~hpre_mask) | (hpre << hpre_position);
+            }
+
+            ::rcc::cfgr::get() = (::rcc::cfgr::get() & ~(sw_mask | ppre1_mask | ppre2_mask)) |
+                (source << sw_position) | ppre_value;
+
+            if (!wait<::rcc::cfgr>(sws_mask, source << sws_position, clock_solver::switch_polls)) {
+                return false;
+            }
+
+            if (hpre < current) {
+                ::rcc::cfgr::get() = (::rcc::cfgr::get() & ~hpre_mask) | (hpre << hpre_position);
+            }
+
+            return true;
+        }
+
+        /// Range is writable while the msi is off or ready
+        static void write_msi_range() noexcept {
+            ::rcc::cr::get() = (::rcc::cr::get() & ~msirange_mask) | msion | msirgsel |
+                (msi_range_value << msirange_position);
+        }
+
+        /// Msi at the range of this tree while the core does not run from it
+        static bool set_msi() noexcept {
+            if (msi_at_target()) {
+                return true;
+            }
+
+            // a pll running from the msi would leave its input range
+            if (((::rcc::pllcfgr::get() & pllsrc_mask) >> pllsrc_position) == 1 && !stop_pll()) {
+                return false;
+            }
+
+            if ((::rcc::cr::get() & msion) && !wait<::rcc::cr>(msirdy, msirdy, clock_solver::oscillator_polls)) {
+                return false;
+            }
+
+            write_msi_range();
+
+            return wait<::rcc::cr>(msirdy, msirdy, clock_solver::oscillator_polls);
+        }
+
+        static bool start_oscillator() noexcept {
+            if (uses_hsi16) {
+                ::rcc::cr::get() = ::rcc::cr::get() | hsion;
+
+                return wait<::rcc::cr>(hsirdy, hsirdy, clock_solver::oscillator_polls);
+            }
+
+            if (uses_hse) {
+                ::rcc::cr::get() = ::rcc::cr::get() | hseon;
+
+                return wait<::rcc::cr>(hserdy, hserdy, clock_solver::oscillator_polls);
+            }
+
+            return true;
+        }
+
+        static bool stop_pll() noexcept {
+            ::rcc::cr::get() = ::rcc::cr::get() & ~pllon;
+
+            return wait<::rcc::cr>(pllrdy, 0, clock_solver::oscillator_polls);
+        }
+
+        /// Pll is reprogrammed only while stopped, sysclk does not run
+        /// from it here and its input is at the frequency of this tree
+        static bool start_pll() noexcept {
+            constexpr lp::u32_t input_ready = uses_msi ? msirdy : uses_hsi16 ? hsirdy : hserdy;
+
+            if (!stop_pll() || !wait<::rcc::cr>(input_ready, input_ready, clock_solver::oscillator_polls)) {
+                return false;
+            }
+
+            ::rcc::pllcfgr::get() = pllcfgr_value;
+            ::rcc::cr::get() = ::rcc::cr::get() | pllon;
+
+            return wait<::rcc::cr>(pllrdy, pllrdy, clock_solver::oscillator_polls);
+        }
+    };
+
+    template <clock_source Source, lp::u32_t Sysclk_hz, lp::u32_t Hclk_hz,
+        lp::u32_t Pclk1_hz, lp::u32_t Pclk2_hz, lp::u32_t Osc_hz>
+    constexpr clock_solver::pll_setting clock_tree<Source, Sysclk_hz, Hclk_hz, Pclk1_hz, Pclk2_hz, Osc_hz>::pll;
+}
+
+#endif // HAL_CLOCK_TREE_HH
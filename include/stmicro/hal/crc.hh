@@ -0,0 +1,366 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for crc calculation unit
+ * @file crc.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <crc.hh>
+#include <rcc.hh>
+
+#include <hal/dma_type.hh>
+
+#ifndef HAL_CRC_HH
+#define HAL_CRC_HH
+
+namespace hal {
+    /// Crc model in the usual catalogue terms: width, polynomial without
+    /// the top bit, initial value, input/output reflection and final xor
+    template <lp::u32_t Width, lp::u32_t Poly, lp::u32_t Init, bool Reflect_in, bool Reflect_out,
+        lp::u32_t Xor_out>
+    struct crc_config {
+        static_assert(Width == 7 || Width == 8 || Width == 16 || Width == 32,
+            "Crc unit supports 7, 8, 16 and 32 bit polynomials");
+
+        static constexpr lp::u32_t width = Width;
+        static constexpr lp::u32_t poly = Poly;
+        static constexpr lp::u32_t init = Init;
+        static constexpr bool reflect_in = Reflect_in;
+        static constexpr bool reflect_out = Reflect_out;
+        static constexpr lp::u32_t xor_out = Xor_out;
+        static constexpr lp::u32_t mask = Width == 32 ? ~0u : (1u << Width) - 1;
+    };
+
+    /// Ethernet, zlib, png
+    using crc32 = crc_config<32, 0x04c11db7, 0xffffffff, true, true, 0xffffffff>;
+    /// Crc unit reset setting
+    using crc32_mpeg2 = crc_config<32, 0x04c11db7, 0xffffffff, false, false, 0>;
+    using crc16_ccitt_false = crc_config<16, 0x1021, 0xffff, false, false, 0>;
+    using crc16_modbus = crc_config<16, 0x8005, 0xffff, true, true, 0>;
+    using crc8_smbus = crc_config<8, 0x07, 0, false, false, 0>;
+
+    namespace crc_table {
+        constexpr lp::u32_t reflect(lp::u32_t value, lp::u32_t width) noexcept {
+            lp::u32_t result = 0;
+
+            for (lp::u32_t i = 0; i < width; ++i) {
+                result |= ((value >> i) & 1) << (width - 1 - i);
+            }
+
+            return result;
+        }
+
+        /// entry[k][i] is byte i followed by k zero bytes
+        struct slices {
+            lp::u32_t entry[8][256];
+        };
+
+        /// Reflected tables run the register lsb first in the low width
+        /// bits, others msb first aligned to bit 31
+        constexpr slices make(lp::u32_t width, lp::u32_t poly, bool reflected) noexcept {
+            slices result = {};
+            const lp::u32_t feedback = reflected ? reflect(poly, width) : poly << (32 - width);
+
+            for (lp::u32_t i = 0; i < 256; ++i) {
+                lp::u32_t value = reflected ? i : i << 24;
+
+                for (lp::u32_t bit = 0; bit < 8; ++bit) {
+                    if (reflected) {
+                        value = value & 1 ? (value >> 1) ^ feedback : value >> 1;
+                    } else {
+                        value = value & 0x80000000 ? (value << 1) ^ feedback : value << 1;
+                    }
+                }
+
+                result.entry[0][i] = value;
+            }
+
+            for (lp::u32_t k = 1; k < 8; ++k) {
+                for (lp::u32_t i = 0; i < 256; ++i) {
+                    const lp::u32_t previous = result.entry[k - 1][i];
+
+                    result.entry[k][i] = reflected ?
+                        (previous >> 8) ^ result.entry[0][previous & 0xff] :
+                        (previous << 8) ^ result.entry[0][previous >> 24];
+                }
+            }
+
+            return result;
+        }
+    }
+
+    /// Table driven slicing-by-8 crc for host builds and cores without
+    /// the unit, 8 KB of tables per config, little endian loads
+    template <typename Config>
+    struct crc_software {
+        static_assert(Config::width % 8 == 0, "Software crc supports whole byte widths");
+
+        static lp::u32_t start() noexcept {
+            return Config::reflect_in ? crc_table::reflect(Config::init, Config::width) :
+                Config::init << (32 - Config::width);
+        }
+
+        static lp::u32_t update(lp::u32_t state, const void *data, lp::u32_t size) noexcept {
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+            const auto &entry = table.entry;
+
+            for (; size >= 8; size -= 8, bytes += 8) {
+                lp::u32_t one;
+                lp::u32_t two;
+
+                __builtin_memcpy(&one, bytes, sizeof(one));
+                __builtin_memcpy(&two, bytes + 4, sizeof(two));
+
+                if (Config::reflect_in) {
+                    one ^= state;
+                    state = entry[7][one & 0xff] ^ entry[6][(one >> 8) & 0xff] ^
+                        entry[5][(one >> 16) & 0xff] ^ entry[4][one >> 24] ^
+                        entry[3][two & 0xff] ^ entry[2][(two >> 8) & 0xff] ^
+                        entry[1][(two >> 16) & 0xff] ^ entry[0][two >> 24];
+                } else {
+                    one = __builtin_bswap32(one) ^ state;
+                    two = __builtin_bswap32(two);
+                    state = entry[7][one >> 24] ^ entry[6][(one >> 16) & 0xff] ^
+                        entry[5][(one >> 8) & 0xff] ^ entry[4][one & 0xff] ^
+                        entry[3][two >> 24] ^ entry[2][(two >> 16) & 0xff] ^
+                        entry[1][(two >> 8) & 0xff] ^ entry[0][two & 0xff];
+                }
+            }
+
+            for (; size; --size, ++bytes) {
+                state = Config::reflect_in ? (state >> 8) ^ entry[0][(state ^ *bytes) & 0xff] :
+                    (state << 8) ^ entry[0][(state >> 24) ^ *bytes];
+            }
+
+            return state;
+        }
+
+        static lp::u32_t finish(lp::u32_t state) noexcept {
+            lp::u32_t value = Config::reflect_in ? state : state >> (32 - Config::width);
+
+            if (Config::reflect_in != Config::reflect_out) {
+                value = crc_table::reflect(value, Config::width);
+            }
+
+            return (value ^ Config::xor_out) & Config::mask;
+        }
+
+        static lp::u32_t compute(const void *data, lp::u32_t size) noexcept {
+            return finish(update(start(), data, size));
+        }
+
+    private:
+        static constexpr crc_table::slices table =
+            crc_table::make(Config::width, Config::poly, Config::reflect_in);
+    };
+
+    template <typename Config>
+    constexpr crc_table::slices crc_software<Config>::table;
+
+    /// Crc calculation unit set up for Config. Data goes in by words with
+    /// byte and half word writes for unaligned head and tail. Reflected
+    /// input uses the unit reversal matching each write width, plain
+    /// input is byte swapped on the way in, as the unit takes the most
+    /// significant byte of a word first.
+    ///
+    /// The unit is shared, begin() sets it up completely, so users of
+    /// different configs only need to keep their begin() to value()
+    /// sequences apart.
+    template <typename Config>
+    struct crc {
+        using config = Config;
+
+        static void enable() noexcept {
+            ::rcc::ahb1enr::get() = ::rcc::ahb1enr::get() | crcen;
+
+            // read back so the clock is running before the first access
+            const lp::u32_t enabled = ::rcc::ahb1enr::get();
+            (void)enabled;
+        }
+
+        static void begin() noexcept {
+            begin(Config::init);
+        }
+
+        /// Start from a raw init register value. Passing value() of a
+        /// config without final xor and output reflection continues it.
+        static void begin(lp::u32_t initial) noexcept {
+            ::crc::pol::get() = Config::poly;
+            ::crc::init::get() = initial;
+            ::crc::cr::get() = control(rev_word) | reset;
+        }
+
+        static void feed(const void *data, lp::u32_t size) noexcept {
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+
+            if (reinterpret_cast<lp::addr_t>(bytes) & 3) {
+                input(rev_byte);
+
+                for (; size && (reinterpret_cast<lp::addr_t>(bytes) & 3); --size) {
+                    write_byte(*bytes++);
+                }
+            }
+
+            input(rev_word);
+
+            for (; size >= 4; size -= 4, bytes += 4) {
+                lp::u32_t word;
+
+                __builtin_memcpy(&word, bytes, sizeof(word));
+                ::crc::dr::get() = Config::reflect_in ? word : __builtin_bswap32(word);
+            }
+
+            tail(bytes, size);
+        }
+
+        static lp::u32_t value() noexcept {
+            return (::crc::dr::get() ^ Config::xor_out) & Config::mask;
+        }
+
+        static lp::u32_t compute(const void *data, lp::u32_t size) noexcept {
+            begin();
+            feed(data, size);
+
+            return value();
+        }
+
+        /// Feed through a dma channel (any free one, no request is used),
+        /// waits for the end. Reflected input moves words with the head
+        /// and tail written by the core, plain input needs a byte swap
+        /// the dma can't do, so it moves single bytes. False on a
+        /// transfer error, the unit value is of no use then.
+        template <typename Channel>
+        static bool feed_dma(const void *data, lp::u32_t size) noexcept {
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+
+            if (!Config::reflect_in) {
+                input(rev_word);
+                return transfer<Channel, dma_config::width::byte>(bytes, size);
+            }
+
+            if (reinterpret_cast<lp::addr_t>(bytes) & 3) {
+                input(rev_byte);
+
+                for (; size && (reinterpret_cast<lp::addr_t>(bytes) & 3); --size) {
+                    write_byte(*bytes++);
+                }
+            }
+
+            input(rev_word);
+
+            if (!transfer<Channel, dma_config::width::word>(bytes, size / 4)) {
+                return false;
+            }
+
+            tail(bytes + size / 4 * 4, size % 4);
+
+            return true;
+        }
+
+        /// Crc of data into result, false and result untouched on a
+        /// transfer error
+        template <typename Channel>
+        static bool compute_dma(const void *data, lp::u32_t size, lp::u32_t &result) noexcept {
+            begin();
+
+            if (!feed_dma<Channel>(data, size)) {
+                return false;
+            }
+
+            result = value();
+
+            return true;
+        }
+
+    private:
+        static constexpr lp::u32_t crcen = ::rcc::ahb1enr_crcen::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t reset = ::crc::cr_reset::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t rev_byte = 1;
+        static constexpr lp::u32_t rev_half = 2;
+        static constexpr lp::u32_t rev_word = 3;
+        static constexpr lp::u32_t polysize =
+            (Config::width == 32 ? 0u : Config::width == 16 ? 1u : Config::width == 8 ? 2u : 3u) <<
+                ::crc::cr_polysize::position;
+        static constexpr lp::u32_t rev_out = Config::reflect_out ? ::crc::cr_rev_out::mask<lp::u32_t>::value : 0;
+        static constexpr lp::u32_t dma_max = 0xffff;
+
+        static constexpr lp::u32_t control(lp::u32_t reversal) noexcept {
+            return polysize | rev_out | (Config::reflect_in ? reversal << ::crc::cr_rev_in::position : 0);
+        }
+
+        /// Input reversal for the next write width, cr writes keep the
+        /// running value
+        static void input(lp::u32_t reversal) noexcept {
+            if (Config::reflect_in) {
+                ::crc::cr::get() = control(reversal);
+            }
+        }
+
+        static void write_byte(lp::u8_t value) noexcept {
+            *reinterpret_cast<volatile lp::u8_t *>(::crc::dr::address) = value;
+        }
+
+        static void tail(const lp::u8_t *bytes, lp::u32_t size) noexcept {
+            if (size >= 2) {
+                lp::u16_t half;
+
+                __builtin_memcpy(&half, bytes, sizeof(half));
+                input(rev_half);
+                *reinterpret_cast<volatile lp::u16_t *>(::crc::dr::address) =
+                    Config::reflect_in ? half : __builtin_bswap16(half);
+                bytes += 2;
+                size -= 2;
+            }
+
+            if (size) {
+                input(rev_byte);
+                write_byte(*bytes);
+            }
+        }
+
+        /// Count items in parts of at most dma_max, stops at an error
+        template <typename Channel, dma_config::width Width>
+        static bool transfer(const lp::u8_t *bytes, lp::u32_t count) noexcept {
+            const lp::u32_t unit = Width == dma_config::width::word ? 4 : 1;
+
+            while (count) {
+                const lp::u32_t part = count < dma_max ? count : dma_max;
+                lp::u32_t status;
+
+                Channel::template mem_to_periph<dma_config::no_request,
+                    dma_config::periph_size<Width>, dma_config::memory_size<Width>>(
+                        ::crc::dr::address, bytes, part);
+
+                while (!((status = Channel::get_flags()) & (Channel::flags::complete | Channel::flags::error))) {
+                }
+
+                Channel::stop();
+
+                if (status & Channel::flags::error) {
+                    return false;
+                }
+
+                bytes += part * unit;
+                count -= part;
+            }
+
+            return true;
+        }
+    };
+}
+
+#endif // HAL_CRC_HH
@@ -0,0 +1,98 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for critical sections
+ * @file critical_section.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <cpu.hh>
+
+#include <hal/nvic.hh>
+
+#ifndef HAL_CRITICAL_SECTION_HH
+#define HAL_CRITICAL_SECTION_HH
+
+namespace hal {
+    /// Most urgent priority among irq_cfg entries sharing some data, the
+    /// ceiling of a critical section protecting it
+    template <typename ...Configs>
+    struct ceiling_of {
+        static constexpr lp::u32_t find() noexcept {
+            const lp::u32_t priorities[] = {Configs::priority...};
+            lp::u32_t result = priorities[0];
+
+            for (auto priority : priorities) {
+                result = priority < result ? priority : result;
+            }
+
+            return result;
+        }
+
+        static constexpr lp::u32_t value = find();
+    };
+
+    /// Holds off interrupts with logical priority Ceiling and below through
+    /// basepri, more urgent ones keep running. Only the group part of the
+    /// priority (nvic::set_priority_grouping) takes part in masking. Nested
+    /// sections never lower the current mask, the previous basepri comes
+    /// back on exit.
+    template <lp::u32_t Ceiling>
+    struct critical_section {
+        static_assert(Ceiling < (1u << nvic_device::priority_bits),
+            "Ceiling does not fit implemented priority bits");
+        static_assert(Ceiling > 0,
+            "Ceiling 0 can not be set through basepri, use global_critical_section");
+
+        static constexpr lp::u32_t basepri = Ceiling << (8 - nvic_device::priority_bits);
+
+        critical_section() noexcept : saved(cpu::get_basepri()) {
+            cpu::set_basepri_max(basepri);
+        }
+
+        ~critical_section() noexcept {
+            cpu::set_basepri(saved);
+        }
+
+        critical_section(const critical_section &) = delete;
+        critical_section &operator=(const critical_section &) = delete;
+
+    private:
+        const lp::u32_t saved;
+    };
+
+    /// Masks every configurable interrupt through primask, interrupts are
+    /// enabled again on exit only when they were enabled on entry
+    struct global_critical_section {
+        global_critical_section() noexcept : saved(cpu::get_primask()) {
+            cpu::disable_interrupts();
+        }
+
+        ~global_critical_section() noexcept {
+            if (!saved) {
+                cpu::enable_interrupts();
+            }
+        }
+
+        global_critical_section(const global_critical_section &) = delete;
+        global_critical_section &operator=(const global_critical_section &) = delete;
+
+    private:
+        const lp::u32_t saved;
+    };
+}
+
+#endif // HAL_CRITICAL_SECTION_HH
@@ -0,0 +1,29 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for dma
+ * @file dma.hh
+ * @author Boris Vinogradov
+ */
+
+#include <hal/dma_device.hh>
+
+#ifndef HAL_DMA_HH
+#define HAL_DMA_HH
+
+namespace hal {
+    using namespace dma_device;
+}
+
+#endif // HAL_DMA_HH
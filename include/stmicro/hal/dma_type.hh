@@ -0,0 +1,309 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for dma
+ * type definitions for dma
+ * @file dma_type.hh
+ * @author Boris Vinogradov
+ */
+
+#include <io_register.hh>
+#include <types.hh>
+#include <type_list.hh>
+
+#include <dma.hh>
+
+#include <hal/isr_irq.hh>
+
+#ifndef HAL_DMA_TYPE_HH
+#define HAL_DMA_TYPE_HH
+
+namespace hal {
+    /// Interrupt of dma channel, specialized by device
+    template <typename Dma_block, lp::u32_t Channel>
+    struct dma_channel_irq;
+
+    struct dma_config {
+        enum struct width : lp::u32_t {
+            byte = 0b00,
+            half_word = 0b01,
+            word = 0b10
+        };
+
+        enum struct level : lp::u32_t {
+            low = 0b00,
+            medium = 0b01,
+            high = 0b10,
+            very_high = 0b11
+        };
+
+        struct complete_int {
+            static constexpr lp::u32_t value = 1 << 1;
+        };
+
+        struct half_int {
+            static constexpr lp::u32_t value = 1 << 2;
+        };
+
+        struct error_int {
+            static constexpr lp::u32_t value = 1 << 3;
+        };
+
+        struct circular {
+            static constexpr lp::u32_t value = 1 << 5;
+        };
+
+        /// Run without peripheral request at memory to memory speed, for
+        /// targets without dma request like the crc unit
+        struct no_request {
+            static constexpr lp::u32_t value = 1 << 14;
+        };
+
+        struct periph_increment {
+            static constexpr lp::u32_t value = 1 << 6;
+        };
+
+        template <width Width>
+        struct periph_size {
+            static constexpr lp::u32_t value = static_cast<lp::u32_t>(Width) << 8;
+        };
+
+        template <width Width>
+        struct memory_size {
+            static constexpr lp::u32_t value = static_cast<lp::u32_t>(Width) << 10;
+        };
+
+        template <level Level>
+        struct priority {
+            static constexpr lp::u32_t value = static_cast<lp::u32_t>(Level) << 12;
+        };
+
+        template <typename ...Options>
+        static constexpr lp::u32_t value() noexcept {
+            const lp::u32_t values[] = {0, Options::value...};
+            lp::u32_t result = 0;
+
+            for (auto v : values) {
+                result |= v;
+            }
+
+            return result;
+        }
+    };
+
+    template <typename Dma_block, lp::u32_t Channel, lp::u32_t Request>
+    struct dma_channel {
+        static_assert(Channel >= 1 && Channel <= 7, "Dma channel must be in 1..7");
+        static_assert(Request <= 0xf, "Dma request must be in 0..15");
+
+        using block = Dma_block;
+        using dma_channels = lp::type_list<dma_channel>;
+
+        static constexpr lp::u32_t channel = Channel;
+        static constexpr lp::u32_t request = Request;
+        static constexpr irq_dev_num_t irq = dma_channel_irq<Dma_block, Channel>::value;
+        /// Unique identity of controller channel
+        static constexpr lp::addr_t key = block::isr::address + Channel;
+
+        using ccr = typename lp::type_list<
+            typename block::ccr1, typename block::ccr2, typename block::ccr3,
+            typename block::ccr4, typename block::ccr5, typename block::ccr6,
+            typename block::ccr7
+        >::template get<Channel - 1>;
+        using cndtr = typename lp::type_list<
+            typename block::cndtr1, typename block::cndtr2, typename block::cndtr3,
+            typename block::cndtr4, typename block::cndtr5, typename block::cndtr6,
+            typename block::cndtr7
+        >::template get<Channel - 1>;
+        using cpar = typename lp::type_list<
+            typename block::cpar1, typename block::cpar2, typename block::cpar3,
+            typename block::cpar4, typename block::cpar5, typename block::cpar6,
+            typename block::cpar7
+        >::template get<Channel - 1>;
+        using cmar = typename lp::type_list<
+            typename block::cmar1, typename block::cmar2, typename block::cmar3,
+            typename block::cmar4, typename block::cmar5, typename block::cmar6,
+            typename block::cmar7
+        >::template get<Channel - 1>;
+
+        struct flags {
+            static constexpr lp::u32_t shift = (Channel - 1) * 4;
+            static constexpr lp::u32_t global = 0x1u << shift;
+            static constexpr lp::u32_t complete = 0x2u << shift;
+            static constexpr lp::u32_t half = 0x4u << shift;
+            static constexpr lp::u32_t error = 0x8u << shift;
+            static constexpr lp::u32_t all = 0xfu << shift;
+        };
+
+        static void select_request() noexcept {
+            block::cselr::get() = (block::cselr::get() & ~(0xfu << flags::shift)) |
+                (Request << flags::shift);
+        }
+
+        template <typename ...Options>
+        static void mem_to_periph(lp::addr_t periph, const void *memory, lp::u32_t count) noexcept {
+            start(periph, reinterpret_cast<lp::addr_t>(memory), count,
+                ccr_dir | ccr_minc | dma_config::value<Options...>());
+        }
+
+        template <typename ...Options>
+        static void periph_to_mem(lp::addr_t periph, void *memory, lp::u32_t count) noexcept {
+            start(periph, reinterpret_cast<lp::addr_t>(memory), count,
+                ccr_minc | dma_config::value<Options...>());
+        }
+
+        template <typename ...Options>
+        static void mem_to_mem(const void *source, void *destination, lp::u32_t count) noexcept {
+            static_assert((dma_config::value<Options...>() & dma_config::circular::value) == 0,
+                "Memory to memory transfer can't be circular");
+
+            start(reinterpret_cast<lp::addr_t>(source),
+                reinterpret_cast<lp::addr_t>(destination), count,
+                ccr_mem2mem | ccr_minc | dma_config::periph_increment::value |
+                    dma_config::value<Options...>());
+        }
+
+        /// Circular transfer split in two halves, half() tells which
+        /// one is released by the hardware after an interrupt
+        template <typename ...Options>
+        static void mem_to_periph_double_buffer(lp::addr_t periph, const void *memory,
+                lp::u32_t count) noexcept {
+            mem_to_periph<dma_config::circular, dma_config::half_int,
+                dma_config::complete_int, Options...>(periph, memory, count);
+        }
+
+        template <typename ...Options>
+        static void periph_to_mem_double_buffer(lp::addr_t periph, void *memory,
+                lp::u32_t count) noexcept {
+            periph_to_mem<dma_config::circular, dma_config::half_int,
+                dma_config::complete_int, Options...>(periph, memory, count);
+        }
+
+        /// Index of released half for double buffered transfers
+        static constexpr lp::u32_t half(lp::u32_t status) noexcept {
+            return (status & flags::complete) ? 1 : 0;
+        }
+
+        static void stop() noexcept {
+            ccr::get() = 0;
+            block::ifcr::get() = flags::all;
+        }
+
+        static bool enabled() noexcept {
+            return ccr::get() & ccr_en;
+        }
+
+        static lp::u32_t remaining() noexcept {
+            return cndtr::get();
+        }
+
+        static lp::u32_t get_flags() noexcept {
+            return block::isr::get() & flags::all;
+        }
+
+        static void clear_flags(lp::u32_t status) noexcept {
+            block::ifcr::get() = status & flags::all;
+        }
+
+        /// Read and acknowledge pending channel flags
+        static lp::u32_t take_flags() noexcept {
+            const lp::u32_t status = get_flags();
+
+            clear_flags(status);
+
+            return status;
+        }
+
+    private:
+        // All channels share ccr1 layout
+        static constexpr lp::u32_t ccr_en = block::ccr1_en::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ccr_dir = block::ccr1_dir::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ccr_minc = block::ccr1_minc::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ccr_mem2mem = block::ccr1_mem2mem::template mask<lp::u32_t>::value;
+
+        static void start(lp::addr_t periph, lp::addr_t memory, lp::u32_t count,
+                lp::u32_t mode) noexcept {
+            ccr::get() = 0;
+            block::ifcr::get() = flags::all;
+            cpar::get() = periph;
+            cmar::get() = memory;
+            cndtr::get() = count;
+            ccr::get() = mode | ccr_en;
+        }
+    };
+
+    template <typename Channels>
+    struct dma_channel_keys;
+
+    template <typename ...Channels>
+    struct dma_channel_keys<lp::type_list<Channels...>> {
+        static constexpr lp::u32_t count(lp::addr_t key) noexcept {
+            const lp::addr_t keys[] = {0, Channels::key...};
+            lp::u32_t result = 0;
+
+            for (auto k : keys) {
+                result += k == key;
+            }
+
+            return result;
+        }
+
+        template <typename ...Owners>
+        static constexpr bool unique_in() noexcept {
+            const lp::addr_t keys[] = {0, Channels::key...};
+
+            for (lp::u32_t i = 1; i < sizeof...(Channels) + 1; ++i) {
+                const lp::u32_t counts[] = {0,
+                    dma_channel_keys<typename Owners::dma_channels>::count(keys[i])...};
+                lp::u32_t total = 0;
+
+                for (auto c : counts) {
+                    total += c;
+                }
+
+                if (total != 1) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    template <typename ...Owners>
+    constexpr bool dma_channels_unique() noexcept {
+        const bool unique[] = {true,
+            dma_channel_keys<typename Owners::dma_channels>::template unique_in<Owners...>()...};
+
+        for (auto u : unique) {
+            if (!u) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// Compile-time channel ownership check, every owner is a dma_channel
+    /// or a driver exposing its channels as dma_channels type list:
+    /// static_assert(hal::dma_allocation<uart_link, adc_stream>::value, "");
+    template <typename ...Owners>
+    struct dma_allocation {
+        static constexpr bool value = dma_channels_unique<Owners...>();
+
+        static_assert(value, "Dma channel is claimed by more than one driver");
+    };
+}
+
+#endif // HAL_DMA_TYPE_HH
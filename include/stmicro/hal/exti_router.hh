@@ -0,0 +1,197 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for exti handler dispatch
+ * @file exti_router.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/device.hh>
+#include <hal/exti_device.hh>
+
+#ifndef HAL_EXTI_ROUTER_HH
+#define HAL_EXTI_ROUTER_HH
+
+namespace hal {
+    using exti_handler = void (*)();
+
+    /// Handler bound to exti line
+    template <device::exti Line, exti_handler Handler>
+    struct exti_bind {
+        static constexpr lp::u32_t line = static_cast<lp::u32_t>(Line);
+        static constexpr exti_handler handler = Handler;
+    };
+
+    /// Compile time exti handler table. Vector functions are called from
+    /// the matching isr:
+    ///
+    ///     using router = hal::exti_router<
+    ///         hal::exti_bind<hal::device::exti::gpio6, on_button>,
+    ///         hal::exti_bind<hal::device::exti::gpio13, on_encoder>
+    ///     >;
+    ///
+    ///     void isr::EXTI9_5() { router::exti9_5(); }
+    ///     void isr::EXTI15_10() { router::exti15_10(); }
+    ///
+    /// A shared vector reads pr & imr once, clears exactly the lines it is
+    /// about to handle and walks them with count leading zeros, so the
+    /// cost is one table call per pending line, unbound lines cost nothing.
+    template <typename ...Binds>
+    struct exti_router {
+        static_assert(sizeof...(Binds) > 0, "Exti router needs at least one handler");
+
+        static constexpr bool unique() noexcept {
+            const lp::u32_t lines[] = {Binds::line...};
+
+            for (lp::u32_t i = 0; i < sizeof...(Binds); ++i) {
+                for (lp::u32_t j = i + 1; j < sizeof...(Binds); ++j) {
+                    if (lines[i] == lines[j]) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        static_assert(unique(), "Exti line is bound to more than one handler");
+
+        /// Bound lines of pr/imr register word
+        static constexpr lp::u32_t bound(lp::u32_t word) noexcept {
+            const lp::u32_t lines[] = {Binds::line...};
+            lp::u32_t mask = 0;
+
+            for (auto line : lines) {
+                if ((line >> 5) == word) {
+                    mask |= 1u << (line & 0x1f);
+                }
+            }
+
+            return mask;
+        }
+
+        /// Unmask interrupts of every bound line
+        static void enable() noexcept {
+            update<0, bound(0), true>();
+            update<1, bound(1), true>();
+        }
+
+        static void disable() noexcept {
+            update<0, bound(0), false>();
+            update<1, bound(1), false>();
+        }
+
+        /// Handle pending bound lines from Mask of register Word
+        template <lp::u32_t Word, lp::u32_t Mask>
+        static void dispatch() noexcept {
+            using pr = exti_device::pr::template get<Word>;
+            using imr = exti_device::imr::template get<Word>;
+
+            constexpr lp::u32_t lines = Mask & bound(Word);
+
+            // dedicated vector (exti0..exti4) raised only by its own line,
+            // shared vectors always check which lines are really pending
+            if (lines != 0 && (Mask & (Mask - 1)) == 0) {
+                pr::get() = lines;
+                table.handler[Word][31 - __builtin_clz(lines)]();
+                return;
+            }
+
+            lp::u32_t pending = pr::get() & imr::get() & lines;
+
+            pr::get() = pending;
+
+            while (pending) {
+                const lp::u32_t line = 31 - __builtin_clz(pending);
+
+                pending &= ~(1u << line);
+                table.handler[Word][line]();
+            }
+        }
+
+        static void exti0() noexcept {
+            dispatch<0, 1u << 0>();
+        }
+
+        static void exti1() noexcept {
+            dispatch<0, 1u << 1>();
+        }
+
+        static void exti2() noexcept {
+            dispatch<0, 1u << 2>();
+        }
+
+        static void exti3() noexcept {
+            dispatch<0, 1u << 3>();
+        }
+
+        static void exti4() noexcept {
+            dispatch<0, 1u << 4>();
+        }
+
+        static void exti9_5() noexcept {
+            dispatch<0, 0x000003e0>();
+        }
+
+        static void exti15_10() noexcept {
+            dispatch<0, 0x0000fc00>();
+        }
+
+    private:
+        struct handler_table {
+            exti_handler handler[2][32];
+        };
+
+        static void none() noexcept {
+        }
+
+        static constexpr handler_table make_table() noexcept {
+            const lp::u32_t lines[] = {Binds::line...};
+            const exti_handler handlers[] = {Binds::handler...};
+            handler_table result = {};
+
+            for (lp::u32_t word = 0; word < 2; ++word) {
+                for (lp::u32_t line = 0; line < 32; ++line) {
+                    result.handler[word][line] = none;
+                }
+            }
+
+            for (lp::u32_t i = 0; i < sizeof...(Binds); ++i) {
+                result.handler[lines[i] >> 5][lines[i] & 0x1f] = handlers[i];
+            }
+
+            return result;
+        }
+
+        template <lp::u32_t Word, lp::u32_t Mask, bool Unmask>
+        static void update() noexcept {
+            using imr = exti_device::imr::template get<Word>;
+
+            if (Mask == 0) {
+                return;
+            }
+
+            imr::get() = Unmask ? imr::get() | Mask : imr::get() & ~Mask;
+        }
+
+        static constexpr handler_table table = make_table();
+    };
+
+    template <typename ...Binds>
+    constexpr typename exti_router<Binds...>::handler_table exti_router<Binds...>::table;
+}
+
+#endif // HAL_EXTI_ROUTER_HH
@@ -0,0 +1,428 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for flash erase and programming
+ * @file flash.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <dwt.hh>
+#include <flash.hh>
+#include <flash_ram.hh>
+#include <syscfg.hh>
+
+#include <hal/critical_section.hh>
+#include <hal/flash_accel.hh>
+#include <hal/flash_device.hh>
+#include <hal/nvic.hh>
+
+#ifndef HAL_FLASH_HH
+#define HAL_FLASH_HH
+
+namespace hal {
+    enum class flash_status {
+        ok,
+        busy,
+        locked,
+        /// Address outside main memory or not aligned to the unit
+        address,
+        /// Flash sr error bits, see flash::errors()
+        failed
+    };
+
+    /// Main flash erase and programming. Every call needs unlock() first.
+    /// Programming goes by 64-bit double words or, much faster, by 256
+    /// byte rows in fast programming mode, which runs from ram with all
+    /// interrupts masked for the row time and needs a mass erased bank.
+    /// Erase is by 2 KB page of either bank, blocking or finished in
+    /// isr::FLASH through irq_handler(), or by whole bank.
+    ///
+    /// Caches are kept off while a blocking operation runs and reset after
+    /// every operation. Each mode accumulates bytes and dwt cycles spent,
+    /// bytes_per_second() turns them into throughput.
+    struct flash {
+        using done_hook = void (*)(flash_status status);
+
+        static constexpr irq_dev_num_t irq = irq_dev_num_t::FLASH;
+
+        enum class mode {
+            double_word,
+            row,
+            erase
+        };
+
+        struct meter {
+            lp::u64_t bytes;
+            lp::u64_t cycles;
+        };
+
+        static void unlock() noexcept {
+            if (locked()) {
+                ::flash::keyr::get() = flash_device::key1;
+                ::flash::keyr::get() = flash_device::key2;
+            }
+        }
+
+        static void lock() noexcept {
+            ::flash::cr::get() = ::flash::cr::get() | lock_bit;
+        }
+
+        static bool locked() noexcept {
+            return ::flash::cr::get() & lock_bit;
+        }
+
+        static bool busy() noexcept {
+            return ::flash::sr::get() & bsy;
+        }
+
+        /// Error bits of the last failed operation
+        static lp::u32_t errors() noexcept {
+            return context().last_errors;
+        }
+
+        /// Bank of address as the erase logic numbers it, swapped banks
+        /// (syscfg memrmp fb_mode) map bank 2 at the lower address
+        static lp::u32_t bank(lp::addr_t address) noexcept {
+            const lp::u32_t upper = (address - flash_device::base) >= flash_device::bank_size;
+            const lp::u32_t swapped = (::syscfg::memrmp::get() & fb_mode) != 0;
+
+            return upper ^ swapped;
+        }
+
+        static flash_status erase_page(lp::addr_t address) noexcept {
+            const flash_status checked = check(address, flash_device::page_size, flash_device::page_size);
+
+            if (checked != flash_status::ok) {
+                return checked;
+            }
+
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            flash_status status;
+
+            {
+                flash_accel::write_guard guard;
+
+                start_erase(address, 0);
+                wait();
+                status = finish(per | pnb_mask | bker);
+            }
+
+            account(mode::erase, flash_device::page_size, begin);
+
+            return status;
+        }
+
+        /// Mass erase the bank holding address, numbered as bank() does.
+        /// Code has to run from the other bank, reads of the erased one
+        /// stall until the end.
+        static flash_status erase_bank(lp::addr_t address) noexcept {
+            const flash_status checked = check(address, 1, 1);
+
+            if (checked != flash_status::ok) {
+                return checked;
+            }
+
+            const lp::u32_t mer = bank(address) ? mer2 : mer1;
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            flash_status status;
+
+            {
+                flash_accel::write_guard guard;
+
+                ::flash::sr::get() = error_mask | eop;
+                ::flash::cr::get() = (::flash::cr::get() & ~per) | mer;
+                ::flash::cr::get() = ::flash::cr::get() | start;
+                wait();
+                status = finish(mer);
+            }
+
+            account(mode::erase, flash_device::bank_size, begin);
+
+            return status;
+        }
+
+        /// Erase every page touched by [address, address + size)
+        static flash_status erase(lp::addr_t address, lp::u32_t size) noexcept {
+            const lp::addr_t first = address & ~(flash_device::page_size - 1);
+
+            for (lp::addr_t page = first; page < address + size; page += flash_device::page_size) {
+                const flash_status status = erase_page(page);
+
+                if (status != flash_status::ok) {
+                    return status;
+                }
+            }
+
+            return flash_status::ok;
+        }
+
+        /// Start page erase, done is called from irq_handler() with the
+        /// result. Code and data of the other bank stay readable meanwhile,
+        /// reads of the erased bank stall until the end.
+        static flash_status erase_page_async(lp::addr_t address, done_hook done) noexcept {
+            const flash_status checked = check(address, flash_device::page_size, flash_device::page_size);
+
+            if (checked != flash_status::ok) {
+                return checked;
+            }
+
+            state &current = context();
+
+            current.done = done;
+            current.started = ::dwt::cyccnt::get();
+            __atomic_store_n(&current.erasing, true, __ATOMIC_RELEASE);
+
+            nvic::template enable_irq<irq>();
+            start_erase(address, eopie | errie);
+
+            return flash_status::ok;
+        }
+
+        static void irq_handler() noexcept {
+            if (!(::flash::sr::get() & (eop | error_mask))) {
+                return;
+            }
+
+            state &current = context();
+            const flash_status status = finish(per | pnb_mask | bker | eopie | errie);
+            const done_hook done = current.done;
+
+            account(mode::erase, flash_device::page_size, current.started);
+            flash_accel::reset_caches();
+            current.done = nullptr;
+            __atomic_store_n(&current.erasing, false, __ATOMIC_RELEASE);
+
+            if (done) {
+                done(status);
+            }
+        }
+
+        static flash_status program(lp::addr_t address, lp::u64_t value) noexcept {
+            const flash_status checked = check(address, flash_device::double_word_size,
+                flash_device::double_word_size);
+
+            if (checked != flash_status::ok) {
+                return checked;
+            }
+
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            flash_status status;
+
+            {
+                flash_accel::write_guard guard;
+
+                status = program_double_word(address, value);
+            }
+
+            account(mode::double_word, flash_device::double_word_size, begin);
+
+            return status;
+        }
+
+        /// Program size bytes, a multiple of 8, double word by double word
+        static flash_status program(lp::addr_t address, const void *data, lp::u32_t size) noexcept {
+            if (size % flash_device::double_word_size) {
+                return flash_status::address;
+            }
+
+            const flash_status checked = check(address, size, flash_device::double_word_size);
+
+            if (checked != flash_status::ok) {
+                return checked;
+            }
+
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            flash_status status = flash_status::ok;
+
+            {
+                flash_accel::write_guard guard;
+
+                for (lp::u32_t offset = 0; offset < size && status == flash_status::ok;
+                    offset += flash_device::double_word_size) {
+                    lp::u64_t value;
+
+                    __builtin_memcpy(&value, bytes + offset, sizeof(value));
+                    status = program_double_word(address + offset, value);
+                }
+            }
+
+            account(mode::double_word, size, begin);
+
+            return status;
+        }
+
+        /// Fast program 256 bytes. The bank of the row has to be mass erased
+        /// with erase_bank() beforehand, a page erase is not enough (pgserr
+        /// and fasterr then), and hclk has to be 8 MHz or more. Data is
+        /// copied to the stack first as the ram routine may not read flash.
+        static flash_status program_row(lp::addr_t address, const void *data) noexcept {
+            const flash_status checked = check(address, flash_device::row_size, flash_device::row_size);
+
+            if (checked != flash_status::ok) {
+                return checked;
+            }
+
+            lp::u32_t words[flash_device::row_size / sizeof(lp::u32_t)];
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            lp::u32_t result;
+
+            __builtin_memcpy(words, data, sizeof(words));
+
+            {
+                flash_accel::write_guard guard;
+                global_critical_section section;
+
+                result = flash_ram::program_row(address, words);
+            }
+
+            account(mode::row, flash_device::row_size, begin);
+
+            return result ? fail(result) : flash_status::ok;
+        }
+
+        static meter measured(mode which) noexcept {
+            return context().meters[static_cast<lp::u32_t>(which)];
+        }
+
+        static void reset_meters() noexcept {
+            for (auto &entry : context().meters) {
+                entry = {0, 0};
+            }
+        }
+
+        /// Throughput of a mode for core running at Core_hz
+        template <lp::u32_t Core_hz>
+        static lp::u32_t bytes_per_second(mode which) noexcept {
+            const meter &entry = context().meters[static_cast<lp::u32_t>(which)];
+
+            return entry.cycles ? static_cast<lp::u32_t>(entry.bytes * Core_hz / entry.cycles) : 0;
+        }
+
+    private:
+        static constexpr lp::u32_t lock_bit = ::flash::cr_lock::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pg = ::flash::cr_pg::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t per = ::flash::cr_per::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pnb_mask = ::flash::cr_pnb::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t pnb_position = ::flash::cr_pnb::position;
+        static constexpr lp::u32_t bker = ::flash::cr_bker::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mer1 = ::flash::cr_mer1::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mer2 = ::flash::cr_mer2::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t start = ::flash::cr_start::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t eopie = ::flash::cr_eopie::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t errie = ::flash::cr_errie::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t bsy = ::flash::sr_bsy::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t eop = ::flash::sr_eop::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t fb_mode = ::syscfg::memrmp_fb_mode::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t error_mask =
+            ::flash::sr_operr::mask<lp::u32_t>::value |
+            ::flash::sr_progerr::mask<lp::u32_t>::value |
+            ::flash::sr_wrperr::mask<lp::u32_t>::value |
+            ::flash::sr_pgaerr::mask<lp::u32_t>::value |
+            ::flash::sr_sizerr::mask<lp::u32_t>::value |
+            ::flash::sr_pgserr::mask<lp::u32_t>::value |
+            ::flash::sr_miserr::mask<lp::u32_t>::value |
+            ::flash::sr_fasterr::mask<lp::u32_t>::value;
+
+        struct state {
+            meter meters[3];
+            lp::u32_t last_errors;
+            lp::u32_t started;
+            done_hook done;
+            /// Set by erase_page_async(), cleared by irq_handler()
+            bool erasing;
+        };
+
+        /// Header only driver state, zero initialized
+        static state &context() noexcept {
+            static state value;
+            return value;
+        }
+
+        /// Range inside main memory and aligned to align
+        static flash_status check(lp::addr_t address, lp::u32_t size, lp::u32_t align) noexcept {
+            if (address < flash_device::base || address + size > flash_device::base + flash_device::size ||
+                (address - flash_device::base) % align) {
+                return flash_status::address;
+            }
+
+            if (locked()) {
+                return flash_status::locked;
+            }
+
+            if (busy() || __atomic_load_n(&context().erasing, __ATOMIC_ACQUIRE)) {
+                return flash_status::busy;
+            }
+
+            return flash_status::ok;
+        }
+
+        static void wait() noexcept {
+            while (busy()) {
+            }
+        }
+
+        static flash_status fail(lp::u32_t bits) noexcept {
+            context().last_errors = bits;
+
+            return flash_status::failed;
+        }
+
+        /// Clear operation bits of cr, collect and clear errors
+        static flash_status finish(lp::u32_t bits) noexcept {
+            const lp::u32_t result = ::flash::sr::get() & error_mask;
+
+            ::flash::cr::get() = ::flash::cr::get() & ~bits;
+            ::flash::sr::get() = result | eop;
+
+            return result ? fail(result) : flash_status::ok;
+        }
+
+        static void start_erase(lp::addr_t address, lp::u32_t interrupts) noexcept {
+            const lp::u32_t page = ((address - flash_device::base) % flash_device::bank_size) /
+                flash_device::page_size;
+
+            ::flash::sr::get() = error_mask | eop;
+            ::flash::cr::get() = (::flash::cr::get() & ~(pnb_mask | bker)) | per | interrupts |
+                (page << pnb_position) | (bank(address) ? bker : 0);
+            ::flash::cr::get() = ::flash::cr::get() | start;
+        }
+
+        /// Low word goes first, programming starts with the high one
+        static flash_status program_double_word(lp::addr_t address, lp::u64_t value) noexcept {
+            volatile lp::u32_t *const target = reinterpret_cast<volatile lp::u32_t *>(address);
+
+            ::flash::sr::get() = error_mask | eop;
+            ::flash::cr::get() = ::flash::cr::get() | pg;
+
+            target[0] = static_cast<lp::u32_t>(value);
+            target[1] = static_cast<lp::u32_t>(value >> 32);
+
+            wait();
+
+            return finish(pg);
+        }
+
+        static void account(mode which, lp::u32_t bytes, lp::u32_t begin) noexcept {
+            meter &entry = context().meters[static_cast<lp::u32_t>(which)];
+
+            entry.bytes += bytes;
+            entry.cycles += ::dwt::cyccnt::get() - begin;
+        }
+    };
+}
+
+#endif // HAL_FLASH_HH
@@ -0,0 +1,144 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for flash prefetch and caches
+ * @file flash_accel.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <flash.hh>
+
+#ifndef HAL_FLASH_ACCEL_HH
+#define HAL_FLASH_ACCEL_HH
+
+namespace hal {
+    /// Prefetch buffer and instruction/data cache setting
+    template <bool Prefetch, bool Icache, bool Dcache>
+    struct flash_accel_config {
+        static constexpr bool prefetch = Prefetch;
+        static constexpr bool icache = Icache;
+        static constexpr bool dcache = Dcache;
+    };
+
+    /// Usual fastest setting, everything on
+    using flash_accel_all = flash_accel_config<true, true, true>;
+
+    /// Flash read accelerator (ART) control. A cache is reset only while
+    /// disabled: every path here clears icen/dcen, pulses icrst/dcrst and
+    /// enables again in separate acr writes. Caches enabled after being
+    /// off are always reset first, since flash may have been erased or
+    /// programmed meanwhile.
+    struct flash_accel {
+        template <typename Config>
+        static void configure() noexcept {
+            const lp::u32_t wanted = (Config::prefetch ? prften : 0) |
+                (Config::icache ? icen : 0) | (Config::dcache ? dcen : 0);
+            const lp::u32_t current = ::flash::acr::get();
+            const lp::u32_t off = current & ~wanted & (icen | dcen);
+            // caches turning on now
+            const lp::u32_t on = wanted & ~current & (icen | dcen);
+
+            if (off) {
+                ::flash::acr::get() = current & ~off;
+            }
+
+            if (on) {
+                reset(on);
+            }
+
+            ::flash::acr::get() = (::flash::acr::get() & ~(prften | icen | dcen)) | wanted;
+        }
+
+        static void enable_prefetch() noexcept {
+            ::flash::acr::get() = ::flash::acr::get() | prften;
+        }
+
+        static void disable_prefetch() noexcept {
+            ::flash::acr::get() = ::flash::acr::get() & ~prften;
+        }
+
+        static void enable_icache() noexcept {
+            enable(icen);
+        }
+
+        static void disable_icache() noexcept {
+            ::flash::acr::get() = ::flash::acr::get() & ~icen;
+        }
+
+        static void enable_dcache() noexcept {
+            enable(dcen);
+        }
+
+        static void disable_dcache() noexcept {
+            ::flash::acr::get() = ::flash::acr::get() & ~dcen;
+        }
+
+        /// Drop cached lines of both caches, enabled caches come back on
+        static void reset_caches() noexcept {
+            const lp::u32_t enabled = ::flash::acr::get() & (icen | dcen);
+
+            ::flash::acr::get() = ::flash::acr::get() & ~enabled;
+            reset(icen | dcen);
+            ::flash::acr::get() = ::flash::acr::get() | enabled;
+        }
+
+        /// Keeps the caches off while flash is erased or programmed and
+        /// resets them before they are enabled again on exit, so no stale
+        /// line of the changed area is read back
+        struct write_guard {
+            write_guard() noexcept : saved(::flash::acr::get() & (icen | dcen)) {
+                ::flash::acr::get() = ::flash::acr::get() & ~saved;
+            }
+
+            ~write_guard() noexcept {
+                if (saved) {
+                    reset(saved);
+                    ::flash::acr::get() = ::flash::acr::get() | saved;
+                }
+            }
+
+            write_guard(const write_guard &) = delete;
+            write_guard &operator=(const write_guard &) = delete;
+
+        private:
+            const lp::u32_t saved;
+        };
+
+    private:
+        static constexpr lp::u32_t prften = ::flash::acr_prften::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t icen = ::flash::acr_icen::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dcen = ::flash::acr_dcen::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t icrst = ::flash::acr_icrst::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dcrst = ::flash::acr_dcrst::mask<lp::u32_t>::value;
+
+        static void enable(lp::u32_t cache) noexcept {
+            if (!(::flash::acr::get() & cache)) {
+                reset(cache);
+                ::flash::acr::get() = ::flash::acr::get() | cache;
+            }
+        }
+
+        /// Pulse reset of disabled caches, icen/dcen masks select them
+        static void reset(lp::u32_t caches) noexcept {
+            const lp::u32_t bits = (caches & icen ? icrst : 0) | (caches & dcen ? dcrst : 0);
+
+            ::flash::acr::get() = ::flash::acr::get() | bits;
+            ::flash::acr::get() = ::flash::acr::get() & ~bits;
+        }
+    };
+}
+
+#endif // HAL_FLASH_ACCEL_HH
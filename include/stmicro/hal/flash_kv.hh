@@ -0,0 +1,630 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for log structured flash key/value store
+ * @file flash_kv.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <dwt.hh>
+
+#include <hal/crc.hh>
+#include <hal/flash.hh>
+#include <hal/flash_device.hh>
+
+#ifndef HAL_FLASH_KV_HH
+#define HAL_FLASH_KV_HH
+
+namespace hal {
+    enum class kv_status {
+        ok,
+        /// Key never written or removed
+        missing,
+        /// Value longer than the store or the caller buffer takes
+        too_large,
+        /// No index slot or flash space left after garbage collection
+        full,
+        /// Flash operation failed, see flash::errors()
+        failed
+    };
+
+    /// Key/value store over Pages flash pages from Begin. Every update
+    /// appends a record, the newest record of a key wins, so a write costs
+    /// one to Max_value / 8 + 1 double word programs instead of a page
+    /// erase. A ram hash index of Max_keys slots maps keys to their newest
+    /// record and is rebuilt by one scan of the region in start().
+    ///
+    /// Page layout, all double word aligned:
+    ///
+    ///     magic, wear          written right after erase
+    ///     sequence, ~sequence  written when the page is opened for writes
+    ///     key | size << 16, crc, value...   records
+    ///
+    /// When no page has room the oldest page is collected: its live
+    /// records are copied to the spare page, then it is erased (the slow
+    /// path, about 25 ms). A collection cut short by a reset leaves no
+    /// free page, start() finishes it. New pages are taken by lowest wear
+    /// count, so erases spread over the region, a page whose format was
+    /// cut short takes the highest count found. Record crc is computed by
+    /// the crc unit (crc32_mpeg2) over the key word and value words.
+    ///
+    /// Records of more keys than Max_keys (a store written with a larger
+    /// index) cannot be indexed, start() reports full then and pages
+    /// holding them are never collected, so they are not lost.
+    /// hal::flash_update::begin() mass erases the upper bank, a store
+    /// there does not survive an update.
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys = 64, lp::u32_t Max_value = 128>
+    struct flash_kv {
+        static constexpr lp::u16_t no_key = 0xffff;
+
+        static_assert(Pages >= 2, "Store needs a spare page for garbage collection");
+        static_assert(Begin >= flash_device::base && (Begin - flash_device::base) % flash_device::page_size == 0,
+            "Store must begin at a flash page");
+        static_assert(Begin + Pages * flash_device::page_size <= flash_device::base + flash_device::size,
+            "Store must end inside main flash");
+        static_assert(Max_keys >= 2 && (Max_keys & (Max_keys - 1)) == 0,
+            "Index size must be a power of two");
+
+        /// Store figures, cycles are dwt cyccnt
+        struct statistics {
+            lp::u32_t writes;
+            lp::u32_t collections;
+            lp::u32_t erases;
+            lp::u32_t corrupted;
+            /// Valid records left out of a full index by start()
+            lp::u32_t unindexed;
+            lp::u32_t worst_write_cycles;
+            lp::u32_t boot_cycles;
+        };
+
+        /// Unlock flash, format unused pages, rebuild the index and finish a
+        /// collection a reset interrupted. Full when records did not fit
+        /// the index, the keys that did are usable.
+        static kv_status start() noexcept {
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+
+            crc_unit::enable();
+            flash::unlock();
+            stats = {0, 0, 0, 0, 0, 0, 0};
+
+            for (auto &entry : index) {
+                entry = {no_key, 0};
+            }
+
+            const kv_status formatted = scan_pages();
+
+            if (formatted != kv_status::ok) {
+                return formatted;
+            }
+
+            rebuild();
+
+            if (stats.unindexed) {
+                stats.boot_cycles = ::dwt::cyccnt::get() - begin;
+                return kv_status::full;
+            }
+
+            // copies of the oldest page are in the spare one, its erase
+            // never happened: collect again, only records left behind move
+            if (free_pages() == 0) {
+                const kv_status collected = collect();
+
+                if (collected != kv_status::ok) {
+                    return collected;
+                }
+            }
+
+            stats.boot_cycles = ::dwt::cyccnt::get() - begin;
+
+            return kv_status::ok;
+        }
+
+        static kv_status set(lp::u16_t key, const void *data, lp::u32_t size) noexcept {
+            if (key == no_key) {
+                return kv_status::missing;
+            }
+
+            if (size > Max_value) {
+                return kv_status::too_large;
+            }
+
+            entry *const known = find(key, false);
+            entry *const slot = known ? known : find(key, true);
+
+            if (!slot) {
+                return kv_status::full;
+            }
+
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            record buffer;
+            const lp::u32_t total = build(buffer, key, static_cast<lp::u16_t>(size), data);
+            const kv_status status = write(buffer, total, slot);
+
+            // a new key gives its slot back, nothing was inserted behind it
+            if (status != kv_status::ok && !known) {
+                slot->key = no_key;
+            }
+
+            account(begin);
+
+            return status;
+        }
+
+        /// Copy the value of key into data, size is set to its length
+        static kv_status get(lp::u16_t key, void *data, lp::u32_t capacity, lp::u32_t &size) noexcept {
+            const entry *const slot = find(key, false);
+
+            if (!slot || !slot->address) {
+                return kv_status::missing;
+            }
+
+            const lp::u32_t length = read_word(slot->address) >> 16;
+
+            if (length > capacity) {
+                return kv_status::too_large;
+            }
+
+            __builtin_memcpy(data, reinterpret_cast<const void *>(slot->address + 8), length);
+            size = length;
+
+            return kv_status::ok;
+        }
+
+        static bool contains(lp::u16_t key) noexcept {
+            const entry *const slot = find(key, false);
+
+            return slot && slot->address;
+        }
+
+        /// Append a tombstone, the key slot stays taken in the index
+        static kv_status remove(lp::u16_t key) noexcept {
+            entry *const slot = find(key, false);
+
+            if (!slot || !slot->address) {
+                return kv_status::missing;
+            }
+
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            record buffer;
+            const lp::u32_t total = build(buffer, key, tombstone, nullptr);
+            const kv_status status = write(buffer, total, slot);
+
+            account(begin);
+
+            return status;
+        }
+
+        /// Erase count of a store page
+        static lp::u32_t wear(lp::u32_t page) noexcept {
+            return pages[page].wear;
+        }
+
+        static statistics report() noexcept {
+            return stats;
+        }
+
+    private:
+        static constexpr lp::u32_t magic = 0x4b565031;
+        static constexpr lp::u32_t header_size = 16;
+        static constexpr lp::u16_t tombstone = 0xfffe;
+        static constexpr lp::u32_t no_page = ~0u;
+
+        static_assert(Max_value < tombstone && header_size + 8 + Max_value <= flash_device::page_size,
+            "Largest record must fit a page");
+
+        using crc_unit = hal::crc<crc32_mpeg2>;
+
+        struct entry {
+            lp::u16_t key;
+            /// Newest record, 0 after remove
+            lp::addr_t address;
+        };
+
+        struct page_info {
+            lp::u32_t wear;
+            /// Zero for a free page
+            lp::u32_t sequence;
+            /// Valid records without an index slot
+            lp::u32_t unindexed;
+        };
+
+        struct record {
+            lp::u32_t words[2 + (Max_value + 7) / 8 * 2];
+        };
+
+        static lp::addr_t page_address(lp::u32_t page) noexcept {
+            return Begin + page * flash_device::page_size;
+        }
+
+        static lp::u32_t read_word(lp::addr_t address) noexcept {
+            return *reinterpret_cast<const volatile lp::u32_t *>(address);
+        }
+
+        static lp::u32_t record_size(lp::u32_t length) noexcept {
+            return 8 + (length == tombstone ? 0 : (length + 7) / 8 * 8);
+        }
+
+        /// Record crc skips its own word, the key word and value follow it
+        static lp::u32_t record_crc(const lp::u32_t *words, lp::u32_t total) noexcept {
+            crc_unit::begin();
+            crc_unit::feed(words, sizeof(lp::u32_t));
+            crc_unit::feed(words + 2, total - 8);
+
+            return crc_unit::value();
+        }
+
+        static lp::u32_t build(record &buffer, lp::u16_t key, lp::u16_t length, const void *data) noexcept {
+            const lp::u32_t total = record_size(length);
+
+            __builtin_memset(buffer.words, 0xff, total);
+            buffer.words[0] = key | static_cast<lp::u32_t>(length) << 16;
+
+            if (data) {
+                __builtin_memcpy(&buffer.words[2], data, length);
+            }
+
+            buffer.words[1] = record_crc(buffer.words, total);
+
+            return total;
+        }
+
+        /// Open addressing with linear probing, insert takes the first
+        /// empty slot of a new key
+        static entry *find(lp::u16_t key, bool insert) noexcept {
+            lp::u32_t position = (key * 0x9e37u >> 4) & (Max_keys - 1);
+
+            for (lp::u32_t probe = 0; probe < Max_keys; ++probe) {
+                entry &slot = index[position];
+
+                if (slot.key == key) {
+                    return &slot;
+                }
+
+                if (slot.key == no_key) {
+                    if (!insert) {
+                        return nullptr;
+                    }
+
+                    slot.key = key;
+                    slot.address = 0;
+
+                    return &slot;
+                }
+
+                position = (position + 1) & (Max_keys - 1);
+            }
+
+            return nullptr;
+        }
+
+        static kv_status flash_error(flash_status status) noexcept {
+            return status == flash_status::ok ? kv_status::ok : kv_status::failed;
+        }
+
+        /// Erase page and write magic with the new wear count
+        static kv_status format(lp::u32_t page) noexcept {
+            const lp::addr_t address = page_address(page);
+            const lp::u32_t wear = pages[page].wear + 1;
+            flash_status status = flash::erase_page(address);
+
+            ++stats.erases;
+
+            if (status == flash_status::ok) {
+                status = flash::program(address, magic | static_cast<lp::u64_t>(wear) << 32);
+            }
+
+            pages[page] = {wear, 0, 0};
+
+            return flash_error(status);
+        }
+
+        /// Read page headers, pages without a valid header are formatted.
+        /// One without magic lost its wear count in an interrupted format,
+        /// it takes the highest count of the others.
+        static kv_status scan_pages() noexcept {
+            lp::u32_t highest = 0;
+
+            active = no_page;
+            used = 0;
+            next_sequence = 1;
+
+            for (lp::u32_t page = 0; page < Pages; ++page) {
+                const lp::addr_t address = page_address(page);
+                const bool marked = read_word(address) == magic;
+
+                pages[page] = {marked ? read_word(address + 4) : 0, 0, 0};
+
+                if (marked && pages[page].wear > highest) {
+                    highest = pages[page].wear;
+                }
+            }
+
+            for (lp::u32_t page = 0; page < Pages; ++page) {
+                const lp::addr_t address = page_address(page);
+                const lp::u32_t sequence = read_word(address + 8);
+                const bool marked = read_word(address) == magic;
+                const bool opened = sequence == ~read_word(address + 12);
+
+                if (!marked || (!opened && sequence != ~0u)) {
+                    if (!marked) {
+                        pages[page].wear = highest;
+                    }
+
+                    const kv_status status = format(page);
+
+                    if (status != kv_status::ok) {
+                        return status;
+                    }
+
+                    continue;
+                }
+
+                if (opened) {
+                    pages[page].sequence = sequence;
+
+                    if (sequence >= next_sequence) {
+                        next_sequence = sequence + 1;
+                        active = page;
+                    }
+                }
+            }
+
+            return kv_status::ok;
+        }
+
+        /// Replay pages oldest first, the write position ends behind the
+        /// last record of the newest page
+        static void rebuild() noexcept {
+            lp::u32_t last = 0;
+
+            for (;;) {
+                lp::u32_t page = no_page;
+
+                for (lp::u32_t i = 0; i < Pages; ++i) {
+                    if (pages[i].sequence > last &&
+                        (page == no_page || pages[i].sequence < pages[page].sequence)) {
+                        page = i;
+                    }
+                }
+
+                if (page == no_page) {
+                    break;
+                }
+
+                last = pages[page].sequence;
+                used = replay(page);
+            }
+        }
+
+        static lp::u32_t replay(lp::u32_t page) noexcept {
+            const lp::addr_t address = page_address(page);
+            lp::u32_t offset = header_size;
+
+            while (offset + 8 <= flash_device::page_size) {
+                const lp::u32_t *words = reinterpret_cast<const lp::u32_t *>(address + offset);
+                const lp::u32_t key_word = words[0];
+                const lp::u32_t length = key_word >> 16;
+
+                if (key_word == ~0u) {
+                    break;
+                }
+
+                // damaged header, nothing behind it can be located
+                if ((length > Max_value && length != tombstone) ||
+                    offset + record_size(length) > flash_device::page_size) {
+                    ++stats.corrupted;
+                    return flash_device::page_size;
+                }
+
+                const lp::u32_t total = record_size(length);
+
+                if (record_crc(words, total) == words[1]) {
+                    entry *const slot = find(key_word & 0xffff, length != tombstone);
+
+                    if (slot) {
+                        slot->address = length == tombstone ? 0 : address + offset;
+                    } else if (length != tombstone) {
+                        ++pages[page].unindexed;
+                        ++stats.unindexed;
+                    }
+                } else {
+                    ++stats.corrupted;
+                }
+
+                offset += total;
+            }
+
+            return offset;
+        }
+
+        static lp::u32_t free_pages() noexcept {
+            lp::u32_t count = 0;
+
+            for (const auto &info : pages) {
+                count += info.sequence == 0;
+            }
+
+            return count;
+        }
+
+        /// Least worn free page becomes the write page
+        static kv_status open_page() noexcept {
+            lp::u32_t page = no_page;
+
+            for (lp::u32_t i = 0; i < Pages; ++i) {
+                if (pages[i].sequence == 0 && (page == no_page || pages[i].wear < pages[page].wear)) {
+                    page = i;
+                }
+            }
+
+            const lp::u32_t sequence = next_sequence++;
+            const flash_status status = flash::program(page_address(page) + 8,
+                sequence | static_cast<lp::u64_t>(~sequence) << 32);
+
+            pages[page].sequence = sequence;
+            active = page;
+            used = header_size;
+
+            return flash_error(status);
+        }
+
+        /// Room for total bytes in the write page, the last free page is
+        /// kept for garbage collection copies
+        static kv_status reserve(lp::u32_t total) noexcept {
+            for (lp::u32_t attempt = 0; attempt <= Pages; ++attempt) {
+                if (active != no_page && used + total <= flash_device::page_size) {
+                    return kv_status::ok;
+                }
+
+                active = no_page;
+
+                const lp::u32_t spare = free_pages();
+
+                if (spare > 1 || (collecting && spare > 0)) {
+                    const kv_status status = open_page();
+
+                    if (status != kv_status::ok) {
+                        return status;
+                    }
+                } else if (collecting || spare == 0) {
+                    return kv_status::full;
+                } else {
+                    const kv_status status = collect();
+
+                    if (status != kv_status::ok) {
+                        return status;
+                    }
+                }
+            }
+
+            return kv_status::full;
+        }
+
+        static kv_status write(const record &buffer, lp::u32_t total, entry *slot) noexcept {
+            const kv_status room = reserve(total);
+
+            if (room != kv_status::ok) {
+                return room;
+            }
+
+            const lp::addr_t address = page_address(active) + used;
+            const flash_status status = flash::program(address, buffer.words, total);
+
+            used += total;
+
+            if (status != flash_status::ok) {
+                return kv_status::failed;
+            }
+
+            slot->address = buffer.words[0] >> 16 == tombstone ? 0 : address;
+
+            return kv_status::ok;
+        }
+
+        /// Move live records of the oldest page to the spare one, then
+        /// erase it. Tombstones are dropped, no older record is left. Full
+        /// when the page holds records the index has no slot for.
+        static kv_status collect() noexcept {
+            lp::u32_t victim = no_page;
+
+            for (lp::u32_t i = 0; i < Pages; ++i) {
+                if (pages[i].sequence && (victim == no_page || pages[i].sequence < pages[victim].sequence)) {
+                    victim = i;
+                }
+            }
+
+            if (victim == no_page || pages[victim].unindexed) {
+                return kv_status::full;
+            }
+
+            const lp::addr_t address = page_address(victim);
+            kv_status status = kv_status::ok;
+
+            ++stats.collections;
+            collecting = true;
+
+            for (lp::u32_t offset = header_size; offset + 8 <= flash_device::page_size; ) {
+                const lp::u32_t key_word = read_word(address + offset);
+                const lp::u32_t length = key_word >> 16;
+
+                if (key_word == ~0u || (length > Max_value && length != tombstone)) {
+                    break;
+                }
+
+                const lp::u32_t total = record_size(length);
+                entry *const slot = find(key_word & 0xffff, false);
+
+                if (slot && slot->address == address + offset) {
+                    record buffer;
+
+                    __builtin_memcpy(buffer.words, reinterpret_cast<const void *>(address + offset), total);
+                    status = write(buffer, total, slot);
+
+                    if (status != kv_status::ok) {
+                        break;
+                    }
+                }
+
+                offset += total;
+            }
+
+            collecting = false;
+
+            return status == kv_status::ok ? format(victim) : status;
+        }
+
+        static void account(lp::u32_t begin) noexcept {
+            const lp::u32_t spent = ::dwt::cyccnt::get() - begin;
+
+            ++stats.writes;
+
+            if (spent > stats.worst_write_cycles) {
+                stats.worst_write_cycles = spent;
+            }
+        }
+
+        static entry index[Max_keys];
+        static page_info pages[Pages];
+        static lp::u32_t active;
+        static lp::u32_t used;
+        static lp::u32_t next_sequence;
+        static bool collecting;
+        static statistics stats;
+    };
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    typename flash_kv<Begin, Pages, Max_keys, Max_value>::entry flash_kv<Begin, Pages, Max_keys, Max_value>::index[Max_keys];
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    typename flash_kv<Begin, Pages, Max_keys, Max_value>::page_info flash_kv<Begin, Pages, Max_keys, Max_value>::pages[Pages];
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    lp::u32_t flash_kv<Begin, Pages, Max_keys, Max_value>::active = ~0u;
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    lp::u32_t flash_kv<Begin, Pages, Max_keys, Max_value>::used = 0;
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    lp::u32_t flash_kv<Begin, Pages, Max_keys, Max_value>::next_sequence = 1;
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    bool flash_kv<Begin, Pages, Max_keys, Max_value>::collecting = false;
+
+    template <lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Max_keys, lp::u32_t Max_value>
+    typename flash_kv<Begin, Pages, Max_keys, Max_value>::statistics flash_kv<Begin, Pages, Max_keys, Max_value>::stats;
+}
+
+#endif // HAL_FLASH_KV_HH
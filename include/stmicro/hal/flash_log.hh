@@ -0,0 +1,371 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for read while write flash logging
+ * @file flash_log.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <dwt.hh>
+
+#include <hal/flash.hh>
+#include <hal/flash_device.hh>
+#include <hal/ring_buffer.hh>
+
+#ifndef HAL_FLASH_LOG_HH
+#define HAL_FLASH_LOG_HH
+
+namespace hal {
+    /// Circular log of fixed size records in Pages flash pages from Begin.
+    /// The region must sit in the bank code does not run from, so erase
+    /// and programming never stall instruction fetch (read while write),
+    /// start() refuses a region in the code bank.
+    ///
+    /// append() only queues a record in ram and is safe from one interrupt
+    /// or thread context, poll() from the main loop moves queued records to
+    /// flash. The page after the write page is always kept erased: when
+    /// writing enters a page the next one is erased in the background
+    /// through hal::flash irq, records queue meanwhile. Queue_records has
+    /// to cover the append rate times a page erase (about 25 ms). A failed
+    /// erase is retried from poll(), writing stops before it leaves the
+    /// page until the next one is erased. hal::flash_update::begin() mass
+    /// erases the upper bank, a log there does not survive an update.
+    ///
+    ///     using log = hal::flash_log<sample, 0x08080000, 64>;
+    ///
+    ///     log::start();
+    ///     log::append(value);      // control loop, isr
+    ///     log::poll();             // main loop
+    ///
+    /// isr::FLASH must call hal::flash::irq_handler(). A record reading as
+    /// all ones can not be told apart from free space.
+    template <typename Record, lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Queue_records = 32>
+    struct flash_log {
+        static constexpr lp::u32_t record_size = sizeof(Record);
+        static constexpr lp::u32_t records_per_page = flash_device::page_size / record_size;
+        static constexpr lp::u32_t capacity = (Pages - 1) * records_per_page;
+
+        static_assert(record_size % flash_device::double_word_size == 0,
+            "Record size must be a multiple of a flash double word");
+        static_assert(flash_device::page_size % record_size == 0,
+            "Records must fill a flash page exactly");
+        static_assert(Pages >= 2, "Log needs a write page and an erased one");
+        static_assert(Begin >= flash_device::base && (Begin - flash_device::base) % flash_device::page_size == 0,
+            "Log must begin at a flash page");
+        static_assert((Begin - flash_device::base) / flash_device::bank_size ==
+            (Begin - flash_device::base + Pages * flash_device::page_size - 1) / flash_device::bank_size,
+            "Log must stay inside one bank");
+
+        /// Append and poll figures, cycles are dwt cyccnt
+        struct statistics {
+            lp::u32_t appended;
+            lp::u32_t written;
+            lp::u32_t dropped;
+            lp::u32_t failed;
+            lp::u32_t erases;
+            lp::u32_t max_queued;
+            lp::u32_t worst_append_cycles;
+            lp::u32_t worst_poll_cycles;
+        };
+
+        /// Unlock flash, find the write position left by the previous run
+        /// and make sure the next page is erased (blocking at this point)
+        static flash_status start() noexcept {
+            if (in_code_bank()) {
+                return flash_status::address;
+            }
+
+            flash::unlock();
+
+            const flash_status found = recover();
+
+            if (found != flash_status::ok) {
+                return found;
+            }
+
+            reset_statistics();
+
+            const flash_status status = erased_page(next_page(head)) ? flash_status::ok :
+                flash::erase_page(next_page(head));
+
+            __atomic_store_n(&ready, status == flash_status::ok, __ATOMIC_RELEASE);
+
+            return status;
+        }
+
+        /// Queue a record, bounded time, false when the queue is full
+        static bool append(const Record &record) noexcept {
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            const bool queued = queue.push(record);
+            const lp::u32_t size = queue.size();
+
+            if (queued) {
+                ++stats.appended;
+            } else {
+                ++stats.dropped;
+            }
+
+            if (size > stats.max_queued) {
+                stats.max_queued = size;
+            }
+
+            const lp::u32_t spent = ::dwt::cyccnt::get() - begin;
+
+            if (spent > stats.worst_append_cycles) {
+                stats.worst_append_cycles = spent;
+            }
+
+            return queued;
+        }
+
+        /// Program up to budget queued records, stops at the end of a page
+        /// while its successor is erased or failed to erase, a failed erase
+        /// starts again here. Returns the records written.
+        static lp::u32_t poll(lp::u32_t budget = ~0u) noexcept {
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            lp::u32_t count = 0;
+            Record record;
+
+            if (!__atomic_load_n(&ready, __ATOMIC_ACQUIRE) && !__atomic_load_n(&erasing, __ATOMIC_ACQUIRE)) {
+                if (erased_page(next_page(head))) {
+                    __atomic_store_n(&ready, true, __ATOMIC_RELEASE);
+                } else {
+                    erase_ahead();
+                }
+            }
+
+            while (count < budget && !__atomic_load_n(&erasing, __ATOMIC_ACQUIRE) &&
+                (!last_slot(head) || __atomic_load_n(&ready, __ATOMIC_ACQUIRE)) && queue.pop(record)) {
+                if (flash::program(head, &record, record_size) == flash_status::ok) {
+                    ++stats.written;
+                } else {
+                    count_failure();
+                }
+
+                ++count;
+                head += record_size;
+
+                if (head == end) {
+                    head = Begin;
+                }
+
+                if ((head - Begin) % flash_device::page_size == 0) {
+                    __atomic_store_n(&ready, false, __ATOMIC_RELEASE);
+                    erase_ahead();
+                }
+            }
+
+            const lp::u32_t spent = ::dwt::cyccnt::get() - begin;
+
+            if (spent > stats.worst_poll_cycles) {
+                stats.worst_poll_cycles = spent;
+            }
+
+            return count;
+        }
+
+        /// Records waiting in ram
+        static lp::u32_t pending() noexcept {
+            return queue.size();
+        }
+
+        /// Background erase in progress, appends only queue
+        static bool erase_running() noexcept {
+            return __atomic_load_n(&erasing, __ATOMIC_ACQUIRE);
+        }
+
+        /// Flash address the next record goes to
+        static lp::addr_t position() noexcept {
+            return head;
+        }
+
+        /// Call fn(const Record &) for records in flash, oldest first
+        template <typename Visitor>
+        static void replay(Visitor fn) noexcept {
+            // oldest data follows the erased page after the write page
+            const lp::addr_t first = next_page(next_page(head));
+
+            for (lp::addr_t slot = first; slot != head; ) {
+                if (!erased(slot)) {
+                    Record record;
+
+                    __builtin_memcpy(&record, reinterpret_cast<const void *>(slot), record_size);
+                    fn(record);
+                }
+
+                slot += record_size;
+
+                if (slot == end) {
+                    slot = Begin;
+                }
+            }
+        }
+
+        static statistics report() noexcept {
+            return stats;
+        }
+
+        static void reset_statistics() noexcept {
+            stats = {0, 0, 0, 0, 0, 0, 0, 0};
+        }
+
+    private:
+        static constexpr lp::addr_t end = Begin + Pages * flash_device::page_size;
+
+        /// Region and code in the same half of the address space, the
+        /// bank swap moves both so it does not matter here
+        static bool in_code_bank() noexcept {
+            const lp::addr_t code = reinterpret_cast<lp::addr_t>(&poll);
+
+            if (code < flash_device::base || code >= flash_device::base + flash_device::size) {
+                return false;
+            }
+
+            return (code - flash_device::base) / flash_device::bank_size ==
+                (Begin - flash_device::base) / flash_device::bank_size;
+        }
+
+        static lp::addr_t page_of(lp::addr_t address) noexcept {
+            return address - (address - Begin) % flash_device::page_size;
+        }
+
+        static lp::addr_t next_page(lp::addr_t address) noexcept {
+            const lp::addr_t next = page_of(address) + flash_device::page_size;
+
+            return next == end ? Begin : next;
+        }
+
+        /// Writing slot moves head into the next page
+        static bool last_slot(lp::addr_t slot) noexcept {
+            return (slot - Begin) % flash_device::page_size == flash_device::page_size - record_size;
+        }
+
+        static bool erased(lp::addr_t slot) noexcept {
+            const volatile lp::u32_t *words = reinterpret_cast<const volatile lp::u32_t *>(slot);
+
+            for (lp::u32_t i = 0; i < record_size / sizeof(lp::u32_t); ++i) {
+                if (words[i] != ~0u) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        static bool erased_page(lp::addr_t page) noexcept {
+            for (lp::u32_t i = 0; i < records_per_page; ++i) {
+                if (!erased(page + i * record_size)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /// Write page is the used page followed by one with a free first
+        /// slot, an all free log starts at Begin, a log without any free
+        /// page (first use of the region) is erased from its first page
+        static flash_status recover() noexcept {
+            lp::addr_t used = 0;
+            bool any_used = false;
+
+            for (lp::addr_t page = Begin; page != end; page += flash_device::page_size) {
+                if (erased(page)) {
+                    continue;
+                }
+
+                any_used = true;
+
+                if (erased(next_page(page))) {
+                    used = page;
+                    break;
+                }
+            }
+
+            head = Begin;
+
+            if (!any_used) {
+                return flash_status::ok;
+            }
+
+            if (!used) {
+                return flash::erase(Begin, flash_device::page_size);
+            }
+
+            head = used;
+
+            while (head != used + flash_device::page_size && !erased(head)) {
+                head += record_size;
+            }
+
+            if (head == end) {
+                head = Begin;
+            }
+
+            return flash_status::ok;
+        }
+
+        /// Failures count from poll() and the flash irq alike
+        static void count_failure() noexcept {
+            __atomic_fetch_add(&stats.failed, 1, __ATOMIC_RELAXED);
+        }
+
+        static void erase_ahead() noexcept {
+            __atomic_store_n(&erasing, true, __ATOMIC_RELEASE);
+
+            if (flash::erase_page_async(next_page(head), erase_done) != flash_status::ok) {
+                __atomic_store_n(&erasing, false, __ATOMIC_RELEASE);
+                count_failure();
+            }
+        }
+
+        static void erase_done(flash_status status) noexcept {
+            if (status == flash_status::ok) {
+                ++stats.erases;
+                __atomic_store_n(&ready, true, __ATOMIC_RELEASE);
+            } else {
+                count_failure();
+            }
+
+            __atomic_store_n(&erasing, false, __ATOMIC_RELEASE);
+        }
+
+        static ring_buffer<Record, Queue_records> queue;
+        static lp::addr_t head;
+        static bool erasing;
+        /// Page after the write page is erased
+        static bool ready;
+        static statistics stats;
+    };
+
+    template <typename Record, lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Queue_records>
+    ring_buffer<Record, Queue_records> flash_log<Record, Begin, Pages, Queue_records>::queue;
+
+    template <typename Record, lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Queue_records>
+    lp::addr_t flash_log<Record, Begin, Pages, Queue_records>::head = Begin;
+
+    template <typename Record, lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Queue_records>
+    bool flash_log<Record, Begin, Pages, Queue_records>::erasing = false;
+
+    template <typename Record, lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Queue_records>
+    bool flash_log<Record, Begin, Pages, Queue_records>::ready = false;
+
+    template <typename Record, lp::addr_t Begin, lp::u32_t Pages, lp::u32_t Queue_records>
+    typename flash_log<Record, Begin, Pages, Queue_records>::statistics
+        flash_log<Record, Begin, Pages, Queue_records>::stats;
+}
+
+#endif // HAL_FLASH_LOG_HH
@@ -0,0 +1,299 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for dual bank firmware update
+ * @file flash_update.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <dwt.hh>
+#include <flash.hh>
+
+#include <hal/crc.hh>
+#include <hal/flash.hh>
+#include <hal/flash_device.hh>
+
+#ifndef HAL_FLASH_UPDATE_HH
+#define HAL_FLASH_UPDATE_HH
+
+namespace hal {
+    /// Streaming firmware update into the bank code does not run from,
+    /// which is always the upper half of the address space (0x08080000):
+    ///
+    ///     hal::flash_update::begin(size);
+    ///     while (receiving) {
+    ///         hal::flash_update::write(chunk, length);
+    ///     }
+    ///     if (hal::flash_update::finish(crc) == hal::flash_status::ok) {
+    ///         hal::flash_update::activate();    // does not return
+    ///     }
+    ///
+    /// Chunks of any length are gathered into 256 byte rows written in
+    /// fast programming mode, which only programs a mass erased bank, so
+    /// begin() erases the whole update bank up front (tens of ms) whatever
+    /// the image size. Code keeps running from the other bank meanwhile,
+    /// only the row program itself masks interrupts. Every row is read back
+    /// from flash into the crc unit (crc32_mpeg2 over 32-bit little endian
+    /// words, image padded with 0xff to a whole word), so finish() checks
+    /// what really landed in flash.
+    ///
+    /// activate() flips optr bfb2 to boot the new bank and reloads option
+    /// bytes, which resets the device. The banks are swapped in the memory
+    /// map at boot, so the image is linked for 0x08000000 as usual and no
+    /// copy step is needed. Needs optr dualbank set (1 MB parts default).
+    struct flash_update {
+        /// Flash share of the update time, both in dwt cycles
+        struct statistics {
+            lp::u32_t bytes;
+            lp::u64_t flash_cycles;
+            lp::u64_t total_cycles;
+        };
+
+        /// First address of the update bank
+        static constexpr lp::addr_t target = flash_device::base + flash_device::bank_size;
+
+        /// Mass erase the update bank and open an image of size bytes, a
+        /// verified image there is gone even when the erase fails. So is
+        /// everything else from target up, a hal::flash_log or
+        /// hal::flash_kv kept in that bank is wiped with it.
+        static flash_status begin(lp::u32_t size) noexcept {
+            if (!(::flash::optr::get() & dualbank) || size == 0 || size > flash_device::bank_size) {
+                return flash_status::address;
+            }
+
+            crc_unit::enable();
+            flash::unlock();
+
+            if (flash::locked()) {
+                return flash_status::locked;
+            }
+
+            state &current = context();
+            const lp::u32_t started = ::dwt::cyccnt::get();
+            const flash_status erased = flash::erase_bank(target);
+
+            current.open = false;
+            current.verified = false;
+
+            if (erased != flash_status::ok) {
+                return erased;
+            }
+
+            current.size = size;
+            current.received = 0;
+            current.filled = 0;
+            current.next = target;
+            current.crc = ~0u;
+            current.stats = {0, ::dwt::cyccnt::get() - started, 0};
+            current.started = started;
+            current.open = true;
+
+            return flash_status::ok;
+        }
+
+        /// Append the next chunk, address status when it runs past the
+        /// size given to begin()
+        static flash_status write(const void *data, lp::u32_t size) noexcept {
+            state &current = context();
+
+            if (!current.open) {
+                return flash_status::locked;
+            }
+
+            if (size > current.size - current.received) {
+                return flash_status::address;
+            }
+
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+
+            current.received += size;
+            current.stats.bytes = current.received;
+
+            while (size) {
+                const lp::u32_t room = flash_device::row_size - current.filled;
+                const lp::u32_t part = size < room ? size : room;
+
+                __builtin_memcpy(current.row + current.filled, bytes, part);
+                current.filled += part;
+                bytes += part;
+                size -= part;
+
+                if (current.filled == flash_device::row_size) {
+                    const flash_status status = flush();
+
+                    if (status != flash_status::ok) {
+                        current.open = false;
+                        return status;
+                    }
+                }
+            }
+
+            return flash_status::ok;
+        }
+
+        /// Program the last partial row and compare the image crc, failed
+        /// on mismatch or when fewer bytes than announced arrived
+        static flash_status finish(lp::u32_t expected_crc) noexcept {
+            state &current = context();
+
+            if (!current.open) {
+                return flash_status::locked;
+            }
+
+            current.open = false;
+
+            if (current.received != current.size) {
+                return flash_status::address;
+            }
+
+            if (current.filled) {
+                const flash_status status = flush();
+
+                if (status != flash_status::ok) {
+                    return status;
+                }
+            }
+
+            current.stats.total_cycles += ::dwt::cyccnt::get() - current.started;
+            current.verified = current.crc == expected_crc;
+
+            return current.verified ? flash_status::ok : flash_status::failed;
+        }
+
+        /// Crc of the image programmed so far
+        static lp::u32_t crc() noexcept {
+            return context().crc;
+        }
+
+        /// Boot the updated bank, only after finish() verified the image.
+        /// Returns only on failure, option bytes stay as they were.
+        static flash_status activate() noexcept {
+            if (!context().verified) {
+                return flash_status::failed;
+            }
+
+            flash::unlock();
+
+            if (::flash::cr::get() & optlock) {
+                ::flash::optkeyr::get() = flash_device::optkey1;
+                ::flash::optkeyr::get() = flash_device::optkey2;
+            }
+
+            if (::flash::cr::get() & optlock) {
+                return flash_status::locked;
+            }
+
+            while (flash::busy()) {
+            }
+
+            // bank 2 in erase numbering is the one mapped at target now
+            const lp::u32_t boot_second = flash::bank(target);
+
+            ::flash::optr::get() = (::flash::optr::get() & ~bfb2) | (boot_second ? bfb2 : 0);
+            ::flash::cr::get() = ::flash::cr::get() | optstrt;
+
+            while (flash::busy()) {
+            }
+
+            if (::flash::sr::get() & error_mask) {
+                const lp::u32_t errors = ::flash::sr::get() & error_mask;
+
+                ::flash::sr::get() = errors;
+                ::flash::cr::get() = ::flash::cr::get() | optlock;
+
+                return flash_status::failed;
+            }
+
+            // option byte reload resets the device
+            ::flash::cr::get() = ::flash::cr::get() | obl_launch;
+
+            return flash_status::ok;
+        }
+
+        static statistics report() noexcept {
+            return context().stats;
+        }
+
+    private:
+        static constexpr lp::u32_t dualbank = ::flash::optr_dualbank::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t bfb2 = ::flash::optr_bfb2::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t optlock = ::flash::cr_optlock::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t optstrt = ::flash::cr_optstrt::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t obl_launch = ::flash::cr_obl_launch::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t error_mask =
+            ::flash::sr_operr::mask<lp::u32_t>::value |
+            ::flash::sr_progerr::mask<lp::u32_t>::value |
+            ::flash::sr_wrperr::mask<lp::u32_t>::value |
+            ::flash::sr_optverr::mask<lp::u32_t>::value;
+
+        using crc_unit = hal::crc<crc32_mpeg2>;
+
+        struct state {
+            alignas(4) lp::u8_t row[flash_device::row_size];
+            lp::u32_t filled;
+            lp::addr_t next;
+            lp::u32_t size;
+            lp::u32_t received;
+            lp::u32_t crc;
+            lp::u32_t started;
+            statistics stats;
+            bool open;
+            bool verified;
+        };
+
+        /// Header only driver state, zero initialized
+        static state &context() noexcept {
+            static state value;
+            return value;
+        }
+
+        /// Program the row padded with 0xff into the erased bank and run
+        /// the programmed image words through the crc unit
+        static flash_status flush() noexcept {
+            state &current = context();
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+
+            __builtin_memset(current.row + current.filled, 0xff, flash_device::row_size - current.filled);
+
+            const flash_status status = flash::program_row(current.next, current.row);
+
+            if (status == flash_status::ok) {
+                const lp::u32_t offset = current.next - target;
+                const lp::u32_t left = (current.size - offset + 3) / 4;
+                const lp::u32_t words = left < flash_device::row_size / 4 ? left : flash_device::row_size / 4;
+
+                current.crc = checksum(current.crc, current.next, words);
+            }
+
+            current.next += flash_device::row_size;
+            current.filled = 0;
+            current.stats.flash_cycles += ::dwt::cyccnt::get() - begin;
+
+            return status;
+        }
+
+        /// Continue a crc from previous, crc32_mpeg2 has no final xor or
+        /// output reversal to undo
+        static lp::u32_t checksum(lp::u32_t previous, lp::addr_t address, lp::u32_t count) noexcept {
+            crc_unit::begin(previous);
+            crc_unit::feed(reinterpret_cast<const void *>(address), count * sizeof(lp::u32_t));
+
+            return crc_unit::value();
+        }
+    };
+}
+
+#endif // HAL_FLASH_UPDATE_HH
@@ -52,6 +52,11 @@ namespace hal {
             _reserved = 0b11
         };
 
+        enum struct otype : lp::u32_t {
+            push_pull = 0b0,
+            open_drain = 0b1
+        };
+
         enum struct alt : lp::u32_t {
             af0 = 0,
             af1 = 1,
@@ -87,6 +92,23 @@ namespace hal {
         using p13 = lp::bit<13>;
         using p14 = lp::bit<14>;
         using p15 = lp::bit<15>;
+
+        /// Device alternate function as pin_config argument
+        static constexpr alt from(device::alt alt_func) noexcept {
+            return static_cast<alt>(alt_func);
+        }
+    };
+
+    /// Full pin setup applied by gpio::configure
+    template <pins::mode Mode, pins::speed Speed = pins::speed::very_low,
+        pins::pull Pull = pins::pull::none, pins::otype Otype = pins::otype::push_pull,
+        pins::alt Alt = pins::alt::af0>
+    struct pin_config {
+        static constexpr pins::mode mode = Mode;
+        static constexpr pins::speed speed = Speed;
+        static constexpr pins::pull pull = Pull;
+        static constexpr pins::otype otype = Otype;
+        static constexpr pins::alt alt = Alt;
     };
 
     template <typename Gpio_block>
@@ -160,9 +182,76 @@ namespace hal {
             block::brr::template set_or<Pins...>();
         }
 
+        /// Apply mode, speed, pull, output type and alternate function at
+        /// once: every register is read and written exactly once with
+        /// masks merged at compile time. Moder is written last, so a pin
+        /// only starts driving once its output type, speed, pull and
+        /// alternate function are in place. Alternate function registers
+        /// are only touched for alt_func mode.
+        template <typename Config, typename ...Pins>
+        static constexpr void configure() noexcept {
+            constexpr lp::u32_t pin_mask = mask_of<Pins...>();
+            constexpr lp::u32_t low = pin_mask & 0xff;
+            constexpr lp::u32_t high = pin_mask >> 8;
+            constexpr lp::u32_t field2 = spread(pin_mask, 2, 0b11);
+            constexpr lp::u32_t mode = spread(pin_mask, 2, static_cast<lp::u32_t>(Config::mode));
+            constexpr lp::u32_t otype = Config::otype == pins::otype::open_drain ? pin_mask : 0;
+            constexpr lp::u32_t speed = spread(pin_mask, 2, static_cast<lp::u32_t>(Config::speed));
+            constexpr lp::u32_t pull = spread(pin_mask, 2, static_cast<lp::u32_t>(Config::pull));
+            constexpr bool alt_func = Config::mode == pins::mode::alt_func;
+            constexpr lp::u32_t alt = static_cast<lp::u32_t>(Config::alt);
+
+            static_assert(pin_mask != 0, "Configure needs at least one pin");
+
+            update<typename block::otyper, pin_mask, otype>();
+            update<typename block::ospeedr, field2, speed>();
+            update<typename block::pupdr, field2, pull>();
+
+            if (alt_func && low) {
+                update<typename block::afrl, spread(low, 4, 0xf), spread(low, 4, alt)>();
+            }
+
+            if (alt_func && high) {
+                update<typename block::afrh, spread(high, 4, 0xf), spread(high, 4, alt)>();
+            }
+
+            update<typename block::moder, field2, mode>();
+        }
+
     private:
         using afr64 = lp::io_register<lp::u64_t, block::afrl::address>;
 
+        template <typename ...Pins>
+        static constexpr lp::u32_t mask_of() noexcept {
+            const lp::u32_t positions[] = {0, (1u << Pins::position)...};
+            lp::u32_t mask = 0;
+
+            for (auto position : positions) {
+                mask |= position;
+            }
+
+            return mask;
+        }
+
+        /// Repeat field value for every pin of mask, fields are width bits
+        static constexpr lp::u32_t spread(lp::u32_t mask, lp::u32_t width,
+                lp::u32_t value) noexcept {
+            lp::u32_t result = 0;
+
+            for (lp::u32_t pin = 0; mask; ++pin, mask >>= 1) {
+                if (mask & 1) {
+                    result |= value << (pin * width);
+                }
+            }
+
+            return result;
+        }
+
+        template <typename GpioRegister, lp::u32_t clear, lp::u32_t value>
+        static constexpr void update() noexcept {
+            GpioRegister::get() = (GpioRegister::get() & ~clear) | value;
+        }
+
         template <typename GpioRegister, lp::u32_t value, lp::u32_t shift, typename ...Pins>
         static constexpr void set_value() noexcept {
             GpioRegister::template set_nand<
@@ -0,0 +1,444 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for hash processor
+ * @file hash.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+#include <type_list.hh>
+
+#include <dwt.hh>
+#include <hash.hh>
+#include <rcc.hh>
+
+#include <hal/dma_device.hh>
+#include <hal/dma_type.hh>
+
+#ifndef HAL_HASH_HH
+#define HAL_HASH_HH
+
+namespace hal {
+    /// Values are cr algo1:algo0
+    enum class hash_algorithm : lp::u32_t {
+        sha1 = 0b00,
+        md5 = 0b01,
+        sha224 = 0b10,
+        sha256 = 0b11
+    };
+
+    /// One digest in progress. Bytes short of a whole 64 byte block wait
+    /// here, so the unit only ever holds whole blocks and its context can
+    /// be swapped out between calls. HMAC keeps the key pointer for the
+    /// outer pass, the key has to stay valid until finish(). A failed dma
+    /// transfer loses the digest, it takes init() again.
+    struct hash_context {
+        /// cr, str, imr, then csr0..csr53
+        lp::u32_t saved[3 + 54];
+        lp::u8_t pending[64];
+        lp::u32_t pending_size;
+        const lp::u8_t *key;
+        lp::u32_t key_size;
+        hash_algorithm algorithm;
+        bool hmac;
+        bool started;
+        bool failed;
+    };
+
+    /// Hash processor shared by any number of hash_context digests. When
+    /// update() or finish() gets a digest other than the one in the unit,
+    /// the unit context (csr registers, 38 words or 54 for HMAC) is saved
+    /// to the old digest and restored from the new one, so long messages
+    /// interleave without waiting for each other.
+    ///
+    ///     hal::hash_context image;
+    ///     using unit = hal::hash<>;
+    ///
+    ///     unit::enable();
+    ///     unit::init(image, hal::hash_algorithm::sha256);
+    ///     unit::update(image, chunk, size);
+    ///     unit::finish(image, digest);
+    ///
+    /// update_dma() feeds the whole blocks of a chunk through In_dma with
+    /// cr mdmat set, so a message can span any number of transfers, and
+    /// ends in dma_irq_handler() (isr of the In_dma channel). The last
+    /// partial word is fed by the core in finish() with str nblw set.
+    /// After a transfer error the digest refuses update() and finish()
+    /// until it is initialized again.
+    template <typename In_dma = dma_device::hash_in>
+    struct hash {
+        using in_channel = In_dma;
+        using dma_channels = lp::type_list<in_channel>;
+        using done_hook = void (*)(bool ok);
+
+        static constexpr lp::u32_t block_size = 64;
+        static constexpr lp::u32_t max_digest_size = 32;
+
+        /// Bytes and dwt cycles of all updates, dma ones included
+        struct meter {
+            lp::u64_t bytes;
+            lp::u64_t cycles;
+        };
+
+        static void enable() noexcept {
+            ::rcc::ahb2enr::get() = ::rcc::ahb2enr::get() | hash1en;
+
+            // read back so the clock is running before the first access
+            const lp::u32_t enabled = ::rcc::ahb2enr::get();
+            (void)enabled;
+        }
+
+        static constexpr lp::u32_t digest_size(hash_algorithm algorithm) noexcept {
+            return algorithm == hash_algorithm::md5 ? 16 :
+                algorithm == hash_algorithm::sha1 ? 20 :
+                algorithm == hash_algorithm::sha224 ? 28 : 32;
+        }
+
+        static void init(hash_context &context, hash_algorithm algorithm) noexcept {
+            setup(context, algorithm, false, nullptr, 0);
+        }
+
+        static void init_hmac(hash_context &context, hash_algorithm algorithm, const lp::u8_t *key,
+                lp::u32_t key_size) noexcept {
+            setup(context, algorithm, true, key, key_size);
+        }
+
+        /// False while a dma update holds the unit or after a failed one
+        static bool update(hash_context &context, const void *data, lp::u32_t size) noexcept {
+            if (busy || context.failed) {
+                return false;
+            }
+
+            const lp::u32_t begin = ::dwt::cyccnt::get();
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+
+            stats.bytes += size;
+
+            while (size) {
+                const lp::u32_t room = block_size - context.pending_size;
+                const lp::u32_t part = size < room ? size : room;
+
+                __builtin_memcpy(context.pending + context.pending_size, bytes, part);
+                context.pending_size += part;
+                bytes += part;
+                size -= part;
+
+                if (context.pending_size == block_size) {
+                    select(context);
+                    write(context.pending, block_size);
+                    context.pending_size = 0;
+                }
+            }
+
+            stats.cycles += ::dwt::cyccnt::get() - begin;
+
+            return true;
+        }
+
+        /// Start feeding the whole blocks of data by dma, data must be
+        /// word aligned and untouched until done is called. The remaining
+        /// bytes are kept by the digest. False while another transfer runs,
+        /// with bytes of an earlier update still waiting or after a failed
+        /// transfer.
+        static bool update_dma(hash_context &context, const void *data, lp::u32_t size,
+                done_hook done) noexcept {
+            const lp::u32_t blocks = size / block_size;
+
+            if (busy || context.failed || context.pending_size || (reinterpret_cast<lp::addr_t>(data) & 3) ||
+                blocks * block_size / 4 > 0xffff) {
+                return false;
+            }
+
+            const lp::u8_t *bytes = static_cast<const lp::u8_t *>(data);
+
+            __builtin_memcpy(context.pending, bytes + blocks * block_size, size - blocks * block_size);
+            context.pending_size = size - blocks * block_size;
+            stats.bytes += size;
+
+            if (!blocks) {
+                if (done) {
+                    done(true);
+                }
+
+                return true;
+            }
+
+            select(context);
+
+            busy = true;
+            callback = done;
+            dma_started = ::dwt::cyccnt::get();
+
+            ::hash::cr::get() = ::hash::cr::get() | mdmat | dmae;
+            in_channel::select_request();
+            in_channel::template mem_to_periph<
+                dma_config::complete_int,
+                dma_config::error_int,
+                dma_config::periph_size<dma_config::width::word>,
+                dma_config::memory_size<dma_config::width::word>
+            >(::hash::din::address, data, blocks * block_size / 4);
+
+            return true;
+        }
+
+        static bool dma_busy() noexcept {
+            return busy;
+        }
+
+        static void dma_irq_handler() noexcept {
+            const lp::u32_t status = in_channel::take_flags();
+
+            if (!(status & (in_channel::flags::complete | in_channel::flags::error))) {
+                return;
+            }
+
+            in_channel::stop();
+            ::hash::cr::get() = ::hash::cr::get() & ~dmae;
+
+            const bool ok = !(status & in_channel::flags::error);
+
+            // unit state is unknown after a failed transfer and the saved
+            // one misses the blocks already taken, the digest is lost
+            if (!ok && active) {
+                active->started = false;
+                active->failed = true;
+                active->pending_size = 0;
+                active = nullptr;
+            }
+
+            stats.cycles += ::dwt::cyccnt::get() - dma_started;
+
+            const done_hook done = callback;
+
+            busy = false;
+            callback = nullptr;
+
+            if (done) {
+                done(ok);
+            }
+        }
+
+        /// Feed the rest, compute and store the digest, returns its size
+        /// or 0 while a dma update holds the unit or after a failed one.
+        /// The context is free for init() afterwards.
+        static lp::u32_t finish(hash_context &context, lp::u8_t *digest) noexcept {
+            if (busy || context.failed) {
+                return 0;
+            }
+
+            select(context);
+            ::hash::cr::get() = ::hash::cr::get() & ~mdmat;
+            last(context.pending, context.pending_size);
+
+            if (context.hmac) {
+                wait_ready();
+                last(context.key, context.key_size);
+            }
+
+            while (!(::hash::sr::get() & dcis)) {
+            }
+
+            const lp::u32_t size = digest_size(context.algorithm);
+
+            for (lp::u32_t i = 0; i < size / 4; ++i) {
+                const lp::u32_t word = __builtin_bswap32(result(i));
+
+                __builtin_memcpy(digest + i * 4, &word, sizeof(word));
+            }
+
+            context.started = false;
+            context.pending_size = 0;
+            active = nullptr;
+
+            return size;
+        }
+
+        static meter measured() noexcept {
+            return stats;
+        }
+
+        static void reset_meter() noexcept {
+            stats = {0, 0};
+        }
+
+        /// Throughput for core running at Core_hz, MB/s is this / 10^6
+        template <lp::u32_t Core_hz>
+        static lp::u32_t bytes_per_second() noexcept {
+            return stats.cycles ? static_cast<lp::u32_t>(stats.bytes * Core_hz / stats.cycles) : 0;
+        }
+
+    private:
+        static constexpr lp::u32_t hash1en = ::rcc::ahb2enr_hash1en::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t init_bit = ::hash::cr_init::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dmae = ::hash::cr_dmae::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mode_hmac = ::hash::cr_mode::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t algo0 = ::hash::cr_algo0::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t algo1 = ::hash::cr_algo1::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mdmat = ::hash::cr_mdmat::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lkey = ::hash::cr_lkey::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t byte_swap = 0b10u << ::hash::cr_datatype::position;
+        static constexpr lp::u32_t dcal = ::hash::str_dcal::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t busy_bit = ::hash::sr_busy::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dinis = ::hash::sr_dinis::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t dcis = ::hash::sr_dcis::mask<lp::u32_t>::value;
+        static constexpr lp::u32_t hash_registers = 38;
+        static constexpr lp::u32_t hmac_registers = 54;
+
+        static void setup(hash_context &context, hash_algorithm algorithm, bool hmac, const lp::u8_t *key,
+                lp::u32_t key_size) noexcept {
+            context.algorithm = algorithm;
+            context.hmac = hmac;
+            context.key = key;
+            context.key_size = key_size;
+            context.pending_size = 0;
+            context.started = false;
+            context.failed = false;
+
+            if (active == &context) {
+                active = nullptr;
+            }
+        }
+
+        static volatile lp::u32_t *context_registers() noexcept {
+            return reinterpret_cast<volatile lp::u32_t *>(::hash::csr0::address);
+        }
+
+        static lp::u32_t result(lp::u32_t index) noexcept {
+            return reinterpret_cast<volatile lp::u32_t *>(::hash::hash_hr0::address)[index];
+        }
+
+        /// Unit idle with an empty input fifo, the point where its context
+        /// can be saved and the next pass can start
+        static void wait_ready() noexcept {
+            while ((::hash::sr::get() & (busy_bit | dinis)) != dinis) {
+            }
+        }
+
+        /// Move the unit to context, saving the digest it holds
+        static void select(hash_context &context) noexcept {
+            if (active == &context) {
+                return;
+            }
+
+            if (active) {
+                save(*active);
+            }
+
+            if (context.started) {
+                restore(context);
+            } else {
+                start(context);
+            }
+
+            active = &context;
+        }
+
+        static void save(hash_context &context) noexcept {
+            const lp::u32_t count = context.hmac ? hmac_registers : hash_registers;
+            volatile lp::u32_t *registers = context_registers();
+
+            wait_ready();
+            context.saved[0] = ::hash::cr::get();
+            context.saved[1] = ::hash::str::get();
+            context.saved[2] = ::hash::imr::get();
+
+            for (lp::u32_t i = 0; i < count; ++i) {
+                context.saved[3 + i] = registers[i];
+            }
+        }
+
+        static void restore(hash_context &context) noexcept {
+            const lp::u32_t count = context.hmac ? hmac_registers : hash_registers;
+            volatile lp::u32_t *registers = context_registers();
+
+            ::hash::imr::get() = context.saved[2];
+            ::hash::str::get() = context.saved[1];
+            ::hash::cr::get() = context.saved[0];
+            ::hash::cr::get() = context.saved[0] | init_bit;
+
+            for (lp::u32_t i = 0; i < count; ++i) {
+                registers[i] = context.saved[3 + i];
+            }
+        }
+
+        /// Fresh digest, HMAC runs the inner key pass right away
+        static void start(hash_context &context) noexcept {
+            const lp::u32_t algorithm = static_cast<lp::u32_t>(context.algorithm);
+            const lp::u32_t control = byte_swap | (algorithm & 1 ? algo0 : 0) | (algorithm & 2 ? algo1 : 0) |
+                (context.hmac ? mode_hmac : 0) | (context.hmac && context.key_size > block_size ? lkey : 0);
+
+            ::hash::imr::get() = 0;
+            ::hash::cr::get() = control | init_bit;
+            context.started = true;
+
+            if (context.hmac) {
+                last(context.key, context.key_size);
+                wait_ready();
+            }
+        }
+
+        /// Whole words to din, size is a multiple of 4
+        static void write(const lp::u8_t *bytes, lp::u32_t size) noexcept {
+            for (lp::u32_t offset = 0; offset < size; offset += 4) {
+                lp::u32_t word;
+
+                __builtin_memcpy(&word, bytes + offset, sizeof(word));
+                ::hash::din::get() = word;
+            }
+        }
+
+        /// Final data of a pass: valid bits of the last word go to str
+        /// nblw first, the partial word is padded, then dcal starts it
+        static void last(const lp::u8_t *bytes, lp::u32_t size) noexcept {
+            const lp::u32_t whole = size / 4 * 4;
+            const lp::u32_t nblw = (size % 4) * 8;
+
+            ::hash::str::get() = nblw;
+            write(bytes, whole);
+
+            if (nblw) {
+                lp::u32_t word = 0;
+
+                __builtin_memcpy(&word, bytes + whole, size - whole);
+                ::hash::din::get() = word;
+            }
+
+            ::hash::str::get() = nblw | dcal;
+        }
+
+        static hash_context *active;
+        static done_hook callback;
+        static lp::u32_t dma_started;
+        static bool busy;
+        static meter stats;
+    };
+
+    template <typename In_dma>
+    hash_context *hash<In_dma>::active = nullptr;
+
+    template <typename In_dma>
+    typename hash<In_dma>::done_hook hash<In_dma>::callback = nullptr;
+
+    template <typename In_dma>
+    lp::u32_t hash<In_dma>::dma_started = 0;
+
+    template <typename In_dma>
+    bool hash<In_dma>::busy = false;
+
+    template <typename In_dma>
+    typename hash<In_dma>::meter hash<In_dma>::stats;
+}
+
+#endif // HAL_HASH_HH
@@ -0,0 +1,86 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for ram vector table
+ * @file irq.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <cpu.hh>
+#include <isr_ram.hh>
+#include <scb.hh>
+
+#include <hal/isr_irq.hh>
+
+#ifndef HAL_IRQ_HH
+#define HAL_IRQ_HH
+
+namespace hal {
+    /// Vector table in sram2. Sram2 sits in the code region, so vector
+    /// fetch keeps the code bus but loses flash wait states. Installed
+    /// handlers are called straight from the table, there is no
+    /// trampoline in between.
+    struct irq {
+        using handler = void (*)();
+
+        /// Copy active vector table into ram and switch vtor to it
+        static void relocate() noexcept {
+            const auto *source = reinterpret_cast<const volatile handler *>(
+                static_cast<lp::addr_t>(scb::vtor::get()));
+
+            for (lp::u32_t i = 0; i < isr::ram_vectors_count; ++i) {
+                ram_vectors_table[i] = source[i];
+            }
+
+            cpu::data_sync_barrier();
+            scb::vtor::get() = table_address();
+            cpu::data_sync_barrier();
+            cpu::instruction_sync_barrier();
+        }
+
+        static bool relocated() noexcept {
+            return scb::vtor::get() == table_address();
+        }
+
+        /// Replace handler of device interrupt, takes effect on the next
+        /// exception entry, table must be relocated first
+        template <irq_dev_num_t irq_n>
+        static void install(handler function) noexcept {
+            ram_vectors_table[index<irq_n>()] = function;
+            cpu::data_sync_barrier();
+        }
+
+        template <irq_dev_num_t irq_n>
+        static handler installed() noexcept {
+            return ram_vectors_table[index<irq_n>()];
+        }
+
+    private:
+        template <irq_dev_num_t irq_n>
+        static constexpr lp::u32_t index() noexcept {
+            static_assert(isr::core_vectors_count + static_cast<lp::u32_t>(irq_n) <
+                isr::ram_vectors_count, "Interrupt is out of vector table");
+
+            return isr::core_vectors_count + static_cast<lp::u32_t>(irq_n);
+        }
+
+        static lp::u32_t table_address() noexcept {
+            return static_cast<lp::u32_t>(reinterpret_cast<lp::addr_t>(ram_vectors_table));
+        }
+    };
+}
+
+#endif // HAL_IRQ_HH
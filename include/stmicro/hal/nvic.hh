@@ -17,6 +17,8 @@
  * @author Boris Vinogradov
  */
 
+#include <scb.hh>
+
 #include <hal/isr_irq.hh>
 #include <hal/nvic_device.hh>
 
@@ -24,6 +26,30 @@
 #define HAL_NVIC_HH
 
 namespace hal {
+    /// Interrupt setup entry for nvic::configure, priority is the logical
+    /// level in implemented bits, 0 is the most urgent
+    template <irq_dev_num_t Irq, lp::u32_t Priority, bool Enabled = true>
+    struct irq_cfg {
+        static constexpr lp::u32_t irq = static_cast<lp::u32_t>(Irq);
+        static constexpr lp::u32_t priority = Priority;
+        static constexpr bool enabled = Enabled;
+
+        static_assert(Priority < (1u << nvic_device::priority_bits),
+            "Interrupt priority does not fit implemented priority bits");
+        static_assert(irq < nvic_device::ipr_count * 4,
+            "Interrupt has no priority register");
+
+        /// Priority byte in its ipr word
+        static constexpr lp::u32_t ipr_word = irq >> 2;
+        static constexpr lp::u32_t ipr_mask = 0xffu << ((irq & 0x3) * 8);
+        static constexpr lp::u32_t ipr_value =
+            (Priority << (8 - nvic_device::priority_bits)) << ((irq & 0x3) * 8);
+
+        /// Enable bit in its iser/icer word
+        static constexpr lp::u32_t enable_word = irq >> 5;
+        static constexpr lp::u32_t enable_mask = 1u << (irq & 0x1f);
+    };
+
     struct nvic {
         template <irq_dev_num_t irq_n>
         static constexpr void enable_irq() noexcept {
@@ -81,7 +107,7 @@ namespace hal {
             nvic_device::ipr::get<
                 (static_cast<lp::word_t>(irq_n) >> 2)
                 >::template set_or<
-                    lp::bit<
+                    typename lp::bit<
                         (static_cast<lp::word_t>(irq_n) & 0x3) * 8,
                         8
                     >::template with_value<priority>
@@ -99,6 +125,164 @@ namespace hal {
                     >
                 >();
         }
+
+        /// Split implemented priority bits into Group_bits preempting group
+        /// bits, the rest are subpriority bits which only order pending
+        /// interrupts of the same group
+        template <lp::u32_t Group_bits>
+        static void set_priority_grouping() noexcept {
+            static_assert(Group_bits <= nvic_device::priority_bits,
+                "Priority group does not fit implemented priority bits");
+
+            ::scb::aircr::get() = aircr_key | ((7 - Group_bits) << 8);
+        }
+
+        /// Number of preempting group bits in implemented priority bits
+        static lp::u32_t priority_grouping() noexcept {
+            const lp::u32_t group = 7 - ((::scb::aircr::get() >> 8) & 0x7);
+
+            return group < nvic_device::priority_bits ? group : nvic_device::priority_bits;
+        }
+
+        /// Apply a whole interrupt table: disables go out first, then every
+        /// touched ipr word is written once with all its priorities merged,
+        /// then one iser store per word enables the interrupts. An ipr word
+        /// fully covered by the table is stored without reading it back.
+        template <typename ...Configs>
+        static void configure() noexcept {
+            static_assert(unique<Configs...>(), "Interrupt is configured more than once");
+
+            const int disables[] = {0, (enable_setup<Configs,
+                first_of_word<Configs, enable_word_of, Configs...>(), false, Configs...>::apply(), 0)...};
+            const int priorities[] = {0, (priority_setup<Configs,
+                first_of_word<Configs, ipr_word_of, Configs...>(), Configs...>::apply(), 0)...};
+            const int enables[] = {0, (enable_setup<Configs,
+                first_of_word<Configs, enable_word_of, Configs...>(), true, Configs...>::apply(), 0)...};
+
+            (void)disables;
+            (void)priorities;
+            (void)enables;
+        }
+
+    private:
+        static constexpr lp::u32_t aircr_key = 0x05fau << 16;
+
+        template <typename ...Configs>
+        static constexpr bool unique() noexcept {
+            const lp::u32_t irqs[] = {Configs::irq...};
+
+            for (lp::u32_t i = 0; i < sizeof...(Configs); ++i) {
+                for (lp::u32_t j = i + 1; j < sizeof...(Configs); ++j) {
+                    if (irqs[i] == irqs[j]) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        template <typename Config>
+        struct ipr_word_of {
+            static constexpr lp::u32_t value = Config::ipr_word;
+        };
+
+        template <typename Config>
+        struct enable_word_of {
+            static constexpr lp::u32_t value = Config::enable_word;
+        };
+
+        /// Register word is written by the first entry which lands in it
+        template <typename Config, template <typename> class Word, typename ...Configs>
+        static constexpr bool first_of_word() noexcept {
+            const lp::u32_t words[] = {Word<Configs>::value...};
+            const lp::u32_t irqs[] = {Configs::irq...};
+
+            for (lp::u32_t i = 0; i < sizeof...(Configs); ++i) {
+                if (words[i] == Word<Config>::value) {
+                    return irqs[i] == Config::irq;
+                }
+            }
+
+            return false;
+        }
+
+        template <lp::u32_t Word, typename ...Configs>
+        static constexpr lp::u32_t merge_ipr(bool mask) noexcept {
+            const lp::u32_t words[] = {Configs::ipr_word...};
+            const lp::u32_t masks[] = {Configs::ipr_mask...};
+            const lp::u32_t values[] = {Configs::ipr_value...};
+            lp::u32_t result = 0;
+
+            for (lp::u32_t i = 0; i < sizeof...(Configs); ++i) {
+                if (words[i] == Word) {
+                    result |= mask ? masks[i] : values[i];
+                }
+            }
+
+            return result;
+        }
+
+        template <lp::u32_t Word, bool Enabled, typename ...Configs>
+        static constexpr lp::u32_t merge_enable() noexcept {
+            const lp::u32_t words[] = {Configs::enable_word...};
+            const lp::u32_t masks[] = {Configs::enable_mask...};
+            const bool enabled[] = {Configs::enabled...};
+            lp::u32_t result = 0;
+
+            for (lp::u32_t i = 0; i < sizeof...(Configs); ++i) {
+                if (words[i] == Word && enabled[i] == Enabled) {
+                    result |= masks[i];
+                }
+            }
+
+            return result;
+        }
+
+        template <typename Config, bool First, typename ...Configs>
+        struct priority_setup {
+            static void apply() noexcept {
+            }
+        };
+
+        template <typename Config, typename ...Configs>
+        struct priority_setup<Config, true, Configs...> {
+            static void apply() noexcept {
+                using ipr = nvic_device::ipr::get<Config::ipr_word>;
+
+                constexpr lp::u32_t mask = merge_ipr<Config::ipr_word, Configs...>(true);
+                constexpr lp::u32_t value = merge_ipr<Config::ipr_word, Configs...>(false);
+
+                if (mask == 0xffffffff) {
+                    ipr::get() = value;
+                } else {
+                    ipr::get() = (ipr::get() & ~mask) | value;
+                }
+            }
+        };
+
+        template <typename Config, bool First, bool Enabled, typename ...Configs>
+        struct enable_setup {
+            static void apply() noexcept {
+            }
+        };
+
+        template <typename Config, bool Enabled, typename ...Configs>
+        struct enable_setup<Config, true, Enabled, Configs...> {
+            static void apply() noexcept {
+                // iser and icer ignore zero bits, no read back is needed
+                using reg = typename lp::type_list<
+                    nvic_device::icer::get<Config::enable_word>,
+                    nvic_device::iser::get<Config::enable_word>
+                >::template get<Enabled>;
+
+                constexpr lp::u32_t mask = merge_enable<Config::enable_word, Enabled, Configs...>();
+
+                if (mask != 0) {
+                    reg::get() = mask;
+                }
+            }
+        };
     };
 }
 
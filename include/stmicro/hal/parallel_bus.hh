@@ -0,0 +1,157 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for gpio parallel bus
+ * @file parallel_bus.hh
+ * @author Boris Vinogradov
+ */
+
+#include <type_list.hh>
+#include <types.hh>
+
+#include <hal/gpio.hh>
+
+#ifndef HAL_PARALLEL_BUS_HH
+#define HAL_PARALLEL_BUS_HH
+
+namespace hal {
+    /// Runtime value on a set of pins of one port, bit i of value drives
+    /// i-th pin of Pins. Every write is a single bsrr store which sets and
+    /// resets all lines at once. Ascending adjacent pins are written with
+    /// shift and mask, any other layout uses 16 entry lookup tables, one
+    /// per 4 value bits.
+    template <typename Port, typename ...Pins>
+    struct parallel_bus {
+        using port = Port;
+        using block = typename Port::block;
+
+        static constexpr lp::u32_t width = sizeof...(Pins);
+
+        static_assert(width > 0 && width <= 16, "Parallel bus has 1 to 16 pins");
+
+        static constexpr lp::u32_t pin_mask() noexcept {
+            const lp::u32_t positions[] = {Pins::position...};
+            lp::u32_t mask = 0;
+
+            for (auto position : positions) {
+                mask |= 1u << position;
+            }
+
+            return mask;
+        }
+
+        static_assert(__builtin_popcount(pin_mask()) == width, "Parallel bus pins must differ");
+
+        /// Pins follow each other in value bit order
+        static constexpr bool contiguous() noexcept {
+            const lp::u32_t positions[] = {Pins::position...};
+
+            for (lp::u32_t i = 1; i < width; ++i) {
+                if (positions[i] != positions[0] + i) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /// Port bits set for value, other bus pins are to be reset
+        static lp::u32_t scatter(lp::u32_t value) noexcept {
+            return layout<contiguous()>::scatter(value);
+        }
+
+        /// Bus value from port input bits
+        static lp::u32_t gather(lp::u32_t bits) noexcept {
+            return layout<contiguous()>::gather(bits);
+        }
+
+        static void write(lp::u32_t value) noexcept {
+            const lp::u32_t bits = scatter(value);
+
+            block::bsrr::get() = bits | ((bits ^ pin_mask()) << 16);
+        }
+
+        static lp::u32_t read() noexcept {
+            return gather(block::idr::get());
+        }
+
+    private:
+        static constexpr lp::u32_t first = lp::type_list<Pins...>::template get<0>::position;
+        static constexpr lp::u32_t value_mask = (1u << width) - 1;
+        static constexpr lp::u32_t nibbles = (width + 3) / 4;
+
+        struct nibble_tables {
+            lp::u32_t entry[nibbles][16];
+        };
+
+        static constexpr nibble_tables make_tables() noexcept {
+            const lp::u32_t positions[] = {Pins::position...};
+            nibble_tables tables = {};
+
+            for (lp::u32_t table = 0; table < nibbles; ++table) {
+                for (lp::u32_t nibble = 0; nibble < 16; ++nibble) {
+                    for (lp::u32_t bit = 0; bit < 4 && table * 4 + bit < width; ++bit) {
+                        if (nibble & (1u << bit)) {
+                            tables.entry[table][nibble] |= 1u << positions[table * 4 + bit];
+                        }
+                    }
+                }
+            }
+
+            return tables;
+        }
+
+        template <bool Contiguous, typename Dummy = void>
+        struct layout {
+            static lp::u32_t scatter(lp::u32_t value) noexcept {
+                lp::u32_t bits = 0;
+
+                for (lp::u32_t table = 0; table < nibbles; ++table) {
+                    bits |= tables.entry[table][(value >> (table * 4)) & 0xf];
+                }
+
+                return bits;
+            }
+
+            static lp::u32_t gather(lp::u32_t bits) noexcept {
+                const lp::u32_t positions[] = {Pins::position...};
+                lp::u32_t value = 0;
+
+                for (lp::u32_t i = 0; i < width; ++i) {
+                    value |= ((bits >> positions[i]) & 1) << i;
+                }
+
+                return value;
+            }
+        };
+
+        template <typename Dummy>
+        struct layout<true, Dummy> {
+            static lp::u32_t scatter(lp::u32_t value) noexcept {
+                return (value & value_mask) << first;
+            }
+
+            static lp::u32_t gather(lp::u32_t bits) noexcept {
+                return (bits >> first) & value_mask;
+            }
+        };
+
+        static constexpr nibble_tables tables = make_tables();
+    };
+
+    template <typename Port, typename ...Pins>
+    constexpr typename parallel_bus<Port, Pins...>::nibble_tables parallel_bus<Port, Pins...>::tables;
+}
+
+#endif // HAL_PARALLEL_BUS_HH
@@ -0,0 +1,132 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer helpers
+ * single producer single consumer ring buffer
+ * @file ring_buffer.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#ifndef HAL_RING_BUFFER_HH
+#define HAL_RING_BUFFER_HH
+
+namespace hal {
+    /// Lock-free ring buffer for one producer and one consumer context
+    /// (thread and interrupt handler). Indices run freely and wrap by mask.
+    template <typename T, lp::u32_t Capacity>
+    struct ring_buffer {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+            "Capacity must be a power of two");
+
+        static constexpr lp::u32_t capacity = Capacity;
+
+        lp::u32_t size() const noexcept {
+            return load(head) - load(tail);
+        }
+
+        lp::u32_t space() const noexcept {
+            return capacity - size();
+        }
+
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        bool full() const noexcept {
+            return size() == capacity;
+        }
+
+        bool push(const T &value) noexcept {
+            const lp::u32_t h = load_relaxed(head);
+
+            if (h - load(tail) == capacity) {
+                return false;
+            }
+
+            data[h & mask] = value;
+            store(head, h + 1);
+
+            return true;
+        }
+
+        bool pop(T &value) noexcept {
+            const lp::u32_t t = load_relaxed(tail);
+
+            if (load(head) == t) {
+                return false;
+            }
+
+            value = data[t & mask];
+            store(tail, t + 1);
+
+            return true;
+        }
+
+        lp::u32_t write(const T *values, lp::u32_t count) noexcept {
+            const lp::u32_t h = load_relaxed(head);
+            const lp::u32_t free = capacity - (h - load(tail));
+            const lp::u32_t n = count < free ? count : free;
+
+            for (lp::u32_t i = 0; i < n; ++i) {
+                data[(h + i) & mask] = values[i];
+            }
+
+            store(head, h + n);
+
+            return n;
+        }
+
+        lp::u32_t read(T *values, lp::u32_t count) noexcept {
+            const lp::u32_t t = load_relaxed(tail);
+            const lp::u32_t used = load(head) - t;
+            const lp::u32_t n = count < used ? count : used;
+
+            for (lp::u32_t i = 0; i < n; ++i) {
+                values[i] = data[(t + i) & mask];
+            }
+
+            store(tail, t + n);
+
+            return n;
+        }
+
+        /// Drop all content, only safe while the producer is stopped
+        void clear() noexcept {
+            store(tail, load(head));
+        }
+
+    private:
+        static constexpr lp::u32_t mask = Capacity - 1;
+
+        static lp::u32_t load(const lp::u32_t &index) noexcept {
+            return __atomic_load_n(&index, __ATOMIC_ACQUIRE);
+        }
+
+        static lp::u32_t load_relaxed(const lp::u32_t &index) noexcept {
+            return __atomic_load_n(&index, __ATOMIC_RELAXED);
+        }
+
+        static void store(lp::u32_t &index, lp::u32_t value) noexcept {
+            __atomic_store_n(&index, value, __ATOMIC_RELEASE);
+        }
+
+        T data[Capacity];
+        lp::u32_t head = 0;
+        lp::u32_t tail = 0;
+    };
+}
+
+#endif // HAL_RING_BUFFER_HH
@@ -0,0 +1,295 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for tickless idle
+ * @file tickless.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <cpu.hh>
+#include <dwt.hh>
+#include <exti.hh>
+#include <lptim.hh>
+#include <pwr.hh>
+#include <rcc.hh>
+#include <scb.hh>
+
+#include <hal/nvic.hh>
+
+#ifndef HAL_TICKLESS_HH
+#define HAL_TICKLESS_HH
+
+namespace hal {
+    using wake_hook = void (*)();
+
+    /// Wake hook for cores running from the clock Stop 2 wakes up on
+    inline void keep_clocks() noexcept {
+    }
+
+    /// Idle until a deadline of Clock (hal::clock) in Stop 2. LPTIM1 runs
+    /// free from LSE, its compare is set to the deadline and wakes the core
+    /// through exti line 32, then SysTick is restarted with the slept time
+    /// added, so the 64-bit system time keeps going. Short waits fall back
+    /// to Sleep with SysTick running.
+    ///
+    /// Core wakes on MSI (or HSI16 with rcc cfgr stopwuck), Restore is
+    /// called first thing after wake to bring back the clock tree Clock
+    /// was built for. isr::LPTIM1 must call irq_handler().
+    ///
+    ///     using sys = hal::clock<80000000>;
+    ///     using idle = hal::tickless_idle<sys, 32768, restore_pll>;
+    ///
+    ///     const bool stop2 = idle::start();
+    ///
+    ///     while (true) {
+    ///         cpu::disable_interrupts();
+    ///         if (!work_pending()) {
+    ///             if (stop2) {
+    ///                 idle::sleep_until(next_deadline());
+    ///             } else {
+    ///                 cpu::wait_interrupt();
+    ///             }
+    ///         }
+    ///         cpu::enable_interrupts();
+    ///         run_work();
+    ///     }
+    template <typename Clock, lp::u32_t Lse_hz = 32768, wake_hook Restore = keep_clocks>
+    struct tickless_idle {
+        using lptim = ::lptim1;
+
+        static constexpr irq_dev_num_t irq = irq_dev_num_t::LPTIM1;
+        /// Longest single Stop 2 period in LSE counts, compare stays clear
+        /// of the counter wrap
+        static constexpr lp::u32_t max_counts = 0xff00;
+        /// Below this the compare write (two to three LSE periods until
+        /// cmpok) and Stop 2 exit cost more than they save
+        static constexpr lp::u32_t min_counts = 8;
+        /// Clock cycles of a max_counts period
+        static constexpr lp::u64_t longest_span = static_cast<lp::u64_t>(max_counts) * Clock::core_hz / Lse_hz;
+        /// LSE startup bound, above the 2 s typical startup at four or
+        /// more core cycles per poll
+        static constexpr lp::u32_t lse_polls = Clock::core_hz / 2;
+        /// Bound of a LPTIM write synchronised to LSE, sixteen LSE periods
+        /// at one or more core cycles per poll
+        static constexpr lp::u32_t sync_polls = 16 * Clock::core_hz / Lse_hz;
+
+        /// Idle path figures, wake latency is in LSE counts between the
+        /// compare match and code running again (one LSE period
+        /// resolution), exit is in core cycles from wfi return until
+        /// clocks are restored and SysTick is running
+        struct statistics {
+            lp::u32_t stops;
+            lp::u32_t sleeps;
+            lp::u32_t worst_wake_counts;
+            lp::u32_t worst_exit_cycles;
+        };
+
+        /// LSE on, LPTIM1 free running on LSE, Stop 2 selected for deep
+        /// sleep. False when LSE or LPTIM1 does not come up within its
+        /// bound (missing crystal), sleep_until() must not be used then.
+        static bool start() noexcept {
+            ::rcc::apb1enr1::get() = ::rcc::apb1enr1::get() | pwren | lptim1en;
+
+            // read back so the clock is running before the first access
+            const lp::u32_t enabled = ::rcc::apb1enr1::get();
+            (void)enabled;
+
+            if (!(::rcc::bdcr::get() & lserdy)) {
+                ::pwr::cr1::get() = ::pwr::cr1::get() | dbp;
+                ::rcc::bdcr::get() = ::rcc::bdcr::get() | lseon;
+
+                if (!wait<::rcc::bdcr>(lserdy, lse_polls)) {
+                    return false;
+                }
+            }
+
+            ::rcc::ccipr::get() = (::rcc::ccipr::get() & ~lptim1sel) | lptim1sel_lse;
+            ::pwr::cr1::get() = (::pwr::cr1::get() & ~lpms) | lpms_stop2;
+
+            // interrupt enable is writable only while disabled
+            lptim::cr::get() = 0;
+            lptim::cfgr::get() = 0;
+            lptim::ier::get() = cmpmie;
+            lptim::cr::get() = enable;
+            lptim::arr::get() = 0xffff;
+
+            if (!wait<lptim::isr>(arrok, sync_polls)) {
+                lptim::cr::get() = 0;
+                return false;
+            }
+
+            lptim::icr::get() = arrokcf;
+            lptim::cr::get() = enable | cntstrt;
+
+            ::exti::imr2::get() = ::exti::imr2::get() | mr32;
+            nvic::template enable_irq<irq>();
+
+            reset_statistics();
+
+            return true;
+        }
+
+        /// Sleep until Clock::now() reaches deadline or any interrupt,
+        /// call with interrupts masked (primask), the interrupt that ended
+        /// the sleep runs once they are unmasked. Deadlines past max_counts
+        /// (~0 for no deadline) sleep max_counts and return.
+        static void sleep_until(lp::u64_t deadline) noexcept {
+            const lp::u64_t now = Clock::now();
+
+            if (deadline <= now) {
+                return;
+            }
+
+            // far deadlines (~0 to sleep until an interrupt) would overflow
+            // the conversion, longer waits are cut to max_counts anyway
+            const lp::u64_t span = deadline - now;
+            const lp::u64_t counts = span > longest_span ? max_counts : span * Lse_hz / Clock::core_hz;
+
+            if (counts < min_counts) {
+                ++stats.sleeps;
+                cpu::wait_interrupt();
+                return;
+            }
+
+            stop(counts > max_counts ? max_counts : static_cast<lp::u32_t>(counts));
+        }
+
+        static void irq_handler() noexcept {
+            lptim::icr::get() = cmpmcf;
+        }
+
+        static statistics report() noexcept {
+            return stats;
+        }
+
+        static void reset_statistics() noexcept {
+            stats = {0, 0, 0, 0};
+        }
+
+        /// Worst time from deadline to code running in core cycles
+        static lp::u32_t worst_wake_latency() noexcept {
+            return static_cast<lp::u32_t>(static_cast<lp::u64_t>(stats.worst_wake_counts) *
+                Clock::core_hz / Lse_hz) + stats.worst_exit_cycles;
+        }
+
+    private:
+        static constexpr lp::u32_t pwren = ::rcc::apb1enr1_pwren::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lptim1en = ::rcc::apb1enr1_lptim1en::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lserdy = ::rcc::bdcr_lserdy::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lseon = ::rcc::bdcr_lseon::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lptim1sel = ::rcc::ccipr_lptim1sel::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lptim1sel_lse = 3u << ::rcc::ccipr_lptim1sel::position;
+        static constexpr lp::u32_t dbp = ::pwr::cr1_dbp::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lpms = ::pwr::cr1_lpms::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t lpms_stop2 = 2u << ::pwr::cr1_lpms::position;
+        static constexpr lp::u32_t sleepdeep = ::scb::scr_sleepdeep::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t mr32 = ::exti::imr2_mr32::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t enable = lptim::cr_enable::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cntstrt = lptim::cr_cntstrt::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t arrok = lptim::isr_arrok::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cmpok = lptim::isr_cmpok::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t arrokcf = lptim::icr_arrokcf::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cmpokcf = lptim::icr_cmpokcf::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cmpmcf = lptim::icr_cmpmcf::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cmpmie = lptim::ier_cmpmie::template mask<lp::u32_t>::value;
+
+        /// Counter runs from asynchronous LSE, a read is valid once two
+        /// consecutive ones agree
+        static lp::u32_t counter() noexcept {
+            lp::u32_t value = lptim::cnt::get();
+            lp::u32_t check;
+
+            while ((check = lptim::cnt::get()) != value) {
+                value = check;
+            }
+
+            return value;
+        }
+
+        /// Poll until the mask bits are set, false after polls reads
+        template <typename Register>
+        static bool wait(lp::u32_t mask, lp::u32_t polls) noexcept {
+            for (; polls; --polls) {
+                if (Register::get() & mask) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /// Core cycles of the LSE counts since begin
+        static lp::u64_t elapsed(lp::u32_t begin) noexcept {
+            return static_cast<lp::u64_t>((counter() - begin) & 0xffff) * Clock::core_hz / Lse_hz;
+        }
+
+        static void stop(lp::u32_t counts) noexcept {
+            if (!Clock::halt()) {
+                Clock::resume(0);
+                return;
+            }
+
+            const lp::u32_t begin = counter();
+            const lp::u32_t match = (begin + counts) & 0xffff;
+
+            lptim::icr::get() = cmpmcf | cmpokcf;
+            lptim::cmp::get() = match;
+
+            // compare write took too long, the match may be already behind,
+            // SysTick was stopped meanwhile so the time spent is added
+            if (!wait<lptim::isr>(cmpok, sync_polls) || ((counter() - begin) & 0xffff) + 2 >= counts) {
+                Clock::resume(elapsed(begin));
+                return;
+            }
+
+            ::scb::scr::get() = ::scb::scr::get() | sleepdeep;
+            cpu::data_sync_barrier();
+            cpu::wait_interrupt();
+            const lp::u32_t woke = ::dwt::cyccnt::get();
+
+            ::scb::scr::get() = ::scb::scr::get() & ~sleepdeep;
+            Restore();
+
+            const lp::u32_t slept = (counter() - begin) & 0xffff;
+
+            Clock::resume(static_cast<lp::u64_t>(slept) * Clock::core_hz / Lse_hz);
+
+            const lp::u32_t exit = ::dwt::cyccnt::get() - woke;
+
+            ++stats.stops;
+
+            // woken by the compare, not by another interrupt
+            if (slept >= counts) {
+                const lp::u32_t late = slept - counts;
+
+                if (late > stats.worst_wake_counts) {
+                    stats.worst_wake_counts = late;
+                }
+            }
+
+            if (exit > stats.worst_exit_cycles) {
+                stats.worst_exit_cycles = exit;
+            }
+        }
+
+        static statistics stats;
+    };
+
+    template <typename Clock, lp::u32_t Lse_hz, wake_hook Restore>
+    typename tickless_idle<Clock, Lse_hz, Restore>::statistics tickless_idle<Clock, Lse_hz, Restore>::stats;
+}
+
+#endif // HAL_TICKLESS_HH
@@ -0,0 +1,355 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for software timers
+ * @file timer_service.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <cpu.hh>
+
+#include <hal/nvic.hh>
+#include <hal/tim.hh>
+
+#ifndef HAL_TIMER_SERVICE_HH
+#define HAL_TIMER_SERVICE_HH
+
+namespace hal {
+    /// One-shot and periodic software timers on a free running 32-bit
+    /// timer (tim2 or tim5). Deadlines sit in a binary min-heap, channel 1
+    /// compare is programmed for the earliest one only, so the timer
+    /// interrupt fires once per expiry instead of once per tick. Insert,
+    /// cancel and expiry are O(log n). Deadlines are 32-bit counter values
+    /// compared modulo 2^32, so a delay must stay below 2^31 ticks.
+    ///
+    /// irq_handler() must be called from the timer isr, callbacks run
+    /// there and may start or cancel timers. Other contexts mask the timer
+    /// interrupt in nvic while touching the queue.
+    template <typename Tim, lp::u32_t Capacity>
+    struct timer_service {
+        using timer = Tim;
+        using block = typename Tim::block;
+        using callback = void (*)(void *context);
+        using handle = lp::u32_t;
+
+        static constexpr irq_dev_num_t irq = tim_irq<Tim>::value;
+        static constexpr handle invalid = ~0u;
+        static constexpr lp::u32_t max_delay = 0x7fffffff;
+
+        static_assert(Capacity > 0 && Capacity < 0xffff, "Timer service capacity is 1 to 65534");
+
+        /// Run counter at Tick_hz from timer kernel clock Kernel_hz
+        template <lp::u32_t Kernel_hz, lp::u32_t Tick_hz>
+        static void start() noexcept {
+            static_assert(Kernel_hz % Tick_hz == 0, "Tick rate must divide timer clock");
+            static_assert(Kernel_hz / Tick_hz <= 0x10000, "Tick rate is below prescaler range");
+
+            clear();
+
+            block::cr1::get() = 0;
+            block::psc::get() = Kernel_hz / Tick_hz - 1;
+            block::arr::get() = 0xffffffff;
+            block::cnt::get() = 0;
+            // load prescaler now instead of on the first overflow
+            block::egr::get() = ug;
+            block::sr::get() = 0;
+            block::dier::get() = cc1ie;
+            block::cr1::get() = cen;
+
+            running = true;
+            nvic::template enable_irq<irq>();
+        }
+
+        static void stop() noexcept {
+            running = false;
+            nvic::template disable_irq<irq>();
+
+            block::cr1::get() = 0;
+            block::dier::get() = 0;
+        }
+
+        /// Current counter value, deadlines are on this time line
+        static lp::u32_t now() noexcept {
+            return block::cnt::get();
+        }
+
+        static handle start_once(lp::u32_t delay, callback function, void *context = nullptr) noexcept {
+            return add(delay, 0, function, context);
+        }
+
+        /// First expiry after period, following ones are period apart
+        /// without drift
+        static handle start_periodic(lp::u32_t period, callback function, void *context = nullptr) noexcept {
+            return period ? add(period, period, function, context) : invalid;
+        }
+
+        /// False when timer already expired or handle is stale
+        static bool cancel(handle id) noexcept {
+            mask();
+
+            const lp::u32_t slot = id & 0xffff;
+            const bool valid = slot < Capacity && entries[slot].position != free &&
+                entries[slot].generation == (id >> 16);
+
+            if (valid) {
+                remove(entries[slot].position);
+                release(slot);
+                arm();
+            }
+
+            unmask();
+
+            return valid;
+        }
+
+        static bool active(handle id) noexcept {
+            const lp::u32_t slot = id & 0xffff;
+
+            return slot < Capacity && entries[slot].position != free &&
+                entries[slot].generation == (id >> 16);
+        }
+
+        static lp::u32_t pending() noexcept {
+            return size;
+        }
+
+        static void irq_handler() noexcept {
+            if (!(block::sr::get() & cc1if)) {
+                return;
+            }
+
+            block::sr::get() = ~cc1if;
+
+            while (size) {
+                const lp::u32_t slot = heap[0];
+                entry &e = entries[slot];
+
+                if (before(now(), e.deadline)) {
+                    break;
+                }
+
+                const callback function = e.function;
+                void *context = e.context;
+
+                remove(0);
+
+                if (e.period) {
+                    e.deadline += e.period;
+                    insert(slot);
+                } else {
+                    release(slot);
+                }
+
+                function(context);
+            }
+
+            arm();
+        }
+
+    private:
+        static constexpr lp::u16_t free = 0xffff;
+        static constexpr lp::u32_t cen = block::cr1_cen::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t ug = block::egr_ug::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cc1g = block::egr_cc1g::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cc1ie = block::dier_cc1ie::template mask<lp::u32_t>::value;
+        static constexpr lp::u32_t cc1if = block::sr_cc1if::template mask<lp::u32_t>::value;
+
+        struct entry {
+            lp::u32_t deadline;
+            lp::u32_t period;
+            callback function;
+            void *context;
+            lp::u16_t position; // heap index or free
+            lp::u16_t generation;
+        };
+
+        /// Counter value a comes before b on the wrapping time line
+        static bool before(lp::u32_t a, lp::u32_t b) noexcept {
+            return a - b > max_delay;
+        }
+
+        static bool earlier(lp::u32_t a, lp::u32_t b) noexcept {
+            return before(entries[a].deadline, entries[b].deadline);
+        }
+
+        /// The timer irq may still be taken a few instructions after the
+        /// icer write, the barriers keep the heap untouched until then
+        static void mask() noexcept {
+            nvic::template disable_irq<irq>();
+            cpu::data_sync_barrier();
+            cpu::instruction_sync_barrier();
+        }
+
+        static void unmask() noexcept {
+            if (running) {
+                nvic::template enable_irq<irq>();
+            }
+        }
+
+        static void clear() noexcept {
+            size = 0;
+            free_head = 0;
+
+            for (lp::u32_t i = 0; i < Capacity; ++i) {
+                entries[i].position = free;
+                entries[i].deadline = i + 1; // free list link
+            }
+        }
+
+        static handle add(lp::u32_t delay, lp::u32_t period, callback function, void *context) noexcept {
+            if (delay > max_delay || period > max_delay || !function) {
+                return invalid;
+            }
+
+            mask();
+
+            if (free_head == Capacity) {
+                unmask();
+                return invalid;
+            }
+
+            const lp::u32_t slot = free_head;
+            entry &e = entries[slot];
+
+            free_head = e.deadline;
+            e.deadline = now() + delay;
+            e.period = period;
+            e.function = function;
+            e.context = context;
+            ++e.generation;
+
+            insert(slot);
+            arm();
+
+            unmask();
+
+            return (static_cast<lp::u32_t>(e.generation) << 16) | slot;
+        }
+
+        static void release(lp::u32_t slot) noexcept {
+            entries[slot].position = free;
+            entries[slot].deadline = free_head;
+            free_head = slot;
+        }
+
+        static void place(lp::u32_t position, lp::u32_t slot) noexcept {
+            heap[position] = slot;
+            entries[slot].position = position;
+        }
+
+        static void sift_up(lp::u32_t position) noexcept {
+            const lp::u32_t slot = heap[position];
+
+            while (position > 0) {
+                const lp::u32_t parent = (position - 1) / 2;
+
+                if (!earlier(slot, heap[parent])) {
+                    break;
+                }
+
+                place(position, heap[parent]);
+                position = parent;
+            }
+
+            place(position, slot);
+        }
+
+        static void sift_down(lp::u32_t position) noexcept {
+            const lp::u32_t slot = heap[position];
+
+            while (true) {
+                lp::u32_t child = position * 2 + 1;
+
+                if (child >= size) {
+                    break;
+                }
+
+                if (child + 1 < size && earlier(heap[child + 1], heap[child])) {
+                    ++child;
+                }
+
+                if (!earlier(heap[child], slot)) {
+                    break;
+                }
+
+                place(position, heap[child]);
+                position = child;
+            }
+
+            place(position, slot);
+        }
+
+        static void insert(lp::u32_t slot) noexcept {
+            place(size, slot);
+            sift_up(size++);
+        }
+
+        static void remove(lp::u32_t position) noexcept {
+            const lp::u32_t last = heap[--size];
+
+            if (position == size) {
+                return;
+            }
+
+            place(position, last);
+
+            if (position > 0 && earlier(last, heap[(position - 1) / 2])) {
+                sift_up(position);
+            } else {
+                sift_down(position);
+            }
+        }
+
+        /// Compare on earliest deadline, a deadline already passed while
+        /// programming is raised by software as compare event
+        static void arm() noexcept {
+            if (!size) {
+                return;
+            }
+
+            const lp::u32_t deadline = entries[heap[0]].deadline;
+
+            block::ccr1::get() = deadline;
+
+            if (!before(now(), deadline)) {
+                block::egr::get() = cc1g;
+            }
+        }
+
+        static entry entries[Capacity];
+        static lp::u16_t heap[Capacity];
+        static lp::u32_t size;
+        static lp::u32_t free_head;
+        static bool running;
+    };
+
+    template <typename Tim, lp::u32_t Capacity>
+    typename timer_service<Tim, Capacity>::entry timer_service<Tim, Capacity>::entries[Capacity];
+
+    template <typename Tim, lp::u32_t Capacity>
+    lp::u16_t timer_service<Tim, Capacity>::heap[Capacity];
+
+    template <typename Tim, lp::u32_t Capacity>
+    lp::u32_t timer_service<Tim, Capacity>::size = 0;
+
+    template <typename Tim, lp::u32_t Capacity>
+    lp::u32_t timer_service<Tim, Capacity>::free_head = Capacity;
+
+    template <typename Tim, lp::u32_t Capacity>
+    bool timer_service<Tim, Capacity>::running = false;
+}
+
+#endif // HAL_TIMER_SERVICE_HH
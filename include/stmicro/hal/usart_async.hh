@@ -0,0 +1,160 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for usart
+ * interrupt driven ring buffered transfers
+ * @file usart_async.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <hal/ring_buffer.hh>
+#include <hal/usart_type.hh>
+
+#ifndef HAL_USART_ASYNC_HH
+#define HAL_USART_ASYNC_HH
+
+namespace hal {
+    /// Non-blocking usart, irq_handler() must be called from the
+    /// corresponding USARTx/UARTx/LPUART1 interrupt handler
+    template <typename Usart_block, lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+    struct usart_async : usart<Usart_block> {
+        using block = Usart_block;
+        using tx_buffer_t = ring_buffer<lp::u8_t, Tx_capacity>;
+        using rx_buffer_t = ring_buffer<lp::u8_t, Rx_capacity>;
+
+        static void start() noexcept {
+            block::icr::template set<
+                typename block::icr_orecf,
+                typename block::icr_ncf,
+                typename block::icr_fecf,
+                typename block::icr_pecf
+            >();
+            block::cr1::template set_or<typename block::cr1_rxneie>();
+        }
+
+        static void stop() noexcept {
+            block::cr1::template set_nand<
+                typename block::cr1_rxneie,
+                typename block::cr1_txeie
+            >();
+        }
+
+        static lp::u32_t write(const lp::u8_t *data, lp::u32_t size) noexcept {
+            const lp::u32_t count = tx.write(data, size);
+
+            if (count != 0) {
+                block::cr1::template set_or<typename block::cr1_txeie>();
+            }
+
+            return count;
+        }
+
+        template <lp::u32_t Size>
+        static lp::u32_t write(const lp::u8_t (&data)[Size]) noexcept {
+            return write(data, Size);
+        }
+
+        static lp::u32_t read(lp::u8_t *data, lp::u32_t size) noexcept {
+            return rx.read(data, size);
+        }
+
+        template <lp::u32_t Size>
+        static lp::u32_t read(lp::u8_t (&data)[Size]) noexcept {
+            return read(data, Size);
+        }
+
+        static lp::u32_t tx_pending() noexcept {
+            return tx.size();
+        }
+
+        static lp::u32_t rx_available() noexcept {
+            return rx.size();
+        }
+
+        /// Characters lost by hardware because rdr was not read in time
+        static lp::u32_t overruns() noexcept {
+            return overrun_count;
+        }
+
+        /// Characters received but discarded because rx buffer was full
+        static lp::u32_t drops() noexcept {
+            return drop_count;
+        }
+
+        static void irq_handler() noexcept {
+            const lp::u32_t status = block::isr::get();
+
+            if (status & (isr_mask<typename block::isr_ore>() |
+                    isr_mask<typename block::isr_fe>() |
+                    isr_mask<typename block::isr_pe>())) {
+                if (status & isr_mask<typename block::isr_ore>()) {
+                    overrun_count = overrun_count + 1;
+                }
+
+                block::icr::template set<
+                    typename block::icr_orecf,
+                    typename block::icr_ncf,
+                    typename block::icr_fecf,
+                    typename block::icr_pecf
+                >();
+            }
+
+            if (status & isr_mask<typename block::isr_rxne>()) {
+                if (!rx.push(static_cast<lp::u8_t>(block::rdr::get()))) {
+                    drop_count = drop_count + 1;
+                }
+            }
+
+            if ((status & isr_mask<typename block::isr_txe>()) &&
+                    block::cr1::template get_and<typename block::cr1_txeie>()) {
+                lp::u8_t value;
+
+                if (tx.pop(value)) {
+                    block::tdr::get() = value;
+                } else {
+                    block::cr1::template set_nand<typename block::cr1_txeie>();
+                }
+            }
+        }
+
+    private:
+        template <typename Bit>
+        static constexpr lp::u32_t isr_mask() noexcept {
+            return Bit::template mask<lp::u32_t>::value;
+        }
+
+        static tx_buffer_t tx;
+        static rx_buffer_t rx;
+        static volatile lp::u32_t overrun_count;
+        static volatile lp::u32_t drop_count;
+    };
+
+    template <typename Usart_block, lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+    typename usart_async<Usart_block, Tx_capacity, Rx_capacity>::tx_buffer_t
+        usart_async<Usart_block, Tx_capacity, Rx_capacity>::tx;
+
+    template <typename Usart_block, lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+    typename usart_async<Usart_block, Tx_capacity, Rx_capacity>::rx_buffer_t
+        usart_async<Usart_block, Tx_capacity, Rx_capacity>::rx;
+
+    template <typename Usart_block, lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+    volatile lp::u32_t usart_async<Usart_block, Tx_capacity, Rx_capacity>::overrun_count = 0;
+
+    template <typename Usart_block, lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+    volatile lp::u32_t usart_async<Usart_block, Tx_capacity, Rx_capacity>::drop_count = 0;
+}
+
+#endif // HAL_USART_ASYNC_HH
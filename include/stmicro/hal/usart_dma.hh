@@ -0,0 +1,283 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for usart
+ * dma driven streaming transfers
+ * @file usart_dma.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+#include <type_list.hh>
+
+#include <hal/dma_type.hh>
+#include <hal/usart_type.hh>
+
+#ifndef HAL_USART_DMA_HH
+#define HAL_USART_DMA_HH
+
+namespace hal {
+    /// Zero-copy usart streaming: transmit straight from caller buffers,
+    /// receive into a circular dma buffer published on half transfer,
+    /// transfer complete and idle line events.
+    /// usart_irq_handler(), tx_dma_irq_handler() and rx_dma_irq_handler()
+    /// must be called from the usart and both dma channel interrupts,
+    /// all configured to the same priority. A publish more than a buffer
+    /// late loses the oldest bytes, rx_laps() counts those.
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    struct usart_dma : usart<Usart_block> {
+        static_assert(Rx_capacity >= 2 && Rx_capacity <= 0xffff,
+            "Rx capacity must fit dma transfer counter");
+
+        using block = Usart_block;
+        using tx_channel = Tx_dma;
+        using rx_channel = Rx_dma;
+        using dma_channels = lp::type_list<tx_channel, rx_channel>;
+
+        /// Receives contiguous chunks of the circular buffer
+        using rx_handler = void (*)(const lp::u8_t *data, lp::u32_t size);
+        using tx_handler = void (*)();
+
+        static void start(rx_handler on_rx, tx_handler on_tx_done = nullptr) noexcept {
+            rx_callback = on_rx;
+            tx_callback = on_tx_done;
+            rx_position = 0;
+            rx_lap_count = 0;
+            rx_owed = 0;
+            tx_active = false;
+
+            tx_channel::select_request();
+            rx_channel::select_request();
+
+            rx_channel::template periph_to_mem_double_buffer<dma_config::error_int>(
+                block::rdr::address, rx_buffer, Rx_capacity);
+
+            block::icr::template set<
+                typename block::icr_idlecf,
+                typename block::icr_orecf
+            >();
+            block::cr3::template set_or<
+                typename block::cr3_dmat,
+                typename block::cr3_dmar,
+                typename block::cr3_eie
+            >();
+            block::cr1::template set_or<typename block::cr1_idleie>();
+        }
+
+        static void stop() noexcept {
+            block::cr1::template set_nand<typename block::cr1_idleie>();
+            block::cr3::template set_nand<
+                typename block::cr3_dmat,
+                typename block::cr3_dmar,
+                typename block::cr3_eie
+            >();
+            tx_channel::stop();
+            rx_channel::stop();
+            tx_active = false;
+        }
+
+        /// Start transmission of caller owned buffer, it must stay
+        /// untouched until tx_busy() returns false
+        static bool send(const lp::u8_t *data, lp::u32_t size) noexcept {
+            if (tx_active || size == 0 || size > 0xffff) {
+                return false;
+            }
+
+            tx_active = true;
+            block::icr::template set<typename block::icr_tccf>();
+            tx_channel::template mem_to_periph<
+                dma_config::complete_int,
+                dma_config::error_int
+            >(block::tdr::address, data, size);
+
+            return true;
+        }
+
+        static bool tx_busy() noexcept {
+            return tx_active;
+        }
+
+        static lp::u32_t overruns() noexcept {
+            return overrun_count;
+        }
+
+        static lp::u32_t transfer_errors() noexcept {
+            return error_count;
+        }
+
+        /// Publishes that found the dma past the unread bytes, only the
+        /// newest bytes up to its position reached the rx handler
+        static lp::u32_t rx_laps() noexcept {
+            return rx_lap_count;
+        }
+
+        static void usart_irq_handler() noexcept {
+            const lp::u32_t status = block::isr::get();
+
+            if (status & block::isr_ore::template mask<lp::u32_t>::value) {
+                overrun_count = overrun_count + 1;
+                block::icr::template set<typename block::icr_orecf>();
+            }
+
+            if (status & block::isr_idle::template mask<lp::u32_t>::value) {
+                block::icr::template set<typename block::icr_idlecf>();
+                rx_publish(rx_take_flags());
+            }
+        }
+
+        static void rx_dma_irq_handler() noexcept {
+            const lp::u32_t status = rx_take_flags();
+
+            if (status & (rx_channel::flags::half | rx_channel::flags::complete)) {
+                rx_publish(status);
+            }
+        }
+
+        static void tx_dma_irq_handler() noexcept {
+            const lp::u32_t status = tx_channel::take_flags();
+
+            if (status & tx_channel::flags::error) {
+                error_count = error_count + 1;
+            }
+
+            if (status & (tx_channel::flags::complete | tx_channel::flags::error)) {
+                tx_channel::stop();
+                tx_active = false;
+
+                if (tx_callback) {
+                    tx_callback();
+                }
+            }
+        }
+
+    private:
+        static constexpr lp::u32_t half_position = Rx_capacity / 2;
+
+        /// Idle publishes take the dma flags as well, so every half and
+        /// complete event is seen by the publish that passes over it
+        static lp::u32_t rx_take_flags() noexcept {
+            const lp::u32_t status = rx_channel::take_flags();
+
+            if (status & rx_channel::flags::error) {
+                error_count = error_count + 1;
+            }
+
+            return status;
+        }
+
+        /// True for a boundary position in the unread bytes after tail
+        static bool passed(lp::u32_t boundary, lp::u32_t tail, lp::u32_t unread) noexcept {
+            return (boundary + Rx_capacity - tail - 1) % Rx_capacity + 1 <= unread;
+        }
+
+        /// Flags taken before the position is read are the boundaries the
+        /// dma crossed since the last publish. One outside the unread
+        /// bytes means it lapped the reader. Both at once are counted too,
+        /// a lap sets the same two flags, so a reader half a buffer late
+        /// is reported even when nothing was lost. A boundary crossed
+        /// between taking the flags and reading the position is owed to
+        /// the next publish.
+        static bool lapped(lp::u32_t status, lp::u32_t tail, lp::u32_t head) noexcept {
+            constexpr lp::u32_t both = rx_channel::flags::half | rx_channel::flags::complete;
+            const lp::u32_t unread = (head + Rx_capacity - tail) % Rx_capacity;
+            const lp::u32_t expected =
+                (passed(half_position, tail, unread) ? rx_channel::flags::half : 0) |
+                (passed(0, tail, unread) ? rx_channel::flags::complete : 0);
+            const lp::u32_t fresh = status & both & ~rx_owed;
+
+            rx_owed = expected & ~fresh;
+
+            return fresh == both || (fresh & ~expected) != 0;
+        }
+
+        static void rx_publish(lp::u32_t status) noexcept {
+            lp::u32_t head = Rx_capacity - rx_channel::remaining();
+
+            if (head == Rx_capacity) {
+                head = 0;
+            }
+
+            const lp::u32_t tail = rx_position;
+
+            if (lapped(status, tail, head)) {
+                rx_lap_count = rx_lap_count + 1;
+            }
+
+            if (head == tail || !rx_callback) {
+                rx_position = head;
+                return;
+            }
+
+            if (head > tail) {
+                rx_callback(&rx_buffer[tail], head - tail);
+            } else {
+                rx_callback(&rx_buffer[tail], Rx_capacity - tail);
+
+                if (head != 0) {
+                    rx_callback(&rx_buffer[0], head);
+                }
+            }
+
+            rx_position = head;
+        }
+
+        static lp::u8_t rx_buffer[Rx_capacity];
+        static lp::u32_t rx_position;
+        static lp::u32_t rx_owed;
+        static rx_handler rx_callback;
+        static tx_handler tx_callback;
+        static volatile bool tx_active;
+        static volatile lp::u32_t overrun_count;
+        static volatile lp::u32_t error_count;
+        static volatile lp::u32_t rx_lap_count;
+    };
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    lp::u8_t
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::rx_buffer[Rx_capacity];
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    lp::u32_t
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::rx_position = 0;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    lp::u32_t
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::rx_owed = 0;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    typename usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::rx_handler
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::rx_callback = nullptr;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    typename usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::tx_handler
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::tx_callback = nullptr;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    volatile bool
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::tx_active = false;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    volatile lp::u32_t
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::overrun_count = 0;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    volatile lp::u32_t
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::error_count = 0;
+
+    template <typename Usart_block, typename Tx_dma, typename Rx_dma, lp::u32_t Rx_capacity>
+    volatile lp::u32_t
+        usart_dma<Usart_block, Tx_dma, Rx_dma, Rx_capacity>::rx_lap_count = 0;
+}
+
+#endif // HAL_USART_DMA_HH
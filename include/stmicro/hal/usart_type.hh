@@ -31,12 +31,38 @@
 #define HAL_USART_TYPE_HH
 
 namespace hal {
+    /// Brr value scale, lpuart divides 256 * clock by brr
+    template <typename Usart_block>
+    struct usart_brr_scale {
+        static constexpr lp::u64_t value = 1;
+    };
+
+    template <lp::addr_t Address>
+    struct usart_brr_scale<lpuart_t<Address>> {
+        static constexpr lp::u64_t value = 256;
+    };
+
     template <typename Usart_block>
     struct usart {
         using block = Usart_block;
         using input = typename block::rdr;
         using output = typename block::tdr;
 
+        /// Nearest brr for baudrate with its error checked
+        template <lp::u32_t Clock, lp::u32_t Baudrate>
+        struct divider {
+            static constexpr lp::u64_t scaled = usart_brr_scale<block>::value * Clock;
+            static constexpr lp::u32_t value = static_cast<lp::u32_t>((scaled + Baudrate / 2) / Baudrate);
+            static constexpr lp::u64_t actual = scaled / value;
+
+            static_assert(value >= (usart_brr_scale<block>::value == 1 ? 16 : 0x300),
+                "Baudrate is too high for kernel clock");
+            static_assert(value <= (usart_brr_scale<block>::value == 1 ? 0xffff : 0xfffff),
+                "Baudrate is too low for kernel clock");
+            static_assert((actual > Baudrate ? actual - Baudrate : Baudrate - actual) * 50 <= Baudrate,
+                "Baudrate error is above 2% for kernel clock");
+        };
+
         struct config {
             using none = typename block::cr1_ue;
             using tx_only = lp::type_list<none, typename block::cr1_te>;
@@ -46,6 +72,11 @@ namespace hal {
                 typename block::cr1_re>;
             template <lp::word_t Periph_clock, lp::word_t Baudrate>
             using baudrate = typename block::brr_brr::template with_value<Periph_clock / Baudrate>;
+            /// Baudrate from kernel clock of Clock_tree, rounded to nearest
+            /// divider, fails to compile above 2% error
+            template <typename Clock_tree, lp::word_t Baudrate>
+            using baud = typename block::brr_brr::template with_value<
+                divider<Clock_tree::template kernel_hz<block>(), Baudrate>::value>;
         };
 
         using register_setup_list = lp::type_list<
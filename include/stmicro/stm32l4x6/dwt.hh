@@ -0,0 +1,128 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware support for dwt
+ * @file dwt.hh
+ * @author Boris Vinogradov
+ */
+
+#include <associate_bit.hh>
+#include <io_register.hh>
+#include <types.hh>
+
+#ifndef DWT_HH
+#define DWT_HH
+
+/* Data watchpoint and trace unit */
+template <lp::addr_t base_address>
+struct dwt_t {
+    /* Control register */
+    using ctrl = lp::io_register<lp::u32_t, base_address + 0x0>;
+    /* Enable cycle counter */
+    using ctrl_cyccntena = lp::assoc_bit<ctrl, 0>;
+    /* Cycle counter tap for periodic packets */
+    using ctrl_postpreset = lp::assoc_bit<ctrl, 1, 4>;
+    /* Reload value for periodic packet counter */
+    using ctrl_postinit = lp::assoc_bit<ctrl, 5, 4>;
+    /* Cycle counter tap selection */
+    using ctrl_cyctap = lp::assoc_bit<ctrl, 9>;
+    /* Synchronization packet tap */
+    using ctrl_synctap = lp::assoc_bit<ctrl, 10, 2>;
+    /* Enable periodic pc sample packets */
+    using ctrl_pcsamplena = lp::assoc_bit<ctrl, 12>;
+    /* Enable exception trace */
+    using ctrl_exctrcena = lp::assoc_bit<ctrl, 16>;
+    /* Enable cpi counter event */
+    using ctrl_cpievtena = lp::assoc_bit<ctrl, 17>;
+    /* Enable exception overhead counter event */
+    using ctrl_excevtena = lp::assoc_bit<ctrl, 18>;
+    /* Enable sleep counter event */
+    using ctrl_sleepevtena = lp::assoc_bit<ctrl, 19>;
+    /* Enable load store unit counter event */
+    using ctrl_lsuevtena = lp::assoc_bit<ctrl, 20>;
+    /* Enable folded instruction counter event */
+    using ctrl_foldevtena = lp::assoc_bit<ctrl, 21>;
+    /* Enable cycle count event */
+    using ctrl_cycevtena = lp::assoc_bit<ctrl, 22>;
+    /* Cycle counter is not supported */
+    using ctrl_nocyccnt = lp::assoc_bit<ctrl, 25>;
+    /* Number of comparators */
+    using ctrl_numcomp = lp::assoc_bit<ctrl, 28, 4>;
+
+
+    /* Cycle count register */
+    using cyccnt = lp::io_register<lp::u32_t, base_address + 0x4>;
+
+
+    /* Cpi count register */
+    using cpicnt = lp::io_register<lp::u32_t, base_address + 0x8>;
+    /* Additional cycles per instruction */
+    using cpicnt_cpicnt = lp::assoc_bit<cpicnt, 0, 8>;
+
+
+    /* Exception overhead count register */
+    using exccnt = lp::io_register<lp::u32_t, base_address + 0xc>;
+    /* Exception overhead cycles */
+    using exccnt_exccnt = lp::assoc_bit<exccnt, 0, 8>;
+
+
+    /* Sleep count register */
+    using sleepcnt = lp::io_register<lp::u32_t, base_address + 0x10>;
+    /* Sleep cycles */
+    using sleepcnt_sleepcnt = lp::assoc_bit<sleepcnt, 0, 8>;
+
+
+    /* Lsu count register */
+    using lsucnt = lp::io_register<lp::u32_t, base_address + 0x14>;
+    /* Load store unit cycles */
+    using lsucnt_lsucnt = lp::assoc_bit<lsucnt, 0, 8>;
+
+
+    /* Folded instruction count register */
+    using foldcnt = lp::io_register<lp::u32_t, base_address + 0x18>;
+    /* Folded instructions */
+    using foldcnt_foldcnt = lp::assoc_bit<foldcnt, 0, 8>;
+
+
+    /* Program counter sample register */
+    using pcsr = lp::io_register<lp::u32_t, base_address + 0x1c>;
+
+
+};
+
+/* Debug control block */
+template <lp::addr_t base_address>
+struct dcb_t {
+    /* Debug halting control and status register */
+    using dhcsr = lp::io_register<lp::u32_t, base_address + 0x0>;
+    /* Debugger is connected */
+    using dhcsr_c_debugen = lp::assoc_bit<dhcsr, 0>;
+
+
+    /* Debug exception and monitor control register */
+    using demcr = lp::io_register<lp::u32_t, base_address + 0xc>;
+    /* Vector catch on core reset */
+    using demcr_vc_corereset = lp::assoc_bit<demcr, 0>;
+    /* Debug monitor enable */
+    using demcr_mon_en = lp::assoc_bit<demcr, 16>;
+    /* Global enable for dwt and itm */
+    using demcr_trcena = lp::assoc_bit<demcr, 24>;
+
+
+};
+
+using dwt = dwt_t<0xe0001000>;
+using dcb = dcb_t<0xe000edf0>;
+
+#endif // DWT_HH
@@ -0,0 +1,33 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware support flash routines running from ram
+ * @file flash_ram.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#ifndef FLASH_RAM_HH
+#define FLASH_RAM_HH
+
+namespace flash_ram {
+    /// Fast program one 256 byte row at address of a mass erased bank from
+    /// 64 words in ram. Runs from .ramfunc (copied with .data), no flash
+    /// access may happen until it returns, so interrupts must be masked.
+    /// Returns flash sr error bits, zero on success.
+    lp::u32_t program_row(lp::addr_t address, const lp::u32_t *words) noexcept;
+}
+
+#endif // FLASH_RAM_HH
@@ -0,0 +1,80 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for device dma
+ * @file dma_device.hh
+ * @author Boris Vinogradov
+ */
+
+#include <dma.hh>
+#include <hal/dma_type.hh>
+#include <hal/isr_irq.hh>
+
+#ifndef HAL_DMA_DEVICE_HH
+#define HAL_DMA_DEVICE_HH
+
+namespace hal {
+    template <> struct dma_channel_irq<::dma1, 1> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH1; };
+    template <> struct dma_channel_irq<::dma1, 2> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH2; };
+    template <> struct dma_channel_irq<::dma1, 3> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH3; };
+    template <> struct dma_channel_irq<::dma1, 4> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH4; };
+    template <> struct dma_channel_irq<::dma1, 5> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH5; };
+    template <> struct dma_channel_irq<::dma1, 6> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH6; };
+    template <> struct dma_channel_irq<::dma1, 7> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA1_CH7; };
+    template <> struct dma_channel_irq<::dma2, 1> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH1; };
+    template <> struct dma_channel_irq<::dma2, 2> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH2; };
+    template <> struct dma_channel_irq<::dma2, 3> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH3; };
+    template <> struct dma_channel_irq<::dma2, 4> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH4; };
+    template <> struct dma_channel_irq<::dma2, 5> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH5; };
+    template <> struct dma_channel_irq<::dma2, 6> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH6; };
+    template <> struct dma_channel_irq<::dma2, 7> { static constexpr irq_dev_num_t value = irq_dev_num_t::DMA2_CH7; };
+
+    namespace dma_device {
+        /* Request mapping: controller, channel, cselr value */
+        using adc1 = dma_channel<::dma1, 1, 0>;
+        using spi1_rx = dma_channel<::dma1, 2, 1>;
+        using spi1_tx = dma_channel<::dma1, 3, 1>;
+        using spi2_rx = dma_channel<::dma1, 4, 1>;
+        using spi2_tx = dma_channel<::dma1, 5, 1>;
+        using usart3_tx = dma_channel<::dma1, 2, 2>;
+        using usart3_rx = dma_channel<::dma1, 3, 2>;
+        using usart1_tx = dma_channel<::dma1, 4, 2>;
+        using usart1_rx = dma_channel<::dma1, 5, 2>;
+        using usart2_rx = dma_channel<::dma1, 6, 2>;
+        using usart2_tx = dma_channel<::dma1, 7, 2>;
+        using i2c1_tx = dma_channel<::dma1, 6, 3>;
+        using i2c1_rx = dma_channel<::dma1, 7, 3>;
+        using uart5_tx = dma_channel<::dma2, 1, 2>;
+        using uart5_rx = dma_channel<::dma2, 2, 2>;
+        using uart4_tx = dma_channel<::dma2, 3, 2>;
+        using uart4_rx = dma_channel<::dma2, 5, 2>;
+        using usart1_tx_alt = dma_channel<::dma2, 6, 2>;
+        using usart1_rx_alt = dma_channel<::dma2, 7, 2>;
+        using lpuart1_tx = dma_channel<::dma2, 6, 4>;
+        using lpuart1_rx = dma_channel<::dma2, 7, 4>;
+        using aes_in = dma_channel<::dma2, 1, 6>;
+        using aes_out = dma_channel<::dma2, 2, 6>;
+        using aes_out_alt = dma_channel<::dma2, 3, 6>;
+        using aes_in_alt = dma_channel<::dma2, 5, 6>;
+        using hash_in = dma_channel<::dma2, 7, 6>;
+
+        /* Software triggered memory transfers, any request value */
+        template <lp::u32_t Channel>
+        using dma1_mem = dma_channel<::dma1, Channel, 0>;
+        template <lp::u32_t Channel>
+        using dma2_mem = dma_channel<::dma2, Channel, 0>;
+    }
+}
+
+#endif // HAL_DMA_DEVICE_HH
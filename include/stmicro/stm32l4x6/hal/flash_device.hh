@@ -0,0 +1,50 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware abstraction layer for device flash
+ * @file flash_device.hh
+ * @author Boris Vinogradov
+ */
+
+#include <types.hh>
+
+#include <flash.hh>
+
+#ifndef HAL_FLASH_DEVICE_HH
+#define HAL_FLASH_DEVICE_HH
+
+namespace hal {
+    namespace flash_device {
+
+        /* Main memory, two banks of equal size (stm32l476xg) */
+        constexpr lp::addr_t base = 0x08000000;
+        constexpr lp::u32_t size = 1024 * 1024;
+        constexpr lp::u32_t bank_size = size / 2;
+
+        /* Erase unit, program unit and fast programming row */
+        constexpr lp::u32_t page_size = 2048;
+        constexpr lp::u32_t double_word_size = 8;
+        constexpr lp::u32_t row_size = 32 * double_word_size;
+
+        /* Key sequence for keyr */
+        constexpr lp::u32_t key1 = 0x45670123;
+        constexpr lp::u32_t key2 = 0xcdef89ab;
+
+        /* Key sequence for optkeyr */
+        constexpr lp::u32_t optkey1 = 0x08192a3b;
+        constexpr lp::u32_t optkey2 = 0x4c5d6e7f;
+    }
+}
+
+#endif // HAL_FLASH_DEVICE_HH
@@ -18,6 +18,7 @@
  */
 
 #include <gpio.hh>
+#include <rcc.hh>
 #include <hal/gpio_type_v2.hh>
 
 #ifndef HAL_GPIO_DEVICE_HH
@@ -34,6 +35,94 @@ namespace hal {
         using gpiog = gpio<gpiog>;
         using gpioh = gpio<gpioh>;
         using gpioi = gpio<gpioi>;
+
+        /// Port number, clock enable bit and register reset values,
+        /// otyper and afr reset to zero on every port
+        template <typename Port>
+        struct gpio_port;
+
+        using gpio_enable_register = ::rcc::ahb2enr;
+
+        template <>
+        struct gpio_port<gpioa> {
+            static constexpr lp::u32_t index = 0;
+            using enable = ::rcc::ahb2enr_gpioaen;
+            static constexpr lp::u32_t moder_reset = 0xabffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x0c000000;
+            static constexpr lp::u32_t pupdr_reset = 0x64000000;
+        };
+
+        template <>
+        struct gpio_port<gpiob> {
+            static constexpr lp::u32_t index = 1;
+            using enable = ::rcc::ahb2enr_gpioben;
+            static constexpr lp::u32_t moder_reset = 0xfffffebf;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000100;
+        };
+
+        template <>
+        struct gpio_port<gpioc> {
+            static constexpr lp::u32_t index = 2;
+            using enable = ::rcc::ahb2enr_gpiocen;
+            static constexpr lp::u32_t moder_reset = 0xffffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
+
+        template <>
+        struct gpio_port<gpiod> {
+            static constexpr lp::u32_t index = 3;
+            using enable = ::rcc::ahb2enr_gpioden;
+            static constexpr lp::u32_t moder_reset = 0xffffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
+
+        template <>
+        struct gpio_port<gpioe> {
+            static constexpr lp::u32_t index = 4;
+            using enable = ::rcc::ahb2enr_gpioeen;
+            static constexpr lp::u32_t moder_reset = 0xffffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
+
+        template <>
+        struct gpio_port<gpiof> {
+            static constexpr lp::u32_t index = 5;
+            using enable = ::rcc::ahb2enr_gpiofen;
+            static constexpr lp::u32_t moder_reset = 0xffffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
+
+        template <>
+        struct gpio_port<gpiog> {
+            static constexpr lp::u32_t index = 6;
+            using enable = ::rcc::ahb2enr_gpiogen;
+            static constexpr lp::u32_t moder_reset = 0xffffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
+
+        template <>
+        struct gpio_port<gpioh> {
+            static constexpr lp::u32_t index = 7;
+            using enable = ::rcc::ahb2enr_gpiohen;
+            static constexpr lp::u32_t moder_reset = 0x0000000f;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
+
+        template <>
+        struct gpio_port<gpioi> {
+            static constexpr lp::u32_t index = 8;
+            using enable = ::rcc::ahb2enr_gpioien;
+            static constexpr lp::u32_t moder_reset = 0xffffffff;
+            static constexpr lp::u32_t ospeedr_reset = 0x00000000;
+            static constexpr lp::u32_t pupdr_reset = 0x00000000;
+        };
     }
 }
 
@@ -45,6 +45,13 @@ namespace hal {
 
         /* Interrupt Priority Registers */
         using ipr = lp::type_list<nvic::ipr0, nvic::ipr1, nvic::ipr2, nvic::ipr3, nvic::ipr4, nvic::ipr5, nvic::ipr6, nvic::ipr7, nvic::ipr8, nvic::ipr9, nvic::ipr10, nvic::ipr11, nvic::ipr12, nvic::ipr13, nvic::ipr14, nvic::ipr15, nvic::ipr16, nvic::ipr17, nvic::ipr18, nvic::ipr19, nvic::ipr20>;
+
+        /* Register counts of the lists above */
+        constexpr lp::u32_t iser_count = 3;
+        constexpr lp::u32_t ipr_count = 21;
+
+        /* Implemented priority bits, upper bits of each ipr byte */
+        constexpr lp::u32_t priority_bits = 4;
     }
 }
 
@@ -18,6 +18,9 @@
  */
 
 #include <rcc.hh>
+#include <tim.hh>
+#include <usart.hh>
+
 #ifndef HAL_RCC_DEVICE_HH
 #define HAL_RCC_DEVICE_HH
 
@@ -284,6 +287,41 @@ namespace hal {
         /* SYSCFG clocks enable during Sleep and               Stop modes */
         using syscfgsmen = rcc::apb2smenr_syscfgsmen;
     }
+
+    /// Bus feeding a peripheral kernel clock with reset ccipr selection,
+    /// timers run at twice the bus clock when its prescaler divides
+    enum class clock_bus {
+        apb1,
+        apb2
+    };
+
+    template <clock_bus Bus, bool Timer = false>
+    struct peripheral_clock_from {
+        static constexpr clock_bus bus = Bus;
+        static constexpr bool timer = Timer;
+    };
+
+    template <typename Block>
+    struct peripheral_clock;
+
+    template <> struct peripheral_clock<::usart1> : peripheral_clock_from<clock_bus::apb2> {};
+    template <> struct peripheral_clock<::usart2> : peripheral_clock_from<clock_bus::apb1> {};
+    template <> struct peripheral_clock<::usart3> : peripheral_clock_from<clock_bus::apb1> {};
+    template <> struct peripheral_clock<::uart4> : peripheral_clock_from<clock_bus::apb1> {};
+    template <> struct peripheral_clock<::uart5> : peripheral_clock_from<clock_bus::apb1> {};
+    template <> struct peripheral_clock<::lpuart1> : peripheral_clock_from<clock_bus::apb1> {};
+
+    template <> struct peripheral_clock<::tim2> : peripheral_clock_from<clock_bus::apb1, true> {};
+    template <> struct peripheral_clock<::tim3> : peripheral_clock_from<clock_bus::apb1, true> {};
+    template <> struct peripheral_clock<::tim4> : peripheral_clock_from<clock_bus::apb1, true> {};
+    template <> struct peripheral_clock<::tim5> : peripheral_clock_from<clock_bus::apb1, true> {};
+    template <> struct peripheral_clock<::tim6> : peripheral_clock_from<clock_bus::apb1, true> {};
+    template <> struct peripheral_clock<::tim7> : peripheral_clock_from<clock_bus::apb1, true> {};
+    template <> struct peripheral_clock<::tim1> : peripheral_clock_from<clock_bus::apb2, true> {};
+    template <> struct peripheral_clock<::tim8> : peripheral_clock_from<clock_bus::apb2, true> {};
+    template <> struct peripheral_clock<::tim15> : peripheral_clock_from<clock_bus::apb2, true> {};
+    template <> struct peripheral_clock<::tim16> : peripheral_clock_from<clock_bus::apb2, true> {};
+    template <> struct peripheral_clock<::tim17> : peripheral_clock_from<clock_bus::apb2, true> {};
 }
 
 #endif // HAL_RCC_DEVICE_HH
@@ -18,6 +18,7 @@
  */
 
 #include <tim.hh>
+#include <hal/isr_irq.hh>
 #include <hal/tim_type.hh>
 
 #ifndef HAL_TIM_DEVICE_HH
@@ -36,6 +37,20 @@ namespace hal {
         using tim8 = tim_general<tim8>;
         using tim6 = tim_base<tim6>;
         using tim7 = tim_base<tim7>;
+
+        /// Interrupt of 32-bit timers
+        template <typename Tim>
+        struct tim_irq;
+
+        template <>
+        struct tim_irq<tim2> {
+            static constexpr irq_dev_num_t value = irq_dev_num_t::TIM2;
+        };
+
+        template <>
+        struct tim_irq<tim5> {
+            static constexpr irq_dev_num_t value = irq_dev_num_t::TIM5;
+        };
     }
 }
 
@@ -19,6 +19,9 @@
 
 #include <usart.hh>
 #include <hal/usart_type.hh>
+#include <hal/usart_async.hh>
+#include <hal/usart_dma.hh>
+#include <hal/dma_device.hh>
 
 #ifndef HAL_USART_DEVICE_HH
 #define HAL_USART_DEVICE_HH
@@ -31,6 +34,34 @@ namespace hal {
         using uart4 = usart<uart4>;
         using uart5 = usart<uart5>;
         using lpuart1 = usart<lpuart1>;
+
+        template <lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+        using usart1_async = usart_async<::usart1, Tx_capacity, Rx_capacity>;
+        template <lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+        using usart2_async = usart_async<::usart2, Tx_capacity, Rx_capacity>;
+        template <lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+        using usart3_async = usart_async<::usart3, Tx_capacity, Rx_capacity>;
+        template <lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+        using uart4_async = usart_async<::uart4, Tx_capacity, Rx_capacity>;
+        template <lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+        using uart5_async = usart_async<::uart5, Tx_capacity, Rx_capacity>;
+        template <lp::u32_t Tx_capacity, lp::u32_t Rx_capacity>
+        using lpuart1_async = usart_async<::lpuart1, Tx_capacity, Rx_capacity>;
+
+        template <lp::u32_t Rx_capacity>
+        using usart1_dma = usart_dma<::usart1, dma_device::usart1_tx, dma_device::usart1_rx, Rx_capacity>;
+        template <lp::u32_t Rx_capacity>
+        using usart1_dma_alt = usart_dma<::usart1, dma_device::usart1_tx_alt, dma_device::usart1_rx_alt, Rx_capacity>;
+        template <lp::u32_t Rx_capacity>
+        using usart2_dma = usart_dma<::usart2, dma_device::usart2_tx, dma_device::usart2_rx, Rx_capacity>;
+        template <lp::u32_t Rx_capacity>
+        using usart3_dma = usart_dma<::usart3, dma_device::usart3_tx, dma_device::usart3_rx, Rx_capacity>;
+        template <lp::u32_t Rx_capacity>
+        using uart4_dma = usart_dma<::uart4, dma_device::uart4_tx, dma_device::uart4_rx, Rx_capacity>;
+        template <lp::u32_t Rx_capacity>
+        using uart5_dma = usart_dma<::uart5, dma_device::uart5_tx, dma_device::uart5_rx, Rx_capacity>;
+        template <lp::u32_t Rx_capacity>
+        using lpuart1_dma = usart_dma<::lpuart1, dma_device::lpuart1_tx, dma_device::lpuart1_rx, Rx_capacity>;
     }
 }
 
@@ -0,0 +1,41 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware support ram vector table
+ * @file isr_ram.hh
+ * @author Boris Vinogradov
+ */
+
+#include <isr_base.hh>
+#include <isr_extend.hh>
+
+#ifndef ISR_RAM_HH
+#define ISR_RAM_HH
+
+namespace isr {
+    /// Core and device vectors as one array, vtor needs the table size
+    /// rounded up to a power of two as alignment
+    constexpr lp::u32_t ram_vectors_count = (sizeof(vectors) + sizeof(device_vectors)) / sizeof(void *);
+    constexpr lp::u32_t ram_vectors_align = 512;
+    constexpr lp::u32_t core_vectors_count = sizeof(vectors) / sizeof(void *);
+
+    // sized by target vector entries, host simulation has wider pointers
+    static_assert(ram_vectors_count * sizeof(lp::u32_t) <= ram_vectors_align,
+        "Ram vectors do not fit table alignment");
+}
+
+/// Vector table copy in sram2, placed by linker into .ram_vectors
+extern void (*ram_vectors_table[isr::ram_vectors_count])();
+
+#endif // ISR_RAM_HH
@@ -0,0 +1,336 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host simulation of device registers
+ * @file register_model.cc
+ * @author Boris Vinogradov
+ */
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error "Register model supports Linux x86-64 hosts only"
+#endif
+
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include "register_model.hh"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+namespace {
+    struct region {
+        lp::addr_t base;
+        lp::u32_t size;
+        bool registers;
+    };
+
+    // stm32l4x6 address windows backed by host memory
+    constexpr region regions[] = {
+        {0x08000000, 0x100000, false}, // flash main memory
+        {0x10000000, 0x8000, false}, // sram2
+        {0x1fff7000, 0x1000, false}, // otp and option bytes
+        {0x40000000, 0x30000, true}, // apb1, apb2 and ahb1 peripherals
+        {0x48000000, 0x3000, true}, // gpio ports
+        {0x50000000, 0x61000, true}, // ahb2 peripherals
+        {0xa0000000, 0x2000, true}, // fmc and quadspi registers
+        {0xe0000000, 0x100000, true} // core private peripherals
+    };
+
+    constexpr lp::addr_t page_size = 0x1000;
+    constexpr lp::u32_t max_hooks = 128;
+    constexpr long long trap_flag = 0x100;
+
+    struct hook {
+        lp::addr_t address;
+        sim::read_hook read;
+        sim::write_hook write;
+    };
+
+    struct access {
+        lp::addr_t page;
+        lp::addr_t address;
+        lp::u32_t old_value[2];
+        bool write;
+        bool active;
+    };
+
+    hook hooks[max_hooks];
+    lp::u32_t hook_count = 0;
+    access pending = {};
+    sim::access_hook observer = nullptr;
+    bool mapped = false;
+
+    constexpr lp::addr_t page_of(lp::addr_t address) noexcept {
+        return address & ~(page_size - 1);
+    }
+
+    constexpr lp::addr_t word_of(lp::addr_t address) noexcept {
+        return address & ~static_cast<lp::addr_t>(3);
+    }
+
+    bool in_model(lp::addr_t address) noexcept {
+        for (const auto &r : regions) {
+            if (address >= r.base && address < r.base + r.size) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool in_registers(lp::addr_t address) noexcept {
+        for (const auto &r : regions) {
+            if (r.registers && address >= r.base && address < r.base + r.size) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool page_hooked(lp::addr_t page) noexcept {
+        if (observer && in_registers(page)) {
+            return true;
+        }
+
+        for (lp::u32_t i = 0; i < hook_count; ++i) {
+            if (page_of(hooks[i].address) == page) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void set_access(lp::addr_t page, bool allowed) noexcept {
+        mprotect(reinterpret_cast<void *>(page), page_size,
+            allowed ? PROT_READ | PROT_WRITE : PROT_NONE);
+    }
+
+    lp::u32_t &word(lp::addr_t address) noexcept {
+        return *reinterpret_cast<lp::u32_t *>(word_of(address));
+    }
+
+    void run_read_hooks(lp::addr_t address) noexcept {
+        for (lp::u32_t i = 0; i < hook_count; ++i) {
+            if (hooks[i].address == address && hooks[i].read) {
+                hooks[i].read(address);
+            }
+        }
+    }
+
+    void run_write_hooks(lp::addr_t address, lp::u32_t old_value, lp::u32_t new_value) noexcept {
+        for (lp::u32_t i = 0; i < hook_count; ++i) {
+            if (hooks[i].address == address && hooks[i].write) {
+                hooks[i].write(address, old_value, new_value);
+            }
+        }
+    }
+
+    void pass_through(int signal) noexcept {
+        struct sigaction action = {};
+
+        action.sa_handler = SIG_DFL;
+        sigaction(signal, &action, nullptr);
+    }
+
+    void on_fault(int signal, siginfo_t *info, void *context) {
+        auto *state = static_cast<ucontext_t *>(context);
+        const lp::addr_t address = reinterpret_cast<lp::addr_t>(info->si_addr);
+
+        if (pending.active || !in_model(address) || !page_hooked(page_of(address))) {
+            pass_through(signal);
+            return;
+        }
+
+        pending.page = page_of(address);
+        pending.address = word_of(address);
+        pending.write = state->uc_mcontext.gregs[REG_ERR] & 0x2;
+        pending.active = true;
+
+        set_access(pending.page, true);
+
+        pending.old_value[0] = word(pending.address);
+        pending.old_value[1] = page_of(pending.address + 4) == pending.page ?
+            word(pending.address + 4) : 0;
+
+        if (!pending.write) {
+            run_read_hooks(pending.address);
+        }
+
+        state->uc_mcontext.gregs[REG_EFL] |= trap_flag;
+    }
+
+    void on_step(int signal, siginfo_t *, void *context) {
+        auto *state = static_cast<ucontext_t *>(context);
+
+        if (!pending.active) {
+            pass_through(signal);
+            return;
+        }
+
+        state->uc_mcontext.gregs[REG_EFL] &= ~trap_flag;
+
+        if (pending.write) {
+            run_write_hooks(pending.address, pending.old_value[0], word(pending.address));
+
+            if (observer) {
+                observer(pending.address, pending.old_value[0], word(pending.address), true);
+            }
+
+            // 64-bit stores touch the following word as well
+            if (page_of(pending.address + 4) == pending.page &&
+                    word(pending.address + 4) != pending.old_value[1]) {
+                run_write_hooks(pending.address + 4, pending.old_value[1],
+                    word(pending.address + 4));
+
+                if (observer) {
+                    observer(pending.address + 4, pending.old_value[1],
+                        word(pending.address + 4), true);
+                }
+            }
+        } else if (observer) {
+            observer(pending.address, word(pending.address), word(pending.address), false);
+        }
+
+        pending.active = false;
+
+        if (page_hooked(pending.page)) {
+            set_access(pending.page, false);
+        }
+    }
+
+    template <typename Operation>
+    void raw_access(lp::addr_t address, Operation operation) noexcept {
+        const lp::addr_t page = page_of(address);
+        const bool lifted = page_hooked(page) && !(pending.active && pending.page == page);
+
+        if (lifted) {
+            set_access(page, true);
+        }
+
+        operation(word(address));
+
+        if (lifted) {
+            set_access(page, false);
+        }
+    }
+}
+
+bool sim::init() noexcept {
+    if (mapped) {
+        return true;
+    }
+
+    for (const auto &r : regions) {
+        void *memory = mmap(reinterpret_cast<void *>(r.base), r.size,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+        if (memory != reinterpret_cast<void *>(r.base)) {
+            return false;
+        }
+    }
+
+    struct sigaction action = {};
+
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+
+    action.sa_sigaction = on_fault;
+    sigaction(SIGSEGV, &action, nullptr);
+
+    action.sa_sigaction = on_step;
+    sigaction(SIGTRAP, &action, nullptr);
+
+    mapped = true;
+
+    return true;
+}
+
+void sim::reset() noexcept {
+    clear_hooks();
+
+    for (const auto &r : regions) {
+        void *memory = reinterpret_cast<void *>(r.base);
+
+        mprotect(memory, r.size, PROT_READ | PROT_WRITE);
+        memset(memory, 0, r.size);
+
+        if (observer && r.registers) {
+            mprotect(memory, r.size, PROT_NONE);
+        }
+    }
+}
+
+lp::u32_t sim::peek(lp::addr_t address) noexcept {
+    lp::u32_t value = 0;
+
+    raw_access(address, [&value](lp::u32_t &w) { value = w; });
+
+    return value;
+}
+
+void sim::poke(lp::addr_t address, lp::u32_t value) noexcept {
+    raw_access(address, [value](lp::u32_t &w) { w = value; });
+}
+
+bool sim::on_read(lp::addr_t address, read_hook hook) noexcept {
+    if (hook_count == max_hooks || !in_model(address)) {
+        return false;
+    }
+
+    hooks[hook_count++] = {word_of(address), hook, nullptr};
+    set_access(page_of(address), false);
+
+    return true;
+}
+
+bool sim::on_write(lp::addr_t address, write_hook hook) noexcept {
+    if (hook_count == max_hooks || !in_model(address)) {
+        return false;
+    }
+
+    hooks[hook_count++] = {word_of(address), nullptr, hook};
+    set_access(page_of(address), false);
+
+    return true;
+}
+
+void sim::clear_hooks() noexcept {
+    const lp::u32_t count = hook_count;
+
+    hook_count = 0;
+
+    for (lp::u32_t i = 0; i < count; ++i) {
+        set_access(page_of(hooks[i].address), !page_hooked(page_of(hooks[i].address)));
+    }
+}
+
+void sim::watch(access_hook hook) noexcept {
+    observer = hook;
+
+    for (const auto &r : regions) {
+        if (!r.registers) {
+            continue;
+        }
+
+        for (lp::addr_t page = r.base; page < r.base + r.size; page += page_size) {
+            set_access(page, !page_hooked(page));
+        }
+    }
+}
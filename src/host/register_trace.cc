@@ -0,0 +1,212 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host register access trace
+ * @file register_trace.cc
+ * @author Boris Vinogradov
+ */
+
+#include <string.h>
+
+#include "register_trace.hh"
+
+namespace {
+    using namespace sim::trace;
+
+    struct scope_entry {
+        const char *name;
+        counters count;
+    };
+
+    // entry 0 collects accesses made outside of any scope
+    scope_entry scopes[max_scopes] = {{"-", {}}};
+    lp::u32_t scope_count = 1;
+    lp::u8_t stack[max_depth];
+    lp::u32_t depth = 0;
+    lp::u32_t overflow_depth = 0;
+
+    record records[max_records];
+    lp::u32_t record_count = 0;
+    lp::u32_t lost_count = 0;
+    counters total = {};
+    bool logging = false;
+
+    // previous access, used to spot read-modify-write pairs
+    lp::addr_t last_address = 0;
+    bool last_read = false;
+
+    lp::u8_t current_scope() noexcept {
+        return depth ? stack[depth - 1] : 0;
+    }
+
+    lp::u8_t find_scope(const char *name) noexcept {
+        for (lp::u32_t i = 1; i < scope_count; ++i) {
+            if (scopes[i].name == name || strcmp(scopes[i].name, name) == 0) {
+                return i;
+            }
+        }
+
+        if (scope_count == max_scopes) {
+            return 0;
+        }
+
+        scopes[scope_count] = {name, {}};
+
+        return scope_count++;
+    }
+
+    void count(counters &c, bool write, bool redundant, bool modify) noexcept {
+        if (write) {
+            ++c.writes;
+            c.redundant_writes += redundant;
+            c.read_modify_writes += modify;
+        } else {
+            ++c.reads;
+        }
+    }
+
+    void on_access(lp::addr_t address, lp::u32_t old_value, lp::u32_t new_value,
+            bool write) noexcept {
+        const lp::u8_t index = current_scope();
+        const bool redundant = write && old_value == new_value;
+        const bool modify = write && last_read && last_address == address;
+
+        count(total, write, redundant, modify);
+        count(scopes[index].count, write, redundant, modify);
+
+        last_address = address;
+        last_read = !write;
+
+        if (!logging) {
+            return;
+        }
+
+        if (record_count == max_records) {
+            ++lost_count;
+            return;
+        }
+
+        records[record_count++] = {address, old_value, new_value,
+            write ? access_kind::write : access_kind::read, index};
+    }
+
+    void print_counters(FILE *out, const char *name, const counters &c) noexcept {
+        fprintf(out, "%-32s %8u %8u %8u %10u %8u\n", name, c.calls, c.reads, c.writes,
+            c.redundant_writes, c.read_modify_writes);
+    }
+}
+
+void sim::trace::start(bool log) noexcept {
+    logging = log;
+    last_read = false;
+    watch(on_access);
+}
+
+void sim::trace::stop() noexcept {
+    watch(nullptr);
+}
+
+void sim::trace::clear() noexcept {
+    for (lp::u32_t i = 0; i < scope_count; ++i) {
+        scopes[i].count = {};
+    }
+
+    record_count = 0;
+    lost_count = 0;
+    total = {};
+    last_read = false;
+}
+
+sim::trace::counters sim::trace::totals() noexcept {
+    return total;
+}
+
+sim::trace::counters sim::trace::totals(const char *name) noexcept {
+    for (lp::u32_t i = 1; i < scope_count; ++i) {
+        if (strcmp(scopes[i].name, name) == 0) {
+            return scopes[i].count;
+        }
+    }
+
+    return {};
+}
+
+lp::u32_t sim::trace::size() noexcept {
+    return record_count;
+}
+
+lp::u32_t sim::trace::lost() noexcept {
+    return lost_count;
+}
+
+const sim::trace::record &sim::trace::at(lp::u32_t index) noexcept {
+    return records[index];
+}
+
+const char *sim::trace::scope_name(lp::u8_t index) noexcept {
+    return index < scope_count ? scopes[index].name : "-";
+}
+
+void sim::trace::report(FILE *out) noexcept {
+    fprintf(out, "%-32s %8s %8s %8s %10s %8s\n", "scope", "calls", "reads", "writes",
+        "redundant", "rmw");
+
+    for (lp::u32_t i = 0; i < scope_count; ++i) {
+        const counters &c = scopes[i].count;
+
+        if (c.calls || c.reads || c.writes) {
+            print_counters(out, scopes[i].name, c);
+        }
+    }
+
+    print_counters(out, "total", total);
+
+    for (lp::u32_t i = 0; i < record_count; ++i) {
+        const record &r = records[i];
+
+        if (r.kind == access_kind::read) {
+            fprintf(out, "  %-30s R 0x%08lx 0x%08x\n", scope_name(r.scope),
+                static_cast<unsigned long>(r.address), r.new_value);
+        } else {
+            fprintf(out, "  %-30s W 0x%08lx 0x%08x -> 0x%08x%s\n", scope_name(r.scope),
+                static_cast<unsigned long>(r.address), r.old_value, r.new_value,
+                r.old_value == r.new_value ? " redundant" : "");
+        }
+    }
+
+    if (lost_count) {
+        fprintf(out, "  %u records lost\n", lost_count);
+    }
+}
+
+sim::trace::scope::scope(const char *name) noexcept {
+    // nesting deeper than the stack is attributed to the deepest scope
+    if (depth == max_depth) {
+        ++overflow_depth;
+        return;
+    }
+
+    stack[depth++] = find_scope(name);
+    ++scopes[current_scope()].count.calls;
+    ++total.calls;
+}
+
+sim::trace::scope::~scope() noexcept {
+    if (overflow_depth) {
+        --overflow_depth;
+        return;
+    }
+
+    --depth;
+}
@@ -0,0 +1,66 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware support flash routines running from ram
+ * @file flash_ram.cc
+ * @author Boris Vinogradov
+ */
+
+#include "flash_ram.hh"
+
+#include <flash.hh>
+
+#include <hal/flash_device.hh>
+
+namespace flash_ram {
+    namespace {
+        constexpr lp::u32_t bsy = ::flash::sr_bsy::mask<lp::u32_t>::value;
+        constexpr lp::u32_t fstpg = ::flash::cr_fstpg::mask<lp::u32_t>::value;
+        constexpr lp::u32_t errors =
+            ::flash::sr_operr::mask<lp::u32_t>::value |
+            ::flash::sr_progerr::mask<lp::u32_t>::value |
+            ::flash::sr_wrperr::mask<lp::u32_t>::value |
+            ::flash::sr_pgaerr::mask<lp::u32_t>::value |
+            ::flash::sr_sizerr::mask<lp::u32_t>::value |
+            ::flash::sr_pgserr::mask<lp::u32_t>::value |
+            ::flash::sr_miserr::mask<lp::u32_t>::value |
+            ::flash::sr_fasterr::mask<lp::u32_t>::value;
+    }
+
+    // registers through plain pointers: register access helpers are not
+    // guaranteed to be inlined and must not be called from flash here
+    __attribute__((section(".ramfunc"), noinline))
+    lp::u32_t program_row(lp::addr_t address, const lp::u32_t *words) noexcept {
+        volatile lp::u32_t *const sr = reinterpret_cast<volatile lp::u32_t *>(::flash::sr::address);
+        volatile lp::u32_t *const cr = reinterpret_cast<volatile lp::u32_t *>(::flash::cr::address);
+        volatile lp::u32_t *const target = reinterpret_cast<volatile lp::u32_t *>(address);
+
+        while (*sr & bsy) {
+        }
+
+        *sr = errors;
+        *cr = *cr | fstpg;
+
+        for (lp::u32_t i = 0; i < hal::flash_device::row_size / 4; ++i) {
+            target[i] = words[i];
+        }
+
+        while (*sr & bsy) {
+        }
+
+        *cr = *cr & ~fstpg;
+
+        return *sr & errors;
+    }
+}
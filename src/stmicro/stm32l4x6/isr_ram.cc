@@ -0,0 +1,23 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Hardware support ram vector table
+ * @file isr_ram.cc
+ * @author Boris Vinogradov
+ */
+
+#include "isr_ram.hh"
+
+__attribute__((section(".ram_vectors"), aligned(isr::ram_vectors_align)))
+void (*ram_vectors_table[isr::ram_vectors_count])();
@@ -0,0 +1,129 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test of software aes against fips-197 and sp 800-38a vectors
+ * @file aes_software.cc
+ * @author Boris Vinogradov
+ */
+
+#include <hal/aes.hh>
+
+#include "check.hh"
+
+namespace {
+    using software = hal::aes_software;
+
+    const lp::u8_t sp_key[16] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+    };
+
+    const lp::u8_t sp_plain[32] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51
+    };
+
+    bool same(const lp::u8_t *one, const lp::u8_t *two, lp::u32_t size) noexcept {
+        return __builtin_memcmp(one, two, size) == 0;
+    }
+
+    /// Known answer both ways, then the same stream in one call against
+    /// block by block calls
+    void check_vector(hal::aes_chain chain, const lp::u8_t *key, const lp::u8_t *iv,
+            const lp::u8_t *plain, const lp::u8_t *cipher, lp::u32_t blocks) noexcept {
+        hal::aes_context encrypt;
+        hal::aes_context decrypt;
+        lp::u8_t output[32];
+
+        software::init(encrypt, chain, hal::aes_direction::encrypt, key, iv);
+        CHECK(software::process(encrypt, plain, output, blocks));
+        CHECK(same(output, cipher, blocks * 16));
+
+        software::init(decrypt, chain, hal::aes_direction::decrypt, key, iv);
+
+        for (lp::u32_t i = 0; i < blocks; ++i) {
+            software::process(decrypt, cipher + i * 16, output + i * 16, 1);
+        }
+
+        CHECK(same(output, plain, blocks * 16));
+    }
+
+    /// Streams taking turns keep their own chaining and key schedule
+    void check_interleaved() noexcept {
+        lp::u8_t buffer[64];
+        lp::u8_t whole[64];
+        lp::u8_t turns[64];
+        lp::u8_t other[64];
+        hal::aes_context one;
+        hal::aes_context two;
+
+        for (lp::u32_t i = 0; i < sizeof(buffer); ++i) {
+            buffer[i] = static_cast<lp::u8_t>(i * 37 + 11);
+        }
+
+        software::init(one, hal::aes_chain::cbc, hal::aes_direction::encrypt, sp_key, buffer);
+        software::process(one, buffer, whole, 4);
+
+        software::init(one, hal::aes_chain::cbc, hal::aes_direction::encrypt, sp_key, buffer);
+        software::init(two, hal::aes_chain::cbc, hal::aes_direction::decrypt, buffer + 16, buffer);
+
+        for (lp::u32_t i = 0; i < 4; ++i) {
+            software::process(one, buffer + i * 16, turns + i * 16, 1);
+            software::process(two, buffer + i * 16, other + i * 16, 1);
+        }
+
+        CHECK(same(whole, turns, sizeof(whole)));
+
+        software::init(two, hal::aes_chain::cbc, hal::aes_direction::decrypt, sp_key, buffer);
+        software::process(two, turns, turns, 4);
+
+        CHECK(same(turns, buffer, sizeof(buffer)));
+    }
+}
+
+int main() {
+    const lp::u8_t fips_key[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+    const lp::u8_t fips_plain[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    const lp::u8_t fips_cipher[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    const lp::u8_t ecb_cipher[16] = {
+        0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97
+    };
+    const lp::u8_t cbc_iv[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+    const lp::u8_t cbc_cipher[32] = {
+        0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+        0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2
+    };
+    const lp::u8_t ctr_counter[16] = {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+    };
+    const lp::u8_t ctr_cipher[32] = {
+        0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+        0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff
+    };
+
+    check_vector(hal::aes_chain::ecb, fips_key, nullptr, fips_plain, fips_cipher, 1);
+    check_vector(hal::aes_chain::ecb, sp_key, nullptr, sp_plain, ecb_cipher, 1);
+    check_vector(hal::aes_chain::cbc, sp_key, cbc_iv, sp_plain, cbc_cipher, 2);
+    check_vector(hal::aes_chain::ctr, sp_key, ctr_counter, sp_plain, ctr_cipher, 2);
+    check_interleaved();
+
+    return test::result();
+}
@@ -0,0 +1,53 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test checks
+ * @file check.hh
+ * @author Boris Vinogradov
+ */
+
+#include <stdio.h>
+
+#include <types.hh>
+
+#ifndef TEST_CHECK_HH
+#define TEST_CHECK_HH
+
+/// Failed checks are printed and counted, main returns test::result()
+/// so ctest sees a non-zero exit code
+namespace test {
+    inline lp::u32_t &failures() noexcept {
+        static lp::u32_t value = 0;
+        return value;
+    }
+
+    inline void check(bool condition, const char *expression, const char *file, int line) noexcept {
+        if (!condition) {
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            ++failures();
+        }
+    }
+
+    inline int result() noexcept {
+        if (failures()) {
+            fprintf(stderr, "%u checks failed\n", failures());
+        }
+
+        return failures() ? 1 : 0;
+    }
+}
+
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+
+#endif // TEST_CHECK_HH
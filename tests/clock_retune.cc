@@ -0,0 +1,125 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test of system time across hclk changes
+ * @file clock_retune.cc
+ * @author Boris Vinogradov
+ */
+
+#include <register_model.hh>
+
+#include <hal/clock.hh>
+
+#include "check.hh"
+
+namespace {
+    using sys = hal::clock<80000000>;
+
+    constexpr lp::u32_t pendstset = ::scb::icsr_pendstset::mask<lp::u32_t>::value;
+
+    lp::u32_t first_load = 0;
+    lp::u32_t loads = 0;
+
+    void record_load(lp::addr_t, lp::u32_t, lp::u32_t value) noexcept {
+        if (loads++ == 0) {
+            first_load = value;
+        }
+    }
+
+    /// SysTick model: value as counted down from period
+    void counted(lp::u32_t period, lp::u32_t cycles) noexcept {
+        sim::poke<::stk::val>(period - 1 - cycles);
+    }
+
+    void nominal() noexcept {
+        sys::start();
+
+        for (int tick = 0; tick < 3; ++tick) {
+            sys::irq_handler();
+        }
+
+        counted(80000, 20000);
+
+        CHECK(sys::now() == 3 * 80000 + 20000);
+    }
+
+    void slower_hclk() noexcept {
+        loads = 0;
+        sys::retune(40000000);
+
+        // 59999 cycles of 80 MHz left in this tick are 29999 counts at 40 MHz
+        CHECK(loads == 2);
+        CHECK(first_load == 29999);
+        CHECK(sim::peek<::stk::load>() == 39999);
+
+        // counter reloaded from the shortened period
+        sim::poke<::stk::val>(29999);
+
+        CHECK(sys::now() == 3 * 80000 + 20000);
+
+        sys::irq_handler();
+        counted(40000, 10000);
+
+        CHECK(sys::ticks() == 4);
+        CHECK(sys::now() == 4 * 80000 + 20000);
+    }
+
+    void resume_scaled() noexcept {
+        loads = 0;
+
+        CHECK(sys::halt());
+
+        // 2.5 ticks slept in 80 MHz cycles
+        sys::resume(200000);
+
+        // 20000 + 200000 is 2 ticks and 60000 cycles, 19999 cycles left
+        // are 9999 counts at 40 MHz
+        CHECK(first_load == 9999);
+        CHECK(sim::peek<::stk::load>() == 39999);
+        CHECK(sys::ticks() == 6);
+    }
+
+    void pending_tick() noexcept {
+        sys::retune(40000000);
+        sys::irq_handler();
+        counted(40000, 100);
+        sim::poke<::scb::icsr>(pendstset);
+
+        const lp::u64_t ticks = sys::ticks();
+
+        loads = 0;
+        sys::retune(80000000);
+
+        // the pending tick is counted and cleared, not counted twice
+        CHECK(!(sim::peek<::scb::icsr>() & pendstset));
+        CHECK(sys::ticks() == ticks);
+        CHECK(sim::peek<::stk::load>() == 79999);
+    }
+}
+
+int main() {
+    if (!sim::init()) {
+        fprintf(stderr, "register model init failed\n");
+        return 1;
+    }
+
+    CHECK(sim::on_write<::stk::load>(record_load));
+
+    nominal();
+    slower_hclk();
+    resume_scaled();
+    pending_tick();
+
+    return test::result();
+}
@@ -0,0 +1,88 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test of software crc against catalogue check values
+ * @file crc_software.cc
+ * @author Boris Vinogradov
+ */
+
+#include <hal/crc.hh>
+
+#include "check.hh"
+
+namespace {
+    const char check_input[] = "123456789";
+
+    /// Bit by bit crc straight from the model parameters
+    template <typename Config>
+    lp::u32_t reference(const lp::u8_t *bytes, lp::u32_t size) noexcept {
+        const lp::u32_t top = 1u << (Config::width - 1);
+        lp::u32_t state = Config::init;
+
+        for (lp::u32_t i = 0; i < size; ++i) {
+            const lp::u32_t byte = Config::reflect_in ? hal::crc_table::reflect(bytes[i], 8) : bytes[i];
+
+            state ^= byte << (Config::width - 8);
+
+            for (lp::u32_t bit = 0; bit < 8; ++bit) {
+                state = state & top ? (state << 1) ^ Config::poly : state << 1;
+            }
+
+            state &= Config::mask;
+        }
+
+        if (Config::reflect_out) {
+            state = hal::crc_table::reflect(state, Config::width);
+        }
+
+        return (state ^ Config::xor_out) & Config::mask;
+    }
+
+    /// Catalogue check value, then every length and alignment of a
+    /// buffer against the reference, whole and in two updates
+    template <typename Config>
+    void check_config(lp::u32_t expected) noexcept {
+        using software = hal::crc_software<Config>;
+
+        CHECK(software::compute(check_input, 9) == expected);
+
+        lp::u8_t buffer[72];
+
+        for (lp::u32_t i = 0; i < sizeof(buffer); ++i) {
+            buffer[i] = static_cast<lp::u8_t>(i * 37 + 11);
+        }
+
+        for (lp::u32_t offset = 0; offset < 8; ++offset) {
+            for (lp::u32_t size = 0; size + offset <= sizeof(buffer); ++size) {
+                const lp::u8_t *data = buffer + offset;
+                const lp::u32_t split = size / 3;
+                const lp::u32_t parts = software::finish(software::update(
+                    software::update(software::start(), data, split), data + split, size - split));
+
+                CHECK(software::compute(data, size) == reference<Config>(data, size));
+                CHECK(parts == reference<Config>(data, size));
+            }
+        }
+    }
+}
+
+int main() {
+    check_config<hal::crc32>(0xcbf43926);
+    check_config<hal::crc32_mpeg2>(0x0376e6e7);
+    check_config<hal::crc16_ccitt_false>(0x29b1);
+    check_config<hal::crc16_modbus>(0x4b37);
+    check_config<hal::crc8_smbus>(0xf4);
+
+    return test::result();
+}
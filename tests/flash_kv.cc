@@ -0,0 +1,272 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test of flash key/value store rebuild, collection and resets
+ * @file flash_kv.cc
+ * @author Boris Vinogradov
+ */
+
+#include <flash_model.hh>
+#include <register_model.hh>
+
+#include <hal/flash_kv.hh>
+
+#include "check.hh"
+
+namespace {
+    using model = sim::flash_model;
+
+    constexpr lp::addr_t region = 0x08080000;
+    constexpr lp::u32_t pages = 3;
+    constexpr lp::u32_t region_size = pages * hal::flash_device::page_size;
+
+    using store = hal::flash_kv<region, pages, 16, 32>;
+    /// Same pages with room for more keys than store indexes
+    using wide_store = hal::flash_kv<region, pages, 64, 32>;
+    /// Two pages of 14 largest records each
+    using small_store = hal::flash_kv<region, 2, 16, 128>;
+
+    lp::u8_t image[region_size];
+    lp::u32_t erase_countdown = 0;
+
+    /// Keep the region as a reset right before the chosen erase leaves it
+    void cut_power(lp::addr_t, lp::u32_t) noexcept {
+        if (erase_countdown && --erase_countdown == 0) {
+            __builtin_memcpy(image, reinterpret_cast<const void *>(region), region_size);
+        }
+    }
+
+    void power_up() noexcept {
+        __builtin_memcpy(reinterpret_cast<void *>(region), image, region_size);
+    }
+
+    void fill(lp::u32_t *value, lp::u32_t word) noexcept {
+        for (lp::u32_t i = 0; i < 8; ++i) {
+            value[i] = word + i;
+        }
+    }
+
+    template <typename Store>
+    bool holds(lp::u16_t key, lp::u32_t word) noexcept {
+        lp::u32_t value[8];
+        lp::u32_t expected[8];
+        lp::u32_t size = 0;
+
+        fill(expected, word);
+
+        return Store::get(key, value, sizeof(value), size) == hal::kv_status::ok && size == sizeof(value) &&
+            __builtin_memcmp(value, expected, size) == 0;
+    }
+
+    /// Newest values and removals survive a restart
+    void rebuild() noexcept {
+        lp::u32_t value[8];
+
+        CHECK(model::attach());
+        CHECK(store::start() == hal::kv_status::ok);
+
+        for (lp::u32_t round = 0; round < 3; ++round) {
+            for (lp::u16_t key = 0; key < 10; ++key) {
+                fill(value, round * 100 + key);
+                CHECK(store::set(key, value, sizeof(value)) == hal::kv_status::ok);
+            }
+        }
+
+        CHECK(store::remove(3) == hal::kv_status::ok);
+        CHECK(store::start() == hal::kv_status::ok);
+        CHECK(!store::contains(3));
+
+        for (lp::u16_t key = 0; key < 10; ++key) {
+            CHECK(key == 3 || holds<store>(key, 200 + key));
+        }
+    }
+
+    /// Updates over a few keys run many collections, values stay the
+    /// newest ones and erases spread over the pages
+    void collection() noexcept {
+        lp::u32_t value[8];
+
+        CHECK(model::attach());
+        CHECK(store::start() == hal::kv_status::ok);
+
+        for (lp::u32_t write = 0; write < 1000; ++write) {
+            fill(value, write);
+            CHECK(store::set(write % 12, value, sizeof(value)) == hal::kv_status::ok);
+        }
+
+        CHECK(store::report().collections > 10);
+
+        for (lp::u16_t key = 0; key < 12; ++key) {
+            CHECK(holds<store>(key, (999 - key) / 12 * 12 + key));
+        }
+
+        lp::u32_t least = store::wear(0);
+        lp::u32_t most = least;
+
+        for (lp::u32_t page = 1; page < pages; ++page) {
+            least = store::wear(page) < least ? store::wear(page) : least;
+            most = store::wear(page) > most ? store::wear(page) : most;
+        }
+
+        CHECK(most - least <= 1);
+    }
+
+    /// Reset between the copies of a collection and the erase of its
+    /// page, start() finishes the collection and nothing is lost
+    void interrupted_collection() noexcept {
+        lp::u32_t value[8];
+
+        CHECK(model::attach());
+        CHECK(store::start() == hal::kv_status::ok);
+
+        for (lp::u16_t key = 20; key < 25; ++key) {
+            fill(value, key);
+            CHECK(store::set(key, value, sizeof(value)) == hal::kv_status::ok);
+        }
+
+        model::before_erase(cut_power);
+        erase_countdown = 1;
+
+        lp::u32_t write = 0;
+
+        for (; erase_countdown && write < 1000; ++write) {
+            fill(value, write);
+            store::set(write % 10, value, sizeof(value));
+        }
+
+        CHECK(erase_countdown == 0);
+
+        model::before_erase(nullptr);
+        power_up();
+
+        CHECK(store::start() == hal::kv_status::ok);
+        CHECK(store::report().collections == 1);
+
+        for (lp::u16_t key = 20; key < 25; ++key) {
+            CHECK(holds<store>(key, key));
+        }
+
+        for (lp::u32_t more = 0; more < 300; ++more) {
+            fill(value, more);
+            CHECK(store::set(more % 10, value, sizeof(value)) == hal::kv_status::ok);
+        }
+
+        for (lp::u16_t key = 20; key < 25; ++key) {
+            CHECK(holds<store>(key, key));
+        }
+    }
+
+    /// A page whose format was cut short keeps a wear count as high as
+    /// the others instead of starting over
+    void interrupted_format() noexcept {
+        lp::u32_t value[8];
+
+        CHECK(model::attach());
+        CHECK(store::start() == hal::kv_status::ok);
+
+        for (lp::u32_t write = 0; write < 300; ++write) {
+            fill(value, write);
+            store::set(write % 4, value, sizeof(value));
+        }
+
+        lp::u32_t spare = pages;
+        lp::u32_t highest = 0;
+
+        for (lp::u32_t page = 0; page < pages; ++page) {
+            const lp::addr_t address = region + page * hal::flash_device::page_size;
+
+            if (*reinterpret_cast<const lp::u32_t *>(address + 8) == ~0u) {
+                spare = page;
+            } else if (store::wear(page) > highest) {
+                highest = store::wear(page);
+            }
+        }
+
+        CHECK(highest > 1);
+        CHECK(spare < pages);
+
+        __builtin_memset(reinterpret_cast<void *>(region + spare * hal::flash_device::page_size), 0xff,
+            hal::flash_device::page_size);
+
+        CHECK(store::start() == hal::kv_status::ok);
+        CHECK(store::wear(spare) > highest);
+    }
+
+    /// Records of keys a smaller index cannot hold are reported and
+    /// never collected away
+    void index_overflow() noexcept {
+        lp::u32_t value[8];
+
+        CHECK(model::attach());
+        CHECK(wide_store::start() == hal::kv_status::ok);
+
+        for (lp::u16_t key = 0; key < 20; ++key) {
+            fill(value, key);
+            CHECK(wide_store::set(key, value, sizeof(value)) == hal::kv_status::ok);
+        }
+
+        CHECK(store::start() == hal::kv_status::full);
+        CHECK(store::report().unindexed == 4);
+
+        // indexed keys still update until a collection would be needed
+        for (lp::u32_t write = 0; write < 200; ++write) {
+            fill(value, write);
+
+            if (store::set(write % 16, value, sizeof(value)) != hal::kv_status::ok) {
+                break;
+            }
+        }
+
+        CHECK(store::report().collections == 0);
+        CHECK(wide_store::start() == hal::kv_status::ok);
+
+        for (lp::u16_t key = 16; key < 20; ++key) {
+            CHECK(holds<wide_store>(key, key));
+        }
+    }
+
+    /// A new key whose write fails does not keep its index slot
+    void failed_write() noexcept {
+        lp::u8_t value[128] = {};
+
+        CHECK(model::attach());
+        CHECK(small_store::start() == hal::kv_status::ok);
+
+        for (lp::u16_t key = 0; key < 14; ++key) {
+            CHECK(small_store::set(key, value, sizeof(value)) == hal::kv_status::ok);
+        }
+
+        CHECK(small_store::set(100, value, sizeof(value)) == hal::kv_status::full);
+        CHECK(small_store::set(101, value, sizeof(value)) == hal::kv_status::full);
+        CHECK(!small_store::contains(100));
+
+        // the removed key keeps its slot, a new one gets the fifteenth
+        CHECK(small_store::remove(0) == hal::kv_status::ok);
+        CHECK(small_store::set(200, value, sizeof(value)) == hal::kv_status::ok);
+        CHECK(small_store::contains(200));
+    }
+}
+
+int main() {
+    sim::init();
+
+    rebuild();
+    collection();
+    interrupted_collection();
+    interrupted_format();
+    index_overflow();
+    failed_write();
+
+    return test::result();
+}
@@ -0,0 +1,159 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test of register access trace
+ * @file register_trace.cc
+ * @author Boris Vinogradov
+ */
+
+#include <register_trace.hh>
+
+#include <gpio.hh>
+
+#include <hal/gpio_device.hh>
+
+#include "check.hh"
+
+namespace {
+    using port = hal::gpio_device::gpioa;
+
+    // clears the mode field, then sets it: two read-modify-writes of moder
+    void set_output() noexcept {
+        sim::trace::scope s("gpio::set_mode");
+        port::set_mode<hal::pins::mode::output, hal::pins::p5>();
+    }
+
+    void scoped_counters() noexcept {
+        set_output();
+        set_output();
+
+        const sim::trace::counters c = sim::trace::totals("gpio::set_mode");
+
+        CHECK(c.calls == 2);
+        CHECK(c.reads == 4);
+        CHECK(c.writes == 4);
+        CHECK(c.read_modify_writes == 4);
+        // the first clear stores the reset value already there
+        CHECK(c.redundant_writes == 1);
+        CHECK(sim::peek<::gpioa::moder>() == 0b01 << 10);
+
+        const sim::trace::counters unknown = sim::trace::totals("never");
+
+        CHECK(unknown.calls == 0 && unknown.reads == 0 && unknown.writes == 0);
+    }
+
+    void records() noexcept {
+        CHECK(sim::trace::size() == 8);
+        CHECK(sim::trace::lost() == 0);
+
+        const sim::trace::record &read = sim::trace::at(2);
+        const sim::trace::record &write = sim::trace::at(3);
+
+        CHECK(read.kind == sim::trace::access_kind::read);
+        CHECK(read.address == ::gpioa::moder::address);
+        CHECK(write.kind == sim::trace::access_kind::write);
+        CHECK(write.old_value == 0 && write.new_value == 0b01 << 10);
+        CHECK(__builtin_strcmp(sim::trace::scope_name(write.scope), "gpio::set_mode") == 0);
+    }
+
+    /// gpio::configure reads and writes every register it touches once,
+    /// moder last
+    void configure_once() noexcept {
+        using config = hal::pin_config<hal::pins::mode::alt_func, hal::pins::speed::high, hal::pins::pull::up,
+            hal::pins::otype::open_drain, hal::pins::alt::af7>;
+
+        sim::trace::clear();
+
+        {
+            sim::trace::scope s("gpio::configure");
+            port::configure<config, hal::pins::p5, hal::pins::p10>();
+        }
+
+        const sim::trace::counters c = sim::trace::totals("gpio::configure");
+        const lp::addr_t touched[] = {
+            ::gpioa::otyper::address, ::gpioa::ospeedr::address, ::gpioa::pupdr::address,
+            ::gpioa::afrl::address, ::gpioa::afrh::address, ::gpioa::moder::address
+        };
+
+        CHECK(c.calls == 1);
+        CHECK(c.reads == 6);
+        CHECK(c.writes == 6);
+        CHECK(c.read_modify_writes == 6);
+
+        for (auto address : touched) {
+            lp::u32_t reads = 0;
+            lp::u32_t writes = 0;
+
+            for (lp::u32_t i = 0; i < sim::trace::size(); ++i) {
+                const sim::trace::record &entry = sim::trace::at(i);
+
+                if (entry.address == address) {
+                    reads += entry.kind == sim::trace::access_kind::read;
+                    writes += entry.kind == sim::trace::access_kind::write;
+                }
+            }
+
+            CHECK(reads == 1 && writes == 1);
+        }
+
+        const sim::trace::record &last = sim::trace::at(sim::trace::size() - 1);
+
+        CHECK(last.kind == sim::trace::access_kind::write && last.address == ::gpioa::moder::address);
+        CHECK(sim::peek<::gpioa::afrh>() == 7u << 8);
+    }
+
+    void unscoped() noexcept {
+        sim::trace::clear();
+
+        CHECK(sim::trace::size() == 0);
+        CHECK(sim::trace::totals().writes == 0);
+
+        ::gpiob::odr::get() = 1;
+
+        const sim::trace::counters total = sim::trace::totals();
+
+        CHECK(total.writes == 1 && total.reads == 0 && total.calls == 0);
+        CHECK(sim::trace::size() == 1);
+        CHECK(__builtin_strcmp(sim::trace::scope_name(sim::trace::at(0).scope), "-") == 0);
+    }
+
+    void stopped() noexcept {
+        sim::trace::stop();
+        sim::trace::clear();
+
+        ::gpiob::odr::get() = 2;
+
+        CHECK(sim::trace::totals().writes == 0);
+        CHECK(sim::peek<::gpiob::odr>() == 2);
+    }
+}
+
+int main() {
+    if (!sim::init()) {
+        fprintf(stderr, "register model init failed\n");
+        return 1;
+    }
+
+    sim::trace::start();
+
+    scoped_counters();
+    records();
+    configure_once();
+    unscoped();
+    stopped();
+
+    sim::reset();
+
+    return test::result();
+}
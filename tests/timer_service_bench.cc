@@ -0,0 +1,150 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host benchmark of timer service insert, cancel and expiry with 1k timers
+ * @file timer_service_bench.cc
+ * @author Boris Vinogradov
+ */
+
+#include <time.h>
+
+#include <register_model.hh>
+
+#include <hal/timer_service.hh>
+
+#include "check.hh"
+
+namespace {
+    constexpr lp::u32_t timers = 1024;
+    constexpr lp::u32_t rounds = 50;
+
+    using service = hal::timer_service<hal::tim2, timers>;
+
+    constexpr lp::u32_t cc1if = ::tim2::sr_cc1if::mask<lp::u32_t>::value;
+
+    service::handle handles[timers];
+    lp::u32_t fired = 0;
+    lp::u32_t last = 0;
+    bool ordered = true;
+    lp::u32_t seed = 1;
+
+    lp::u32_t random_delay() noexcept {
+        seed = seed * 1664525 + 1013904223;
+        return 1 + (seed >> 8) % 1000000;
+    }
+
+    lp::u64_t nanoseconds() noexcept {
+        timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return static_cast<lp::u64_t>(now.tv_sec) * 1000000000u + now.tv_nsec;
+    }
+
+    void expired(void *) noexcept {
+        const lp::u32_t now = service::now();
+
+        ordered = ordered && now - last <= service::max_delay;
+        last = now;
+        ++fired;
+    }
+
+    /// Counter jumps to the compare value, as the timer would reach it
+    void run_until_empty() noexcept {
+        while (service::pending()) {
+            sim::poke<::tim2::cnt>(sim::peek<::tim2::ccr1>());
+            sim::poke<::tim2::sr>(cc1if);
+            service::irq_handler();
+        }
+    }
+
+    struct figures {
+        lp::u64_t insert;
+        lp::u64_t expire;
+        lp::u64_t cancel;
+    };
+
+    void round(figures &total) noexcept {
+        lp::u64_t begin = nanoseconds();
+
+        for (auto &h : handles) {
+            h = service::start_once(random_delay(), expired);
+        }
+
+        total.insert += nanoseconds() - begin;
+
+        CHECK(service::pending() == timers);
+
+        last = service::now();
+        fired = 0;
+        begin = nanoseconds();
+        run_until_empty();
+        total.expire += nanoseconds() - begin;
+
+        CHECK(fired == timers);
+
+        for (auto &h : handles) {
+            h = service::start_once(random_delay(), expired);
+        }
+
+        begin = nanoseconds();
+
+        // every second handle, from the back, hits heap positions all over
+        for (lp::u32_t i = timers; i > 1; i -= 2) {
+            CHECK(service::cancel(handles[i - 1]));
+        }
+
+        total.cancel += nanoseconds() - begin;
+
+        CHECK(service::pending() == timers / 2);
+        CHECK(!service::cancel(handles[timers - 1]));
+
+        fired = 0;
+        last = service::now();
+        run_until_empty();
+
+        CHECK(fired == timers / 2);
+    }
+}
+
+int main() {
+    if (!sim::init()) {
+        fprintf(stderr, "register model init failed\n");
+        return 1;
+    }
+
+    service::start<80000000, 1000000>();
+    // start close to the counter wrap
+    sim::poke<::tim2::cnt>(0xfff00000);
+
+    figures total = {0, 0, 0};
+
+    for (lp::u32_t i = 0; i < rounds; ++i) {
+        round(total);
+    }
+
+    CHECK(ordered);
+
+    const double operations = static_cast<double>(rounds) * timers;
+
+    printf("timer_service %u timers, %u rounds\n", timers, rounds);
+    printf("  insert %8.1f ns\n", total.insert / operations);
+    printf("  expire %8.1f ns\n", total.expire / operations);
+    printf("  cancel %8.1f ns\n", total.cancel / (operations / 2));
+
+    service::stop();
+    sim::reset();
+
+    return test::result();
+}
@@ -0,0 +1,190 @@
+/* Copyright 2018 Boris Vinogradov <no111u3@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Host test of register model, usart model and usart dma receive
+ * @file usart_model.cc
+ * @author Boris Vinogradov
+ */
+
+#include <register_model.hh>
+#include <usart_model.hh>
+
+#include <hal/usart.hh>
+
+#include "check.hh"
+
+namespace {
+    using model = sim::usart_model<::usart1>;
+
+    lp::u32_t written = 0;
+
+    void count_write(lp::addr_t, lp::u32_t, lp::u32_t) noexcept {
+        ++written;
+    }
+
+    void plain_memory() noexcept {
+        ::usart2::brr::get() = 0x1234;
+
+        CHECK(sim::peek<::usart2::brr>() == 0x1234);
+
+        sim::poke<::usart2::brr>(0x45);
+
+        CHECK(::usart2::brr::get() == 0x45);
+    }
+
+    void write_hook() noexcept {
+        written = 0;
+
+        CHECK(sim::on_write<::usart2::cr1>(count_write));
+
+        ::usart2::cr1::get() = 1;
+        ::usart2::cr1::get() = ::usart2::cr1::get() | 2;
+
+        CHECK(written == 2);
+        CHECK(sim::peek<::usart2::cr1>() == 3);
+
+        // raw access bypasses hooks
+        sim::poke<::usart2::cr1>(0);
+
+        CHECK(written == 2);
+
+        sim::clear_hooks();
+        ::usart2::cr1::get() = 1;
+
+        CHECK(written == 2);
+    }
+
+    void transmit() noexcept {
+        CHECK(model::attach());
+
+        for (const char *p = "hello"; *p; ++p) {
+            hal::usart1::send(*p);
+        }
+
+        lp::u8_t out[16];
+        const lp::u32_t size = model::transmitted(out, sizeof(out));
+
+        CHECK(size == 5);
+        CHECK(__builtin_memcmp(out, "hello", 5) == 0);
+        CHECK(model::transmitted(out, sizeof(out)) == 0);
+    }
+
+    void receive() noexcept {
+        constexpr lp::u32_t rxne = ::usart1::isr_rxne::mask<lp::u32_t>::value;
+        constexpr lp::u32_t ore = ::usart1::isr_ore::mask<lp::u32_t>::value;
+
+        model::inject('x');
+
+        CHECK(sim::peek<::usart1::isr>() & rxne);
+        CHECK(hal::usart1::recv() == 'x');
+        CHECK(!(sim::peek<::usart1::isr>() & rxne));
+        CHECK(!(sim::peek<::usart1::isr>() & ore));
+
+        model::inject('a');
+        model::inject('b');
+
+        CHECK(sim::peek<::usart1::isr>() & ore);
+        CHECK(hal::usart1::recv() == 'b');
+    }
+
+    using stream = hal::usart2_dma<16>;
+
+    lp::u32_t received = 0;
+
+    void count_rx(const lp::u8_t *, lp::u32_t size) noexcept {
+        received += size;
+    }
+
+    void clear_dma_flags(lp::addr_t, lp::u32_t, lp::u32_t value) noexcept {
+        sim::poke<::dma1::isr>(sim::peek<::dma1::isr>() & ~value);
+    }
+
+    /// Dma at head with flags pending, published by the dma interrupt or
+    /// an idle line
+    void rx_event(lp::u32_t head, lp::u32_t flags, bool idle = false) noexcept {
+        sim::poke<stream::rx_channel::cndtr>(16 - head);
+        sim::poke<::dma1::isr>(flags);
+
+        if (idle) {
+            sim::poke<::usart2::isr>(::usart2::isr_idle::mask<lp::u32_t>::value);
+            stream::usart_irq_handler();
+        } else {
+            stream::rx_dma_irq_handler();
+        }
+    }
+
+    void dma_laps() noexcept {
+        constexpr lp::u32_t half = stream::rx_channel::flags::half;
+        constexpr lp::u32_t complete = stream::rx_channel::flags::complete;
+
+        CHECK(sim::on_write<::dma1::ifcr>(clear_dma_flags));
+
+        stream::start(count_rx);
+
+        rx_event(8, half);
+        rx_event(0, complete);
+        rx_event(3, 0, true);
+
+        CHECK(received == 19);
+        CHECK(stream::rx_laps() == 0);
+
+        // 18 bytes from 3 to 5, only the newest 2 are left
+        rx_event(5, half | complete);
+
+        CHECK(received == 21);
+        CHECK(stream::rx_laps() == 1);
+        CHECK(sim::peek<::dma1::isr>() == 0);
+
+        // half crossed between taking the flags and reading the position
+        rx_event(9, 0, true);
+        rx_event(10, half);
+
+        CHECK(received == 26);
+        CHECK(stream::rx_laps() == 1);
+
+        // complete alone can't be crossed from 10 to 12 without a lap
+        rx_event(12, complete);
+
+        CHECK(received == 28);
+        CHECK(stream::rx_laps() == 2);
+
+        // half a buffer late is reported as well
+        rx_event(1, half | complete, true);
+
+        CHECK(received == 33);
+        CHECK(stream::rx_laps() == 3);
+
+        stream::stop();
+        sim::clear_hooks();
+    }
+}
+
+int main() {
+    if (!sim::init()) {
+        fprintf(stderr, "register model init failed\n");
+        return 1;
+    }
+
+    plain_memory();
+    write_hook();
+    transmit();
+    receive();
+    dma_laps();
+
+    sim::reset();
+
+    CHECK(sim::peek<::usart1::isr>() == 0);
+
+    return test::result();
+}